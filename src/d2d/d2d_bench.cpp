@@ -0,0 +1,302 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "d2d/io/dsv_parser.hpp"
+#include "d2d/io/dsv_reader.hpp"
+#include "d2d/io/triangle_mesh.hpp"
+#include "d2d/io/vtp_stream_writer.hpp"
+#include "d2d/io/write_options.hpp"
+#include "d2d/util/adjacency.hpp"
+#include "d2d/util/disc_attributes.hpp"
+#include "d2d/util/synthetic.hpp"
+#ifdef D2D_WITH_VTK
+#include "d2d/io/vtp_writer.hpp"
+#endif
+
+// Microbenchmarks of the stages of dsv2vtp and msh2vtp on synthetic inputs
+// (see d2d/util/synthetic.hpp). The argument of each benchmark is the number
+// of points or vertices.
+
+namespace {
+
+  constexpr uint64_t seed = 1;
+
+  // A triangle mesh which is generated instead of read
+  class synthetic_mesh : public d2d::io::triangle_mesh<double> {
+  public:
+    synthetic_mesh(std::size_t pNumVertices)
+    {
+      auto grid = d2d::util::synthetic::surface_grid<double>::with_vertices(seed, pNumVertices);
+      this->mVertices = grid.get_vertices();
+      this->mTriangles = grid.get_triangles();
+    }
+  };
+
+  std::string create_dsv_text(std::size_t pNumPoints)
+  {
+    auto result = std::string {};
+    d2d::util::synthetic::append_dsv_rows(result, seed, 0, pNumPoints);
+    return result;
+  }
+
+  // A file in the temporary directory which is removed at the end of scope
+  class temp_file {
+  public:
+    temp_file(std::string const& pSuffix)
+    {
+      auto dir = std::getenv("TMPDIR");
+      mPath = std::string {dir != nullptr ? dir : "/tmp"} + "/d2d_bench_" +
+        std::to_string(::getpid()) + pSuffix;
+    }
+
+    ~temp_file()
+    {
+      std::remove(mPath.c_str());
+    }
+
+    temp_file(temp_file const&) = delete;
+    temp_file& operator=(temp_file const&) = delete;
+
+    std::string const& path() const
+    {
+      return mPath;
+    }
+
+  private:
+    std::string mPath;
+  };
+
+  // Sets the common counters of a benchmark over pNumItems items
+  void set_counters(benchmark::State& pState, std::size_t pNumItems)
+  {
+    pState.SetItemsProcessed((int64_t) (pState.iterations() * pNumItems));
+  }
+
+  void dsv_parser_parse(benchmark::State& pState)
+  {
+    auto numpoints = (std::size_t) pState.range(0);
+    auto text = create_dsv_text(numpoints);
+    for (auto _ : pState) {
+      auto parser = d2d::io::dsv_parser<double> {false};
+      auto columns = parser.parse(text.data(), text.data() + text.size());
+      benchmark::DoNotOptimize(columns.vertices.data());
+    }
+    set_counters(pState, numpoints);
+    pState.SetBytesProcessed((int64_t) (pState.iterations() * text.size()));
+  }
+  BENCHMARK(dsv_parser_parse)->RangeMultiplier(4)->Range(1 << 14, 1 << 20)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  // Includes mapping and reading the file (from the page cache)
+  void dsv_reader_read(benchmark::State& pState)
+  {
+    auto numpoints = (std::size_t) pState.range(0);
+    auto text = create_dsv_text(numpoints);
+    temp_file file {".dsv"};
+    {
+      auto out = std::fopen(file.path().c_str(), "wb");
+      if (out == nullptr || std::fwrite(text.data(), 1, text.size(), out) != text.size()) {
+        pState.SkipWithError("Could not write the input file");
+        if (out != nullptr)
+          std::fclose(out);
+        return;
+      }
+      std::fclose(out);
+    }
+    for (auto _ : pState) {
+      auto reader = d2d::io::dsv_reader<double> {file.path(), false};
+      benchmark::DoNotOptimize(reader.get_vertices().data());
+    }
+    set_counters(pState, numpoints);
+    pState.SetBytesProcessed((int64_t) (pState.iterations() * text.size()));
+  }
+  BENCHMARK(dsv_reader_read)->RangeMultiplier(4)->Range(1 << 14, 1 << 20)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  // Argument 1: build in parallel
+  void vertex_triangle_adjacency(benchmark::State& pState)
+  {
+    auto mesh = synthetic_mesh {(std::size_t) pState.range(0)};
+    auto vertices = mesh.get_vertices();
+    for (auto _ : pState) {
+      auto adjacency = d2d::util::vertex_triangle_adjacency
+        {vertices.size(), mesh.get_triangles(), pState.range(1) != 0};
+      benchmark::DoNotOptimize(adjacency.get_offsets().data());
+    }
+    set_counters(pState, vertices.size());
+  }
+  BENCHMARK(vertex_triangle_adjacency)
+    ->RangeMultiplier(4)->Ranges({{1 << 14, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  void create_disc_normals_from_triangles(benchmark::State& pState)
+  {
+    auto mesh = synthetic_mesh {(std::size_t) pState.range(0)};
+    auto vertices = mesh.get_vertices();
+    auto triangles = mesh.get_triangles();
+    auto adjacency = d2d::util::vertex_triangle_adjacency {vertices.size(), triangles};
+    for (auto _ : pState) {
+      auto normals = d2d::util::create_disc_normals_from_triangles
+        (vertices, triangles, adjacency);
+      benchmark::DoNotOptimize(normals.data());
+    }
+    set_counters(pState, vertices.size());
+  }
+  BENCHMARK(create_disc_normals_from_triangles)
+    ->RangeMultiplier(4)->Range(1 << 14, 1 << 20)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  void create_disc_radii_from_triangles(benchmark::State& pState)
+  {
+    auto mesh = synthetic_mesh {(std::size_t) pState.range(0)};
+    auto vertices = mesh.get_vertices();
+    auto triangles = mesh.get_triangles();
+    auto adjacency = d2d::util::vertex_triangle_adjacency {vertices.size(), triangles};
+    for (auto _ : pState) {
+      auto radii = d2d::util::create_disc_radii_from_triangles
+        (vertices, triangles, adjacency);
+      benchmark::DoNotOptimize(radii.data());
+    }
+    set_counters(pState, vertices.size());
+  }
+  BENCHMARK(create_disc_radii_from_triangles)
+    ->RangeMultiplier(4)->Range(1 << 14, 1 << 20)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  // The fused derivation which the writers use
+  void create_disc_attributes_from_triangles(benchmark::State& pState)
+  {
+    auto mesh = synthetic_mesh {(std::size_t) pState.range(0)};
+    auto vertices = mesh.get_vertices();
+    auto triangles = mesh.get_triangles();
+    auto adjacency = d2d::util::vertex_triangle_adjacency {vertices.size(), triangles};
+    for (auto _ : pState) {
+      auto discs = d2d::util::create_disc_attributes_from_triangles
+        (vertices, triangles, adjacency);
+      benchmark::DoNotOptimize(discs.radii.data());
+    }
+    set_counters(pState, vertices.size());
+  }
+  BENCHMARK(create_disc_attributes_from_triangles)
+    ->RangeMultiplier(4)->Range(1 << 14, 1 << 20)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  // The writer benchmarks take the number of vertices and the data mode
+  // (0: ascii, 1: binary, 2: appended). They write to a file in $TMPDIR,
+  // hence the file system is part of the measurement.
+  d2d::io::write_options
+  get_write_options(benchmark::State& pState, d2d::io::write_options::backend pWriter)
+  {
+    auto options = d2d::io::write_options {};
+    options.mode = static_cast<d2d::io::write_options::data_mode>(pState.range(1));
+    options.writer = pWriter;
+    options.verbose = false;
+    return options;
+  }
+
+  void writer_args(benchmark::internal::Benchmark* pBench)
+  {
+    for (auto numvertices : {1 << 14, 1 << 17, 1 << 20})
+      for (auto mode : {0, 1, 2})
+        pBench->Args({numvertices, mode});
+    pBench->Unit(benchmark::kMillisecond)->UseRealTime();
+  }
+
+  template<typename writer_type>
+  void write_dsv_discs(benchmark::State& pState, d2d::io::write_options::backend pWriter)
+  {
+    auto numpoints = (std::size_t) pState.range(0);
+    temp_file input {".dsv"};
+    {
+      auto text = create_dsv_text(numpoints);
+      auto out = std::fopen(input.path().c_str(), "wb");
+      if (out == nullptr || std::fwrite(text.data(), 1, text.size(), out) != text.size()) {
+        pState.SkipWithError("Could not write the input file");
+        if (out != nullptr)
+          std::fclose(out);
+        return;
+      }
+      std::fclose(out);
+    }
+    auto reader = d2d::io::dsv_reader<double> {input.path(), false};
+    temp_file output {".vtp"};
+    auto options = get_write_options(pState, pWriter);
+    for (auto _ : pState)
+      writer_type::write_disc_surface(reader, output.path(), options);
+    set_counters(pState, numpoints);
+  }
+
+  template<typename writer_type>
+  void write_mesh_discs(benchmark::State& pState, d2d::io::write_options::backend pWriter)
+  {
+    auto mesh = synthetic_mesh {(std::size_t) pState.range(0)};
+    temp_file output {".vtp"};
+    auto options = get_write_options(pState, pWriter);
+    for (auto _ : pState)
+      writer_type::write_disc_surface(mesh, output.path(), options);
+    set_counters(pState, mesh.get_vertices().size());
+  }
+
+  template<typename writer_type>
+  void write_mesh_triangles(benchmark::State& pState, d2d::io::write_options::backend pWriter)
+  {
+    auto mesh = synthetic_mesh {(std::size_t) pState.range(0)};
+    temp_file output {".vtp"};
+    auto options = get_write_options(pState, pWriter);
+    for (auto _ : pState)
+      writer_type::write_triangle_surface(mesh, output.path(), options);
+    set_counters(pState, mesh.get_vertices().size());
+  }
+
+  using native_writer = d2d::io::vtp_stream_writer<double>;
+  constexpr auto native = d2d::io::write_options::backend::native;
+
+  void write_dsv_discs_native(benchmark::State& pState)
+  {
+    write_dsv_discs<native_writer>(pState, native);
+  }
+  BENCHMARK(write_dsv_discs_native)->Apply(writer_args);
+
+  void write_mesh_discs_native(benchmark::State& pState)
+  {
+    write_mesh_discs<native_writer>(pState, native);
+  }
+  BENCHMARK(write_mesh_discs_native)->Apply(writer_args);
+
+  void write_mesh_triangles_native(benchmark::State& pState)
+  {
+    write_mesh_triangles<native_writer>(pState, native);
+  }
+  BENCHMARK(write_mesh_triangles_native)->Apply(writer_args);
+
+#ifdef D2D_WITH_VTK
+  using vtk_writer = d2d::io::vtp_writer<double>;
+  constexpr auto vtk = d2d::io::write_options::backend::vtk;
+
+  void write_dsv_discs_vtk(benchmark::State& pState)
+  {
+    write_dsv_discs<vtk_writer>(pState, vtk);
+  }
+  BENCHMARK(write_dsv_discs_vtk)->Apply(writer_args);
+
+  void write_mesh_discs_vtk(benchmark::State& pState)
+  {
+    write_mesh_discs<vtk_writer>(pState, vtk);
+  }
+  BENCHMARK(write_mesh_discs_vtk)->Apply(writer_args);
+
+  void write_mesh_triangles_vtk(benchmark::State& pState)
+  {
+    write_mesh_triangles<vtk_writer>(pState, vtk);
+  }
+  BENCHMARK(write_mesh_triangles_vtk)->Apply(writer_args);
+#endif
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/clo.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/synthetic.hpp"
+
+// Generates deterministic DSV and MSH inputs of any size for benchmarks and
+// scaling runs. The output is produced block by block; the items of a block
+// are generated concurrently.
+
+namespace {
+
+  using output_file = std::unique_ptr<std::FILE, int (*)(std::FILE*)>;
+
+  // The number of items generated by one task
+  constexpr std::size_t itemsPerTask = 1 << 16;
+
+  void put(std::FILE* pFile, std::string const& pStr)
+  {
+    if (std::fwrite(pStr.data(), 1, pStr.size(), pFile) != pStr.size())
+      throw std::runtime_error("Could not write the output file");
+  }
+
+  // Calls pFun(first, last, out) for consecutive ranges of [0, pNum) and
+  // writes the outputs in order
+  template<typename function_type>
+  void generate(std::FILE* pFile, std::size_t pNum, function_type pFun)
+  {
+    auto numtasks = 4 * d2d::util::parallel::get_num_threads();
+    auto blockitems = numtasks * itemsPerTask;
+    auto outs = std::vector<std::string> (numtasks);
+    for (std::size_t block = 0; block < pNum; block += blockitems) {
+      d2d::util::parallel::for_each_index(numtasks, [&](std::size_t tidx) {
+          auto first = std::min(pNum, block + tidx * itemsPerTask);
+          auto last = std::min(pNum, first + itemsPerTask);
+          outs[tidx].clear();
+          pFun(first, last, outs[tidx]);
+        });
+      for (auto const& out : outs)
+        put(pFile, out);
+    }
+  }
+
+  template<typename value_type>
+  void append_binary(std::string& pOut, value_type pValue)
+  {
+    pOut.append(reinterpret_cast<char const*>(&pValue), sizeof(pValue));
+  }
+
+  void append_line(std::string& pOut, char const* pFormat, ...)
+    __attribute__((format(printf, 2, 3)));
+
+  void append_line(std::string& pOut, char const* pFormat, ...)
+  {
+    char buffer[256];
+    va_list args;
+    va_start(args, pFormat);
+    auto len = std::vsnprintf(buffer, sizeof(buffer), pFormat, args);
+    va_end(args);
+    pOut.append(buffer, (std::size_t) len);
+  }
+
+  void write_dsv(std::FILE* pFile, uint64_t pSeed, std::size_t pNumPoints)
+  {
+    generate(pFile, pNumPoints, [pSeed](std::size_t pFirst, std::size_t pLast, std::string& pOut) {
+        d2d::util::synthetic::append_dsv_rows(pOut, pSeed, pFirst, pLast);
+      });
+  }
+
+  void write_msh
+  (std::FILE* pFile, uint64_t pSeed, std::size_t pNumVertices, bool pVersion2, bool pBinary)
+  {
+    auto grid = d2d::util::synthetic::surface_grid<double>::with_vertices(pSeed, pNumVertices);
+    auto numvertices = grid.num_vertices();
+    auto numtriangles = grid.num_triangles();
+    if (pVersion2 && numvertices + numtriangles >= (std::size_t) 1 << 31)
+      throw std::runtime_error("MSH 2.2 files hold less than 2^31 nodes and elements; use 4.1");
+
+    auto head = std::string {};
+    append_line(head, "$MeshFormat\n%s %d 8\n", pVersion2 ? "2.2" : "4.1", pBinary ? 1 : 0);
+    if (pBinary) {
+      append_binary<int32_t>(head, 1);
+      head += "\n";
+    }
+    head += "$EndMeshFormat\n";
+    if (!pVersion2) {
+      // One surface without physical tags and bounding curves
+      head += "$Entities\n";
+      if (pBinary) {
+        for (uint64_t value : {0, 0, 1, 0})
+          append_binary(head, value);
+        append_binary<int32_t>(head, 1);
+        for (double value : {0, 0, 0, 1, 1, 1})
+          append_binary(head, value);
+        append_binary<uint64_t>(head, 0);
+        append_binary<uint64_t>(head, 0);
+        head += "\n";
+      } else {
+        head += "0 0 1 0\n1 0 0 0 1 1 1 0 0\n";
+      }
+      head += "$EndEntities\n";
+    }
+    head += "$Nodes\n";
+    if (pVersion2)
+      append_line(head, "%zu\n", numvertices);
+    else if (pBinary) {
+      for (uint64_t value : {(uint64_t) 1, (uint64_t) numvertices, (uint64_t) 1, (uint64_t) numvertices})
+        append_binary(head, value);
+      append_binary<int32_t>(head, 2); // entity dimension
+      append_binary<int32_t>(head, 1); // entity tag
+      append_binary<int32_t>(head, 0); // no parametric coordinates
+      append_binary<uint64_t>(head, numvertices);
+    } else {
+      append_line(head, "1 %zu 1 %zu\n2 1 0 %zu\n", numvertices, numvertices, numvertices);
+    }
+    put(pFile, head);
+
+    // The node tags are 1, 2, ...
+    if (pVersion2) {
+      generate(pFile, numvertices, [&](std::size_t pFirst, std::size_t pLast, std::string& pOut) {
+          for (auto idx = pFirst; idx < pLast; ++idx) {
+            auto vertex = grid.get_vertex(idx);
+            if (pBinary) {
+              append_binary<int32_t>(pOut, (int32_t) (idx + 1));
+              for (auto coord : vertex)
+                append_binary(pOut, coord);
+            } else {
+              append_line(pOut, "%zu %.17g %.17g %.17g\n", idx + 1, vertex[0], vertex[1], vertex[2]);
+            }
+          }
+        });
+    } else {
+      // All the tags of the block, then all the coordinates
+      generate(pFile, numvertices, [&](std::size_t pFirst, std::size_t pLast, std::string& pOut) {
+          for (auto idx = pFirst; idx < pLast; ++idx)
+            if (pBinary)
+              append_binary<uint64_t>(pOut, idx + 1);
+            else
+              append_line(pOut, "%zu\n", idx + 1);
+        });
+      generate(pFile, numvertices, [&](std::size_t pFirst, std::size_t pLast, std::string& pOut) {
+          for (auto idx = pFirst; idx < pLast; ++idx) {
+            auto vertex = grid.get_vertex(idx);
+            if (pBinary)
+              for (auto coord : vertex)
+                append_binary(pOut, coord);
+            else
+              append_line(pOut, "%.17g %.17g %.17g\n", vertex[0], vertex[1], vertex[2]);
+          }
+        });
+    }
+
+    head.clear();
+    if (pBinary)
+      head += "\n";
+    head += "$EndNodes\n$Elements\n";
+    if (pVersion2) {
+      append_line(head, "%zu\n", numtriangles);
+      if (pBinary)
+        for (int32_t value : {2, (int32_t) numtriangles, 2}) // type, count, number of tags
+          append_binary(head, value);
+    } else if (pBinary) {
+      for (uint64_t value : {(uint64_t) 1, (uint64_t) numtriangles, (uint64_t) 1, (uint64_t) numtriangles})
+        append_binary(head, value);
+      append_binary<int32_t>(head, 2); // entity dimension
+      append_binary<int32_t>(head, 1); // entity tag
+      append_binary<int32_t>(head, 2); // triangles
+      append_binary<uint64_t>(head, numtriangles);
+    } else {
+      append_line(head, "1 %zu 1 %zu\n2 1 2 %zu\n", numtriangles, numtriangles, numtriangles);
+    }
+    put(pFile, head);
+
+    generate(pFile, numtriangles, [&](std::size_t pFirst, std::size_t pLast, std::string& pOut) {
+        for (auto idx = pFirst; idx < pLast; ++idx) {
+          auto triangle = grid.get_triangle(idx);
+          if (pVersion2 && pBinary) {
+            // The element tag, the physical and the elementary tag
+            for (auto value : {idx + 1, (std::size_t) 1, (std::size_t) 1})
+              append_binary<int32_t>(pOut, (int32_t) value);
+            for (auto node : triangle)
+              append_binary<int32_t>(pOut, (int32_t) (node + 1));
+          } else if (pVersion2) {
+            append_line(pOut, "%zu 2 2 1 1 %zu %zu %zu\n",
+                        idx + 1, triangle[0] + 1, triangle[1] + 1, triangle[2] + 1);
+          } else if (pBinary) {
+            append_binary<uint64_t>(pOut, idx + 1);
+            for (auto node : triangle)
+              append_binary<uint64_t>(pOut, node + 1);
+          } else {
+            append_line(pOut, "%zu %zu %zu %zu\n",
+                        idx + 1, triangle[0] + 1, triangle[1] + 1, triangle[2] + 1);
+          }
+        }
+      });
+
+    head.clear();
+    if (pBinary)
+      head += "\n";
+    head += "$EndElements\n";
+    put(pFile, head);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  auto optman = d2d::util::clo::manager {};
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"OUTPUT_FILE", {"--outfile", "-o"},
+                        "specifies the name of the output file", true});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"POINTS", {"--points", "-n"},
+                        "the number of DSV points or (at least) the number of mesh vertices", true});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"FORMAT", {"--format"},
+                        "dsv (default), msh (version 4.1) or msh2 (version 2.2)"});
+  optman.addCmlParam(d2d::util::clo::bool_option
+                     {"BINARY", {"--binary"},
+                        "write binary MSH files"});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"SEED", {"--seed"},
+                        "the seed of the data set (default: 1)"});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"THREADS", {"--threads"},
+                        "specifies the number of threads (default: all hardware threads)"});
+  auto format = std::string {};
+  auto numpoints = std::size_t {0};
+  auto seed = std::size_t {1};
+  auto numthreads = std::size_t {0};
+  auto succ = optman.parse_args(argc, argv);
+  if (succ) {
+    format = optman.get_string_option_value("FORMAT");
+    succ = format.empty() || format == "dsv" || format == "msh" || format == "msh2";
+  }
+  if (succ)
+    succ = d2d::util::parse::parse_count(optman.get_string_option_value("POINTS"), numpoints);
+  if (succ && !optman.get_string_option_value("SEED").empty())
+    succ = d2d::util::parse::parse_count(optman.get_string_option_value("SEED"), seed, 0);
+  if (succ && !optman.get_string_option_value("THREADS").empty())
+    succ = d2d::util::parse::parse_count(optman.get_string_option_value("THREADS"), numthreads);
+  if (!succ) {
+    std::cout << optman.get_usage_msg();
+    return EXIT_FAILURE;
+  }
+  auto outfilename = optman.get_string_option_value("OUTPUT_FILE");
+  if (numthreads > 0)
+    d2d::util::parallel::set_num_threads(numthreads);
+
+  try {
+    auto file = output_file {std::fopen(outfilename.c_str(), "wb"), &std::fclose};
+    if (!file)
+      throw std::runtime_error
+        ("Could not open " + outfilename + " for writing: " + std::strerror(errno));
+    std::setvbuf(file.get(), nullptr, _IOFBF, 1 << 20);
+    if (format.empty() || format == "dsv")
+      write_dsv(file.get(), seed, numpoints);
+    else
+      write_msh(file.get(), seed, numpoints, format == "msh2",
+                optman.get_bool_option_value("BINARY"));
+    if (std::fclose(file.release()) != 0)
+      throw std::runtime_error("Could not write " + outfilename);
+  } catch (std::exception const& ee) {
+    std::cerr << "Error: " << ee.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
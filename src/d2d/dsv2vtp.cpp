@@ -1,5 +1,161 @@
+#include <algorithm>
+#include <memory>
+
+#include "d2d/io/d2d_binary.hpp"
+#include "d2d/io/dsv_chunk_reader.hpp"
 #include "d2d/io/dsv_reader.hpp"
+#include "d2d/io/vtp_stream_writer.hpp"
+#ifdef D2D_WITH_VTK
 #include "d2d/io/vtp_writer.hpp"
+#endif
+#include "d2d/util/batch.hpp"
+#include "d2d/util/cache.hpp"
+#include "d2d/util/decompress.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/reorder.hpp"
+#include "d2d/util/stdio.hpp"
+#include "d2d/util/time_series.hpp"
+#include "d2d/util/watch.hpp"
+
+// Converts the input chunk by chunk, such that the memory used stays
+// roughly below maxmemory
+template<typename numeric_type>
+static void convert_in_chunks
+(std::string const& infilename,
+ std::string const& outfilename,
+ bool filtercovered,
+ std::size_t maxmemory,
+ d2d::io::write_options writeoptions)
+{
+  // The chunk being read is in memory as text and as parsed columns, which
+  // take less space than the text of typical files; up to four more chunks
+  // of columns are on their way through the stages of the pipeline.
+  auto chunksize = std::max<std::size_t>(1 << 20, maxmemory / 8);
+  auto chunkreader =
+    d2d::io::dsv_chunk_reader<numeric_type> {infilename, filtercovered, chunksize};
+  writeoptions.writer = d2d::io::write_options::backend::native;
+  writeoptions.mode = d2d::io::write_options::data_mode::appended;
+  if (writeoptions.verbose)
+    std::cout << "Writing surface to " << outfilename << " in "
+              << chunkreader.get_num_chunks() << " piece(s)" << std::endl;
+  d2d::io::vtp_stream_writer<numeric_type>::write_disc_surface
+    (chunkreader, outfilename, writeoptions);
+  if (chunkreader.get_num_malformed_lines() > 0) {
+    std::cerr
+      << "Warning: skipped " << chunkreader.get_num_malformed_lines()
+      << " malformed line(s) in " << infilename << std::endl;
+  }
+}
+
+// With several pieces the output is indexed by a .pvtp file
+static std::string output_name
+(std::string const& outfilename, d2d::io::write_options const& writeoptions)
+{
+  if (writeoptions.numpieces > 1)
+    return d2d::io::get_pvtp_index_file_name(outfilename);
+  return outfilename;
+}
+
+template<typename numeric_type>
+static void convert
+(std::string const& infilename,
+ std::string const& outfilename,
+ bool filtercovered,
+ std::size_t maxmemory,
+ std::string const& savebinary,
+ d2d::util::reorder_options const& reorderoptions,
+ d2d::io::write_options const& writeoptions)
+{
+  // A binary input is mapped, so it needs no chunking. A compressed input
+  // cannot be split into chunks; it is parsed as it is decoded.
+  if (maxmemory > 0 && !d2d::util::stdio::is_stdio(infilename) &&
+      !d2d::io::is_binary_file(infilename) &&
+      !d2d::util::decompress::is_compressed_file(infilename)) {
+    convert_in_chunks<numeric_type>
+      (infilename, outfilename, filtercovered, maxmemory, writeoptions);
+    return;
+  }
+  auto transferobject = d2d::io::dsv_reader<numeric_type> {infilename, filtercovered};
+  if (!savebinary.empty()) {
+    if (writeoptions.verbose)
+      std::cout << "Saving points to " << savebinary << std::endl;
+    transferobject.save_binary(savebinary);
+  }
+  if (reorderoptions.originalids)
+    transferobject.track_original_ids();
+  if (reorderoptions.reorder)
+    transferobject.reorder_spatially();
+  if (writeoptions.verbose)
+    std::cout << "Writing surface to "
+      << output_name(outfilename, writeoptions) << std::endl;
+  if (writeoptions.writer == d2d::io::write_options::backend::native) {
+    d2d::io::vtp_stream_writer<numeric_type>::write_disc_surface
+      (transferobject, outfilename, writeoptions);
+  } else {
+#ifdef D2D_WITH_VTK
+    d2d::io::vtp_writer<numeric_type>::write_disc_surface
+      (transferobject, outfilename, writeoptions);
+#else
+    throw std::runtime_error("dsv2vtp was built without VTK");
+#endif
+  }
+}
+
+static void convert
+(std::string const& infilename,
+ std::string const& outfilename,
+ bool filtercovered,
+ std::size_t maxmemory,
+ bool singleprecision,
+ std::string const& savebinary,
+ d2d::util::reorder_options const& reorderoptions,
+ d2d::io::write_options const& writeoptions)
+{
+  if (singleprecision)
+    convert<float>(infilename, outfilename, filtercovered, maxmemory, savebinary,
+                   reorderoptions, writeoptions);
+  else
+    convert<double>(infilename, outfilename, filtercovered, maxmemory, savebinary,
+                    reorderoptions, writeoptions);
+}
+
+// Converts the steps of a time series. The discs have no connectivity to
+// reuse; step N+1 is read while step N is written.
+template<typename numeric_type>
+static void convert_series
+(std::vector<d2d::util::series::step> const& steps,
+ std::string const& outfilename,
+ bool filtercovered,
+ d2d::io::write_options const& writeoptions)
+{
+  auto files = std::vector<std::string> (steps.size());
+  auto read = [&](std::size_t pIdx) {
+    return std::unique_ptr<d2d::io::dsv_reader<numeric_type> >
+      {new d2d::io::dsv_reader<numeric_type> {steps[pIdx].input, filtercovered}};
+  };
+  auto write = [&](std::size_t pIdx, std::unique_ptr<d2d::io::dsv_reader<numeric_type> >& pReader) {
+    auto stepfilename = d2d::util::series::get_step_file_name(outfilename, pIdx, steps.size());
+    files[pIdx] = output_name(stepfilename, writeoptions);
+    if (writeoptions.verbose)
+      std::cout << "Writing step " << pIdx << " (time " << steps[pIdx].time << ") to "
+                << files[pIdx] << std::endl;
+    if (writeoptions.writer == d2d::io::write_options::backend::native) {
+      d2d::io::vtp_stream_writer<numeric_type>::write_disc_surface
+        (*pReader, stepfilename, writeoptions);
+    } else {
+#ifdef D2D_WITH_VTK
+      d2d::io::vtp_writer<numeric_type>::write_disc_surface
+        (*pReader, stepfilename, writeoptions);
+#else
+      throw std::runtime_error("dsv2vtp was built without VTK");
+#endif
+    }
+  };
+  d2d::util::series::run(steps.size(), read, write);
+  d2d::util::series::write_pvd(outfilename, steps, files);
+}
 
 int main(int argc, char* argv[]) {
 
@@ -12,19 +168,143 @@ int main(int argc, char* argv[]) {
   //      "render the input on GUI"});
   optman.addCmlParam(d2d::util::clo::string_option
     {"INPUT_FILE", {"--infile"},
-       "spacifies the name of the input file", true});
+       "spacifies the name of the input file (not with --batch or --glob)"});
   optman.addCmlParam(d2d::util::clo::string_option
     {"OUTPUT_FILE", {"--write", "--outfile"},
-       "specifies the name of the output file", true});
-  bool succ = optman.parse_args(argc, argv);
+       "specifies the name of the output file (not with --batch or --glob)"});
+  optman.addCmlParam(d2d::util::clo::string_option
+    {"MAX_MEMORY", {"--max-memory"},
+       "converts the input in chunks to stay roughly within the given memory, e.g., 4G"
+       " (implies --writer native and --data-mode appended)"});
+  optman.addCmlParam(d2d::util::clo::string_option
+    {"PRECISION", {"--precision"},
+       "float or double (default); float reads, processes and writes 32 bit values"});
+  optman.addCmlParam(d2d::util::clo::string_option
+    {"SAVE_BINARY", {"--save-binary"},
+       "also saves the parsed points to the given d2d binary file, which can be used as"
+       " input instead of the text file (not with --batch, --glob or --max-memory)"});
+  optman.addCmlParam(d2d::util::clo::string_option
+    {"THREADS", {"--threads"},
+       "specifies the number of threads (default: all hardware threads)"});
+  d2d::util::reorder_options::add_cml_params(optman);
+  d2d::io::write_options::add_cml_params(optman);
+  d2d::util::batch::add_cml_params(optman);
+  d2d::util::series::add_cml_params(optman);
+  d2d::util::watch::add_cml_params(optman);
+  d2d::util::cache::add_cml_params(optman);
+  d2d::util::profile::add_cml_params(optman);
+  auto writeoptions = d2d::io::write_options {};
+#ifndef D2D_WITH_VTK
+  writeoptions.writer = d2d::io::write_options::backend::native;
+#endif
+  bool succ = optman.parse_args(argc, argv) &&
+    writeoptions.read_cml_params(optman);
+  bool batchmode = succ && d2d::util::batch::is_requested(optman);
+  std::size_t maxmemory = 0;
+  if (succ && !optman.get_string_option_value("MAX_MEMORY").empty()) {
+    succ = d2d::util::parse::parse_byte_size
+      (optman.get_string_option_value("MAX_MEMORY"), maxmemory);
+    if (!succ)
+      std::cerr << "Error: invalid value of --max-memory" << std::endl;
+  }
+  if (succ && maxmemory > 0 && !writeoptions.lodfactors.empty()) {
+    std::cerr << "Error: --lod cannot be combined with --max-memory" << std::endl;
+    succ = false;
+  }
+  auto reorderoptions = d2d::util::reorder_options {};
+  if (succ) {
+    reorderoptions.read_cml_params(optman);
+    if (maxmemory > 0 && (reorderoptions.reorder || reorderoptions.originalids)) {
+      std::cerr << "Error: --reorder and --original-ids cannot be combined with --max-memory"
+                << std::endl;
+      succ = false;
+    }
+  }
+  std::string savebinary;
+  if (succ) {
+    savebinary = optman.get_string_option_value("SAVE_BINARY");
+    if (!savebinary.empty() && (batchmode || maxmemory > 0)) {
+      std::cerr << "Error: --save-binary cannot be combined with --batch, --glob or --max-memory"
+                << std::endl;
+      succ = false;
+    }
+  }
+  std::string precision;
+  if (succ) {
+    precision = optman.get_string_option_value("PRECISION");
+    succ = precision.empty() || precision == "float" || precision == "double";
+  }
+  auto numthreads = std::size_t {0};
+  if (succ && !optman.get_string_option_value("THREADS").empty()) {
+    succ = d2d::util::parse::parse_count(optman.get_string_option_value("THREADS"), numthreads);
+    if (!succ)
+      std::cerr << "Error: invalid value of --threads" << std::endl;
+  }
+  if (succ && !d2d::util::batch::check_cml_params(optman)) {
+    std::cerr << "Error: invalid value of --jobs" << std::endl;
+    succ = false;
+  }
+  bool seriesmode = succ && d2d::util::series::is_requested(optman);
+  if (succ && seriesmode) {
+    if (batchmode || maxmemory > 0 || reorderoptions.reorder || reorderoptions.originalids ||
+        !writeoptions.lodfactors.empty() || !savebinary.empty() ||
+        optman.get_bool_option_value("INCREMENTAL") ||
+        !optman.get_string_option_value("CACHE_DIR").empty()) {
+      std::cerr << "Error: --time-series cannot be combined with --batch, --glob, --max-memory,"
+        " --reorder, --original-ids, --lod, --save-binary, --incremental or --cache-dir"
+                << std::endl;
+      succ = false;
+    }
+  }
+  bool watchmode = succ && d2d::util::watch::is_requested(optman);
+  if (succ && watchmode && (batchmode || seriesmode || !savebinary.empty())) {
+    std::cerr << "Error: --watch cannot be combined with --batch, --glob, --time-series or"
+      " --save-binary" << std::endl;
+    succ = false;
+  }
+  if (succ && !batchmode && !watchmode) {
+    succ = (seriesmode || !optman.get_string_option_value("INPUT_FILE").empty()) &&
+      !optman.get_string_option_value("OUTPUT_FILE").empty();
+  }
+  bool usestdio = succ &&
+    (d2d::util::stdio::is_stdio(optman.get_string_option_value("INPUT_FILE")) ||
+     d2d::util::stdio::is_stdio(optman.get_string_option_value("OUTPUT_FILE")));
+  if (usestdio &&
+      (batchmode || watchmode || seriesmode || maxmemory > 0 || writeoptions.numpieces > 1 ||
+       !writeoptions.lodfactors.empty() || optman.get_bool_option_value("INCREMENTAL") ||
+       !optman.get_string_option_value("CACHE_DIR").empty())) {
+    std::cerr << "Error: - (stdin or stdout) cannot be combined with --batch, --glob, --watch,"
+      " --time-series, --max-memory, --pieces, --lod, --incremental or --cache-dir" << std::endl;
+    succ = false;
+  }
   if (!succ) {
     std::cout << optman.get_usage_msg();
     return EXIT_FAILURE;
   }
   std::string infilename = optman.get_string_option_value("INPUT_FILE");
   std::string outfilename = optman.get_string_option_value("OUTPUT_FILE");
+  // The output goes to stdout; all the messages go to stderr
+  if (d2d::util::stdio::is_stdio(outfilename))
+    std::cout.rdbuf(std::cerr.rdbuf());
   bool filtercovered = optman.get_bool_option_value("FILTER_COVERED");
+  bool singleprecision = precision == "float";
+  std::string profilefile = d2d::util::profile::read_cml_params(optman);
+  auto cache = std::unique_ptr<d2d::util::cache::incremental> {};
+  // Converts unless incremental conversion finds the output up to date
+  auto run = [&](std::string const& pInput, std::string const& pOutput) {
+    auto doconvert = [&] {
+      convert(pInput, pOutput, filtercovered, maxmemory, singleprecision, savebinary,
+              reorderoptions, writeoptions);
+    };
+    if (cache)
+      cache->run(pInput, pOutput, d2d::io::get_output_file_names(pOutput, writeoptions),
+                 writeoptions.verbose, doconvert);
+    else
+      doconvert();
+  };
   // bool render = optman.get_bool_option_value("RENDER");
+  if (numthreads > 0)
+    d2d::util::parallel::set_num_threads(numthreads);
 
   if (filtercovered) {
     std::cout
@@ -32,7 +312,46 @@ int main(int argc, char* argv[]) {
       << std::endl;
   }
 
-  auto transferobject = d2d::io::dsv_reader<double> {infilename, filtercovered};
-  std::cout << "Writing surface to " << outfilename << std::endl;
-  d2d::io::vtp_writer<double>::write_disc_surface(transferobject, outfilename);
+  try {
+    if (seriesmode) {
+      auto steps = d2d::util::series::read_cml_params(optman);
+      if (singleprecision)
+        convert_series<float>(steps, outfilename, filtercovered, writeoptions);
+      else
+        convert_series<double>(steps, outfilename, filtercovered, writeoptions);
+      d2d::util::profile::report(profilefile);
+      return EXIT_SUCCESS;
+    }
+    cache = d2d::util::cache::read_cml_params(optman, "dsv2vtp");
+    if (watchmode) {
+      writeoptions.verbose = false;
+      // Compressed and binary inputs are recognized by their contents; .d2d
+      // is the name of the latter in watched directories
+      d2d::util::watch::run
+        (optman, {".dsv", ".dsv.gz", ".dsv.xz", ".dsv.zst", ".d2d"}, ".vtp", run);
+      if (cache)
+        d2d::util::cache::print_summary(*cache);
+      d2d::util::profile::report(profilefile);
+      return EXIT_SUCCESS;
+    }
+    if (batchmode) {
+      auto jobs = d2d::util::batch::read_cml_params(optman, ".vtp");
+      writeoptions.verbose = false;
+      auto summary = d2d::util::batch::run
+        (jobs, d2d::util::batch::get_num_jobs(optman),
+         [&](d2d::util::batch::job const& jj) {
+          run(jj.input, jj.output);
+        });
+      d2d::util::batch::print_summary(summary);
+      if (cache)
+        d2d::util::cache::print_summary(*cache);
+      d2d::util::profile::report(profilefile);
+      return summary.numfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    run(infilename, outfilename);
+    d2d::util::profile::report(profilefile);
+  } catch (std::exception const& ee) {
+    std::cerr << "Error: " << ee.what() << std::endl;
+    return EXIT_FAILURE;
+  }
 }
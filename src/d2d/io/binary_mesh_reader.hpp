@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include "d2d/io/d2d_binary.hpp"
+#include "d2d/io/triangle_mesh.hpp"
+
+namespace d2d { namespace io {
+
+  // Reads a triangle mesh from a d2d binary file (see d2d/io/d2d_binary.hpp)
+  // as written by triangle_mesh::save_binary(). The file is mapped and its
+  // vertices and triangles are used without copying.
+  template<typename numeric_type>
+  class binary_mesh_reader : public triangle_mesh<numeric_type> {
+  public:
+
+    binary_mesh_reader(std::string const& pFilePath) :
+      triangle_mesh<numeric_type>(pFilePath)
+    {
+      this->load_binary(pFilePath);
+    }
+  };
+}}
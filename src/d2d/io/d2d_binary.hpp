@@ -0,0 +1,281 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/mapped_file.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/utils.hpp"
+#include "d2d/util/xxhash.hpp"
+
+// The d2d binary format holds the contents of a reader (a point set of
+// dsv_reader or a triangle_mesh) such that it can be mapped into memory and
+// used without parsing. Layout (little endian):
+//
+//   header         64 bytes (magic, version, kind, size of the reals,
+//                  number of sections, flags, checksum of header and table)
+//   section table  32 bytes per section (id, element size, number of
+//                  elements, offset, checksum of the data)
+//   sections       each one at an offset which is a multiple of 64
+//
+// The checksums are the ones of xxhash64_blocks(). Files of another version
+// are rejected; the version changes whenever the layout does.
+
+namespace d2d { namespace io {
+
+  enum class binary_kind : uint32_t {point_set = 1, triangle_mesh = 2};
+
+  enum class binary_section : uint32_t {
+    vertices = 1, normals = 2, areas = 3, material_ids = 4, cover_flags = 5, triangles = 6
+  };
+
+  // A section of a file to be written
+  struct binary_section_data {
+    binary_section id;
+    uint32_t elemsize;
+    uint64_t count;
+    void const* data;
+  };
+
+  namespace detail {
+
+    constexpr char binaryMagic[8] = {'D', '2', 'D', 'B', 'I', 'N', '\r', '\n'};
+    constexpr uint32_t binaryVersion = 1;
+    constexpr uint64_t binaryAlignment = 64;
+
+    struct binary_header {
+      char magic[8];
+      uint32_t version;
+      uint32_t kind;
+      uint32_t realsize;
+      uint32_t numsections;
+      uint64_t flags;
+      uint64_t checksum;
+      uint64_t reserved[3];
+    };
+
+    struct binary_entry {
+      uint32_t id;
+      uint32_t elemsize;
+      uint64_t count;
+      uint64_t offset;
+      uint64_t checksum;
+    };
+
+    static_assert(sizeof(binary_header) == 64, "The header takes 64 bytes");
+    static_assert(sizeof(binary_entry) == 32, "A section entry takes 32 bytes");
+
+    inline uint64_t align_offset(uint64_t pOffset)
+    {
+      return (pOffset + binaryAlignment - 1) / binaryAlignment * binaryAlignment;
+    }
+
+    // The checksum of the header (without its checksum) and the table
+    inline uint64_t header_checksum
+    (binary_header pHeader, std::vector<binary_entry> const& pEntries)
+    {
+      pHeader.checksum = 0;
+      auto seed = d2d::util::xxhash64(&pHeader, sizeof(pHeader));
+      return d2d::util::xxhash64(pEntries.data(), pEntries.size() * sizeof(binary_entry), seed);
+    }
+  }
+
+  // Flags of a file
+  constexpr uint64_t binaryFilteredCovered = 1;
+
+  // Whether the file starts like a d2d binary file
+  inline bool is_binary_file(std::string const& pFilePath)
+  {
+    char magic[sizeof(detail::binaryMagic)];
+    auto file = std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+      {std::fopen(pFilePath.c_str(), "rb"), &std::fclose};
+    return file && std::fread(magic, 1, sizeof(magic), file.get()) == sizeof(magic) &&
+      std::memcmp(magic, detail::binaryMagic, sizeof(magic)) == 0;
+  }
+
+  inline void write_binary_file
+  (std::string const& pFilePath, binary_kind pKind, uint32_t pRealSize, uint64_t pFlags,
+   std::vector<binary_section_data> const& pSections)
+  {
+    d2d::util::profile::phase phase {"binary write"};
+    auto header = detail::binary_header {};
+    std::memcpy(header.magic, detail::binaryMagic, sizeof(header.magic));
+    header.version = detail::binaryVersion;
+    header.kind = (uint32_t) pKind;
+    header.realsize = pRealSize;
+    header.numsections = (uint32_t) pSections.size();
+    header.flags = pFlags;
+    auto entries = std::vector<detail::binary_entry> {};
+    auto offset = detail::align_offset
+      (sizeof(header) + pSections.size() * sizeof(detail::binary_entry));
+    for (auto const& section : pSections) {
+      auto numbytes = section.count * section.elemsize;
+      entries.push_back({(uint32_t) section.id, section.elemsize, section.count, offset,
+                         d2d::util::xxhash64_blocks(section.data, numbytes)});
+      offset = detail::align_offset(offset + numbytes);
+    }
+    header.checksum = detail::header_checksum(header, entries);
+
+    auto file = std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+      {std::fopen(pFilePath.c_str(), "wb"), &std::fclose};
+    if (!file)
+      throw std::runtime_error("Could not open " + pFilePath + " for writing");
+    auto position = (uint64_t) 0;
+    auto put = [&](void const* pData, uint64_t pSize) {
+      if (pSize > 0 && std::fwrite(pData, 1, pSize, file.get()) != pSize)
+        throw std::runtime_error("Could not write " + pFilePath);
+      position += pSize;
+    };
+    auto pad = [&](uint64_t pOffset) {
+      char const zeros[detail::binaryAlignment] = {};
+      put(zeros, pOffset - position);
+    };
+    put(&header, sizeof(header));
+    put(entries.data(), entries.size() * sizeof(detail::binary_entry));
+    for (std::size_t idx = 0; idx < pSections.size(); ++idx) {
+      pad(entries[idx].offset);
+      put(pSections[idx].data, pSections[idx].count * pSections[idx].elemsize);
+    }
+    if (std::fflush(file.get()) != 0)
+      throw std::runtime_error("Could not write " + pFilePath);
+    phase.set_bytes(position);
+  }
+
+  // A d2d binary file mapped into memory. The header and all the checksums
+  // are verified on opening.
+  class binary_file {
+  public:
+    binary_file(std::string const& pFilePath) :
+      mFilePath(pFilePath),
+      mFile(pFilePath)
+    {
+      d2d::util::profile::phase phase {"binary read"};
+      phase.set_bytes(mFile.size());
+      if (mFile.size() < sizeof(detail::binary_header))
+        throw std::runtime_error(pFilePath + " is not a d2d binary file");
+      std::memcpy(&mHeader, mFile.data(), sizeof(mHeader));
+      if (std::memcmp(mHeader.magic, detail::binaryMagic, sizeof(mHeader.magic)) != 0)
+        throw std::runtime_error(pFilePath + " is not a d2d binary file");
+      if (mHeader.version != detail::binaryVersion)
+        throw std::runtime_error
+          (pFilePath + " has the unsupported d2d binary version " +
+           std::to_string(mHeader.version));
+      if (mHeader.realsize != sizeof(float) && mHeader.realsize != sizeof(double))
+        throw std::runtime_error
+          (pFilePath + " has the invalid real size " + std::to_string(mHeader.realsize));
+      auto tablesize = (uint64_t) mHeader.numsections * sizeof(detail::binary_entry);
+      if (tablesize > mFile.size() - sizeof(mHeader))
+        throw std::runtime_error(pFilePath + " is truncated");
+      mEntries.resize(mHeader.numsections);
+      std::memcpy(mEntries.data(), mFile.data() + sizeof(mHeader), tablesize);
+      if (detail::header_checksum(mHeader, mEntries) != mHeader.checksum)
+        throw std::runtime_error("The header of " + pFilePath + " is corrupt");
+      for (auto const& entry : mEntries) {
+        auto numbytes = entry.count * entry.elemsize;
+        if (entry.offset % detail::binaryAlignment != 0 || entry.offset > mFile.size() ||
+            numbytes > mFile.size() - entry.offset ||
+            (entry.elemsize > 0 && numbytes / entry.elemsize != entry.count))
+          throw std::runtime_error(pFilePath + " is truncated");
+        if (d2d::util::xxhash64_blocks(mFile.data() + entry.offset, numbytes) != entry.checksum)
+          throw std::runtime_error
+            ("Section " + std::to_string(entry.id) + " of " + pFilePath + " is corrupt");
+      }
+    }
+
+    binary_kind get_kind() const
+    {
+      return (binary_kind) mHeader.kind;
+    }
+
+    // 4 (float) or 8 (double)
+    uint32_t get_real_size() const
+    {
+      return mHeader.realsize;
+    }
+
+    uint64_t get_flags() const
+    {
+      return mHeader.flags;
+    }
+
+    // A view of the elements of a section in the mapping. Throws if there
+    // is no such section or if its elements are not of value_type.
+    template<typename value_type>
+    d2d::util::array_view<value_type const> get_section(binary_section pId) const
+    {
+      auto const& entry = find(pId);
+      if (entry.elemsize != sizeof(value_type))
+        throw std::runtime_error
+          ("Unexpected element size in section " + std::to_string(entry.id) + " of " +
+           mFilePath);
+      return {reinterpret_cast<value_type const*>(mFile.data() + entry.offset),
+              (std::size_t) entry.count};
+    }
+
+    // The reals (or triples of reals) of a section converted to
+    // numeric_type, for files of the other precision. Throws if the
+    // elements of the section are not numComponents reals of the file.
+    template<typename numeric_type, std::size_t numComponents>
+    std::vector<numeric_type> convert_section(binary_section pId) const
+    {
+      auto const& entry = find(pId);
+      if (entry.elemsize != numComponents * mHeader.realsize)
+        throw std::runtime_error
+          ("Unexpected element size in section " + std::to_string(entry.id) + " of " +
+           mFilePath);
+      auto result = std::vector<numeric_type> (entry.count * numComponents);
+      auto data = mFile.data() + entry.offset;
+      for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        if (mHeader.realsize == sizeof(float)) {
+          float value;
+          std::memcpy(&value, data + idx * sizeof(value), sizeof(value));
+          result[idx] = (numeric_type) value;
+        } else {
+          double value;
+          std::memcpy(&value, data + idx * sizeof(value), sizeof(value));
+          result[idx] = (numeric_type) value;
+        }
+      }
+      return result;
+    }
+
+  private:
+    detail::binary_entry const& find(binary_section pId) const
+    {
+      for (auto const& entry : mEntries)
+        if (entry.id == (uint32_t) pId)
+          return entry;
+      throw std::runtime_error
+        ("Section " + std::to_string((uint32_t) pId) + " missing in " + mFilePath);
+    }
+
+    std::string mFilePath;
+    d2d::util::mapped_file mFile;
+    detail::binary_header mHeader;
+    std::vector<detail::binary_entry> mEntries;
+  };
+
+  // The reals of a section as numeric_type: a view of the mapping if the
+  // precisions match; otherwise a view of pCopy, which receives the
+  // converted values
+  template<typename value_type, typename numeric_type, std::size_t numComponents>
+  d2d::util::array_view<value_type const>
+  get_binary_reals
+  (binary_file const& pFile, binary_section pId, std::vector<value_type>& pCopy)
+  {
+    static_assert(sizeof(value_type) == numComponents * sizeof(numeric_type),
+                  "value_type consists of numComponents reals");
+    if (pFile.get_real_size() == sizeof(numeric_type))
+      return pFile.get_section<value_type>(pId);
+    auto reals = pFile.convert_section<numeric_type, numComponents>(pId);
+    pCopy.resize(reals.size() / numComponents);
+    std::memcpy(pCopy.data(), reals.data(), reals.size() * sizeof(numeric_type));
+    return pCopy;
+  }
+}}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "d2d/io/dsv_parser.hpp"
+#include "d2d/util/mapped_file.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/profile.hpp"
+
+namespace d2d { namespace io {
+
+  // Reads a DSV file in chunks of a bounded number of bytes, such that only
+  // one chunk has to be in memory at a time. The chunks end at line breaks.
+  // The pages of the file which belong to a chunk are dropped from memory
+  // after the chunk has been parsed.
+  template<typename numeric_type>
+  class dsv_chunk_reader {
+  public:
+
+    dsv_chunk_reader(std::string infilename, bool filtercovered, std::size_t chunksize) :
+      infilename(infilename),
+      file(infilename, false),
+      parser(filtercovered) {
+      split(std::max<std::size_t>(1, chunksize));
+    }
+
+    std::string
+    get_input_file_path()
+    {
+      return infilename;
+    }
+
+    // There is at least one (possibly empty) chunk
+    std::size_t get_num_chunks() const
+    {
+      return chunks.size();
+    }
+
+    // Parses the chunk pIdx. The chunks are meant to be read in order.
+    dsv_columns<numeric_type> read_chunk(std::size_t pIdx)
+    {
+      d2d::util::profile::phase phase {"dsv read"};
+      auto const& chunk = chunks[pIdx];
+      phase.set_bytes((uint64_t) (chunk.second - chunk.first));
+      if (pIdx + 1 < chunks.size())
+        file.prefetch(chunks[pIdx + 1].first, chunks[pIdx + 1].second);
+      auto result = parser.parse(chunk.first, chunk.second);
+      file.discard(chunk.first, chunk.second);
+      phase.set_items(result.size());
+      return result;
+    }
+
+    // The number of malformed lines in the chunks read so far
+    std::size_t get_num_malformed_lines()
+    {
+      return parser.get_num_malformed_lines();
+    }
+
+  private:
+    void split(std::size_t chunksize)
+    {
+      auto pos = file.begin();
+      while (pos < file.end()) {
+        auto chunkend = file.end();
+        if ((std::size_t) (file.end() - pos) > chunksize)
+          chunkend = d2d::util::parse::next_line(pos + chunksize - 1, file.end());
+        chunks.push_back({pos, chunkend});
+        pos = chunkend;
+      }
+      if (chunks.empty())
+        chunks.push_back({file.begin(), file.end()});
+    }
+
+  private:
+    std::string infilename;
+    d2d::util::mapped_file file;
+    d2d::io::dsv_parser<numeric_type> parser;
+    std::vector<std::pair<char const*, char const*> > chunks;
+  };
+}}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/utils.hpp"
+
+namespace d2d { namespace io {
+
+  // The columns of a delimiter-separated values file. Each row of such a
+  // file holds the following nine values:
+  //   x y z normal-x normal-y normal-z material-id area cover-flag
+  template<typename numeric_type>
+  struct dsv_columns {
+    std::vector<d2d::util::triple<numeric_type> > vertices;
+    std::vector<d2d::util::triple<numeric_type> > normals;
+    std::vector<int32_t> matIds;
+    std::vector<numeric_type> areas;
+    std::vector<int32_t> coverflags;
+
+    std::size_t size() const
+    {
+      return vertices.size();
+    }
+
+    void resize(std::size_t pSize)
+    {
+      vertices.resize(pSize);
+      normals.resize(pSize);
+      matIds.resize(pSize);
+      areas.resize(pSize);
+      coverflags.resize(pSize);
+    }
+  };
+
+  // Parses the text of a DSV file. The text is split into newline aligned
+  // chunks which are parsed concurrently; the rows of the chunks are joined in
+  // file order.
+  template<typename numeric_type>
+  class dsv_parser {
+  public:
+
+    dsv_parser(bool filtercovered) :
+      filtercovered(filtercovered) {}
+
+    // Parses all rows in [pBegin, pEnd)
+    dsv_columns<numeric_type>
+    parse(char const* pBegin, char const* pEnd)
+    {
+      auto chunks = split(pBegin, pEnd);
+      auto parsed = std::vector<dsv_columns<numeric_type> > (chunks.size());
+      auto malformed = std::vector<std::size_t> (chunks.size(), 0);
+      d2d::util::parallel::for_each_index(chunks.size(), [&](std::size_t cidx) {
+          malformed[cidx] = parse_chunk
+            (chunks[cidx].first, chunks[cidx].second, parsed[cidx]);
+        });
+      // Join the chunks in file order
+      auto offsets = std::vector<std::size_t> (chunks.size() + 1, 0);
+      for (std::size_t cidx = 0; cidx < chunks.size(); ++cidx) {
+        offsets[cidx + 1] = offsets[cidx] + parsed[cidx].size();
+        numMalformedLines += malformed[cidx];
+      }
+      if (parsed.size() == 1)
+        return std::move(parsed[0]);
+      auto result = dsv_columns<numeric_type> {};
+      result.resize(offsets.back());
+      d2d::util::parallel::for_each_index(chunks.size(), [&](std::size_t cidx) {
+          auto& part = parsed[cidx];
+          auto offset = offsets[cidx];
+          std::copy(part.vertices.begin(), part.vertices.end(),
+                    result.vertices.begin() + offset);
+          std::copy(part.normals.begin(), part.normals.end(),
+                    result.normals.begin() + offset);
+          std::copy(part.matIds.begin(), part.matIds.end(),
+                    result.matIds.begin() + offset);
+          std::copy(part.areas.begin(), part.areas.end(),
+                    result.areas.begin() + offset);
+          std::copy(part.coverflags.begin(), part.coverflags.end(),
+                    result.coverflags.begin() + offset);
+          part = dsv_columns<numeric_type> {}; // release memory early
+        });
+      return result;
+    }
+
+    // The number of non-comment lines which did not hold nine values
+    std::size_t get_num_malformed_lines()
+    {
+      return numMalformedLines;
+    }
+
+  private:
+    // Splits the text into chunks which end right after a newline (or at
+    // the end of the text)
+    std::vector<std::pair<char const*, char const*> >
+    split(char const* pBegin, char const* pEnd)
+    {
+      auto result = std::vector<std::pair<char const*, char const*> > {};
+      auto size = (std::size_t) (pEnd - pBegin);
+      auto numchunks = std::max<std::size_t>
+        (1, std::min(8 * d2d::util::parallel::get_num_threads(),
+                     size / minChunkSize));
+      auto chunksize = size / numchunks + 1;
+      auto pos = pBegin;
+      while (pos < pEnd) {
+        auto chunkend = pEnd;
+        if ((std::size_t) (pEnd - pos) > chunksize)
+          chunkend = d2d::util::parse::next_line(pos + chunksize, pEnd);
+        result.push_back({pos, chunkend});
+        pos = chunkend;
+      }
+      return result;
+    }
+
+    // Returns the number of malformed lines in the chunk
+    std::size_t
+    parse_chunk
+    (char const* pBegin, char const* pEnd, dsv_columns<numeric_type>& pOut)
+    {
+      namespace parse = d2d::util::parse;
+      // A rough guess of the number of rows saves most reallocations
+      auto estimate = (std::size_t) (pEnd - pBegin) / 64;
+      pOut.vertices.reserve(estimate);
+      pOut.normals.reserve(estimate);
+      pOut.matIds.reserve(estimate);
+      pOut.areas.reserve(estimate);
+      pOut.coverflags.reserve(estimate);
+      std::size_t malformed = 0;
+      auto pos = pBegin;
+      while (pos < pEnd) {
+        auto lineend = parse::next_line(pos, pEnd);
+        pos = parse::skip_blanks(pos, lineend);
+        if (pos == lineend || *pos == '\n' || *pos == '#') {
+          // An empty line or a comment
+          pos = lineend;
+          continue;
+        }
+        double xx, yy, zz;
+        double nx, ny, nz;
+        int32_t mid;
+        double area;
+        int32_t cover;
+        // Like operator>>, the number parsers skip blanks on their own and
+        // stop at the first character which does not belong to a number.
+        bool ok =
+          parse::parse_double(pos, lineend, xx) &&
+          parse::parse_double(pos, lineend, yy) &&
+          parse::parse_double(pos, lineend, zz) &&
+          parse::parse_double(pos, lineend, nx) &&
+          parse::parse_double(pos, lineend, ny) &&
+          parse::parse_double(pos, lineend, nz) &&
+          parse::parse_int32(pos, lineend, mid) &&
+          parse::parse_double(pos, lineend, area) &&
+          parse::parse_int32(pos, lineend, cover);
+        pos = lineend; // Anything after the ninth value is ignored
+        if (!ok) {
+          ++malformed;
+          continue;
+        }
+        if (filtercovered && cover != 0) {
+          // Skip that point. It is covered by another point on a finer level
+          continue;
+        }
+        pOut.vertices.push_back
+          ({(numeric_type) xx, (numeric_type) yy, (numeric_type) zz});
+        pOut.normals.push_back
+          ({(numeric_type) nx, (numeric_type) ny, (numeric_type) nz});
+        pOut.matIds.push_back(mid);
+        pOut.areas.push_back((numeric_type) area);
+        pOut.coverflags.push_back(cover);
+      }
+      return malformed;
+    }
+
+  private:
+    static constexpr std::size_t minChunkSize = 1 << 20;
+    bool filtercovered;
+    std::size_t numMalformedLines = 0;
+  };
+}}
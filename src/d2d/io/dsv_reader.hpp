@@ -1,11 +1,22 @@
 #pragma once
 
-#include <algorithm>
-#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
 #include <string>
 #include <vector>
 
+#include "d2d/io/d2d_binary.hpp"
+#include "d2d/io/dsv_parser.hpp"
+#include "d2d/util/array_view.hpp"
 #include "d2d/util/clo.hpp"
+#include "d2d/util/decompress.hpp"
+#include "d2d/util/mapped_file.hpp"
+#include "d2d/util/partition.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/reorder.hpp"
+#include "d2d/util/simd.hpp"
+#include "d2d/util/stdio.hpp"
 #include "d2d/util/utils.hpp"
 
 namespace d2d { namespace io {
@@ -16,7 +27,13 @@ namespace d2d { namespace io {
     dsv_reader(std::string infilename, bool filtercovered) :
       infilename(infilename),
       filtercovered(filtercovered) {
-      readfile();
+      if (d2d::util::stdio::is_stdio(infilename) ||
+          d2d::util::decompress::is_compressed_file(infilename))
+        readstream();
+      else if (d2d::io::is_binary_file(infilename))
+        readbinary();
+      else
+        readfile();
     }
 
     std::string
@@ -25,79 +42,290 @@ namespace d2d { namespace io {
       return infilename;
     }
 
-    std::vector<d2d::util::triple<numeric_type> >
-    get_vertices()
+    // The vertices and normals are stored as interleaved x, y, z triples in
+    // one contiguous buffer each. The views returned by the get-functions
+    // refer to the memory of this reader (or to the d2d binary file it maps);
+    // they stay valid as long as the reader lives and the data has not been
+    // released.
+    d2d::util::array_view<d2d::util::triple<numeric_type> const>
+    get_vertices() const
     {
+      if (binaryfile)
+        return mapped.vertices;
       return vertices;
     }
 
-    std::vector<d2d::util::triple<numeric_type> >
-    get_normals()
+    d2d::util::array_view<d2d::util::triple<numeric_type> const>
+    get_normals() const
     {
+      if (binaryfile)
+        return mapped.normals;
       return normals;
     }
 
-    std::vector<numeric_type>
-    get_areas()
+    d2d::util::array_view<numeric_type const>
+    get_areas() const
     {
+      if (binaryfile)
+        return mapped.areas;
       return areas;
     }
 
+    d2d::util::array_view<int32_t const>
+    get_material_ids() const
+    {
+      if (binaryfile)
+        return mapped.matIds;
+      return matIds;
+    }
+
+    d2d::util::array_view<int32_t const>
+    get_cover_flags() const
+    {
+      if (binaryfile)
+        return mapped.coverflags;
+      return coverflags;
+    }
+
+    std::vector<numeric_type>
+    get_sqrts_of_areas() const
+    {
+      auto areas = get_areas();
+      auto result = std::vector<numeric_type> (areas.size());
+      d2d::util::simd::batch_sqrt(areas.data(), result.data(), areas.size());
+      return result;
+    }
+
+    // Writes the columns to a d2d binary file (see d2d/io/d2d_binary.hpp),
+    // which the constructor recognizes and maps instead of parsing it
+    void save_binary(std::string const& outfilename) const
+    {
+      auto vv = get_vertices();
+      auto nn = get_normals();
+      auto aa = get_areas();
+      auto mm = get_material_ids();
+      auto cc = get_cover_flags();
+      d2d::io::write_binary_file
+        (outfilename, d2d::io::binary_kind::point_set, sizeof(numeric_type),
+         filtered ? d2d::io::binaryFilteredCovered : 0,
+         {{d2d::io::binary_section::vertices, sizeof(vv[0]), vv.size(), vv.data()},
+          {d2d::io::binary_section::normals, sizeof(nn[0]), nn.size(), nn.data()},
+          {d2d::io::binary_section::areas, sizeof(aa[0]), aa.size(), aa.data()},
+          {d2d::io::binary_section::material_ids, sizeof(mm[0]), mm.size(), mm.data()},
+          {d2d::io::binary_section::cover_flags, sizeof(cc[0]), cc.size(), cc.data()}});
+    }
+
+    // Sorts the discs along a Morton curve (see d2d/util/reorder.hpp)
+    void reorder_spatially()
+    {
+      materialize();
+      d2d::util::profile::phase phase {"reorder"};
+      phase.set_items(vertices.size());
+      auto order = d2d::util::spatial_order(get_vertices());
+      vertices = d2d::util::gather(get_vertices(), order);
+      normals = d2d::util::gather(get_normals(), order);
+      areas = d2d::util::gather(get_areas(), order);
+      matIds = d2d::util::gather(get_material_ids(), order);
+      coverflags = d2d::util::gather(get_cover_flags(), order);
+      if (!originalids.empty())
+        originalids = d2d::util::gather(get_original_ids().points, order);
+    }
+
+    // Keeps track of the indices which the discs have now (after filtering
+    // the covered ones) through reorder_spatially()
+    void track_original_ids()
+    {
+      originalids.resize(get_vertices().size());
+      std::iota(originalids.begin(), originalids.end(), (std::size_t) 0);
+    }
+
+    // The discs are both points and (vertex) cells. Empty views unless
+    // track_original_ids() was called.
+    d2d::util::original_ids
+    get_original_ids() const
+    {
+      return {originalids, originalids};
+    }
+
+    // The release-functions move the data out of the reader. The reader
+    // holds no data of that kind afterwards.
+    std::vector<d2d::util::triple<numeric_type> >
+    release_vertices()
+    {
+      materialize();
+      return std::move(vertices);
+    }
+
+    std::vector<d2d::util::triple<numeric_type> >
+    release_normals()
+    {
+      materialize();
+      return std::move(normals);
+    }
+
     std::vector<numeric_type>
-    get_sqrts_of_areas()
+    release_areas()
+    {
+      materialize();
+      return std::move(areas);
+    }
+
+    std::vector<int32_t>
+    release_material_ids()
     {
-      return d2d::util::foldl<std::vector<numeric_type>, numeric_type>
-        ([](auto& acc, auto const& ee) {acc.push_back(std::sqrt(ee));
-          return acc;},
-          std::vector<numeric_type>{},
-          areas);
+      materialize();
+      return std::move(matIds);
+    }
+
+    std::vector<int32_t>
+    release_cover_flags()
+    {
+      materialize();
+      return std::move(coverflags);
     }
 
   private:
     void readfile()
     {
-      auto lefttrim =
-        [](auto str){
-          str.erase(str.begin(),
-                    std::find_if(str.begin(), str.end(),
-                                 [](int ch){return !std::isspace(ch);}));};
-      std::ifstream filestream(infilename.c_str());
-      std::string line;
-      while (std::getline(filestream, line)) {
-        lefttrim(line);
-        if (line[0] == '#') {
-          // The string in the variable line represents a comment
-          continue;
-        }
-        std::stringstream linestream;
-        linestream << line;
-        double xx, yy, zz;
-        double nx, ny, nz;
-        int32_t mid;
-        double area;
-        int32_t cover;
-        linestream >> xx >> yy >> zz >> nx >> ny
-                   >> nz >> mid >> area >> cover;
-        if (filtercovered && cover != 0) {
-          // Skip that point. It is covered by another point on a finer level
+      d2d::util::profile::phase phase {"dsv read"};
+      auto file = d2d::util::mapped_file {infilename};
+      auto parser = d2d::io::dsv_parser<numeric_type> {filtercovered};
+      auto columns = parser.parse(file.begin(), file.end());
+      phase.set_bytes(file.size());
+      phase.set_items(columns.size());
+      if (parser.get_num_malformed_lines() > 0) {
+        std::cerr
+          << "Warning: skipped " << parser.get_num_malformed_lines()
+          << " malformed line(s) in " << infilename << std::endl;
+      }
+      vertices = std::move(columns.vertices);
+      normals = std::move(columns.normals);
+      matIds = std::move(columns.matIds);
+      areas = std::move(columns.areas);
+      coverflags = std::move(columns.coverflags);
+      filtered = filtercovered;
+    }
+
+    // Parses stdin or a compressed file block by block as it arrives,
+    // concurrently with the producer or the decoder
+    void readstream()
+    {
+      d2d::util::profile::phase phase {"dsv read"};
+      d2d::util::decompress::reader input {infilename};
+      auto parser = d2d::io::dsv_parser<numeric_type> {filtercovered};
+      auto append = [](auto& pTo, auto const& pFrom) {
+        pTo.insert(pTo.end(), pFrom.begin(), pFrom.end());
+      };
+      auto numbytes = d2d::util::stdio::read_lines
+        ([&](char* pBuffer, std::size_t pSize) { return input.read(pBuffer, pSize); },
+         1 << 20, [&](char const* pBegin, char const* pEnd) {
+          auto columns = parser.parse(pBegin, pEnd);
+          append(vertices, columns.vertices);
+          append(normals, columns.normals);
+          append(matIds, columns.matIds);
+          append(areas, columns.areas);
+          append(coverflags, columns.coverflags);
+        });
+      phase.set_bytes(numbytes);
+      phase.set_items(vertices.size());
+      if (parser.get_num_malformed_lines() > 0) {
+        std::cerr
+          << "Warning: skipped " << parser.get_num_malformed_lines()
+          << " malformed line(s) in "
+          << (d2d::util::stdio::is_stdio(infilename) ? "stdin" : infilename) << std::endl;
+      }
+      filtered = filtercovered;
+    }
+
+    // Maps a d2d binary file. The columns are used in place unless the file
+    // is of the other precision or the covered points still need to be
+    // filtered.
+    void readbinary()
+    {
+      auto file = std::make_shared<d2d::io::binary_file const>(infilename);
+      if (file->get_kind() != d2d::io::binary_kind::point_set)
+        throw std::runtime_error(infilename + " does not hold a point set");
+      using triple = d2d::util::triple<numeric_type>;
+      mapped.vertices = d2d::io::get_binary_reals<triple, numeric_type, 3>
+        (*file, d2d::io::binary_section::vertices, vertices);
+      mapped.normals = d2d::io::get_binary_reals<triple, numeric_type, 3>
+        (*file, d2d::io::binary_section::normals, normals);
+      mapped.areas = d2d::io::get_binary_reals<numeric_type, numeric_type, 1>
+        (*file, d2d::io::binary_section::areas, areas);
+      mapped.matIds = file->template get_section<int32_t>(d2d::io::binary_section::material_ids);
+      mapped.coverflags =
+        file->template get_section<int32_t>(d2d::io::binary_section::cover_flags);
+      auto numpoints = mapped.vertices.size();
+      if (mapped.normals.size() != numpoints || mapped.areas.size() != numpoints ||
+          mapped.matIds.size() != numpoints || mapped.coverflags.size() != numpoints)
+        throw std::runtime_error("The columns of " + infilename + " differ in length");
+      binaryfile = std::move(file);
+      filtered = (binaryfile->get_flags() & d2d::io::binaryFilteredCovered) != 0;
+      if (filtercovered && !filtered)
+        filter_covered();
+    }
+
+    // Copies mapped columns into the vectors, for the functions which
+    // modify or release them
+    void materialize()
+    {
+      if (!binaryfile)
+        return;
+      // Converted columns are in the vectors already
+      auto copy = [](auto const& pView, auto& pVector) {
+        if (pView.data() != pVector.data())
+          pVector.assign(pView.begin(), pView.end());
+      };
+      copy(mapped.vertices, vertices);
+      copy(mapped.normals, normals);
+      copy(mapped.areas, areas);
+      copy(mapped.matIds, matIds);
+      copy(mapped.coverflags, coverflags);
+      binaryfile.reset();
+    }
+
+    // Drops the points with a cover flag not equal zero, as the parser does
+    void filter_covered()
+    {
+      materialize();
+      std::size_t count = 0;
+      for (std::size_t idx = 0; idx < vertices.size(); ++idx) {
+        if (coverflags[idx] != 0)
           continue;
-        }
-        vertices.push_back({xx, yy, zz});
-        normals.push_back({nx, ny, nz});
-        matIds.push_back(mid);
-        areas.push_back(area);
-        coverflags.push_back(cover);
+        vertices[count] = vertices[idx];
+        normals[count] = normals[idx];
+        areas[count] = areas[idx];
+        matIds[count] = matIds[idx];
+        coverflags[count] = coverflags[idx];
+        ++count;
       }
-      filestream.close();
+      vertices.resize(count);
+      normals.resize(count);
+      areas.resize(count);
+      matIds.resize(count);
+      coverflags.resize(count);
+      filtered = true;
     }
 
   private:
     std::string infilename;
     bool filtercovered;
-    std::vector<d2d::util::triple<double> > vertices;
-    std::vector<d2d::util::triple<double> > normals;
+    std::vector<d2d::util::triple<numeric_type> > vertices;
+    std::vector<d2d::util::triple<numeric_type> > normals;
     std::vector<int32_t> matIds;
-    std::vector<double> areas;
+    std::vector<numeric_type> areas;
     std::vector<int32_t> coverflags;
+    std::vector<std::size_t> originalids;
+    // Whether the covered points have been filtered
+    bool filtered = false;
+    // Set while the columns are the ones of a mapped binary file
+    std::shared_ptr<d2d::io::binary_file const> binaryfile;
+    struct {
+      d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices;
+      d2d::util::array_view<d2d::util::triple<numeric_type> const> normals;
+      d2d::util::array_view<numeric_type const> areas;
+      d2d::util::array_view<int32_t const> matIds;
+      d2d::util::array_view<int32_t const> coverflags;
+    } mapped;
   };
 }}
@@ -2,47 +2,76 @@
 
 #include <algorithm>
 #include <cassert>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 
 #include <gmsh.h>
 
+#include "d2d/io/node_index.hpp"
+#include "d2d/io/triangle_mesh.hpp"
+#include "d2d/util/profile.hpp"
 #include "d2d/util/utils.hpp"
 
 namespace d2d { namespace io {
-  template<typename numeric_type>
-  class gmsh_reader {
+
+  // Gmsh is initialized once per process (on first use) and finalized at
+  // exit. The Gmsh API is not thread-safe; its users hold the lock returned
+  // by acquire().
+  class gmsh_session {
   public:
+    static std::unique_lock<std::mutex> acquire()
+    {
+      static gmsh_session session;
+      return std::unique_lock<std::mutex> {session.mMutex};
+    }
 
-    gmsh_reader(std::string& pFilePath):
-      mMshFilePath(pFilePath) {
+  private:
+    gmsh_session()
+    {
       gmsh::initialize();
       gmsh::option::setNumber("General.Terminal", 1);
-      gmsh::open(pFilePath);
-      this->mVertices = read_vertices();
-      this->mTriangles = read_triangles();
-      gmsh::finalize();
     }
 
-    std::vector<d2d::util::triple<numeric_type> >
-    get_vertices()
+    ~gmsh_session()
     {
-      return this->mVertices;
+      gmsh::finalize();
     }
 
-    std::vector<d2d::util::triple<std::size_t> >
-    get_triangles()
-    {
-      return this->mTriangles;
-    }
+    std::mutex mMutex;
+  };
 
-    std::string get_input_file_path()
-    {
-      return this->mMshFilePath;
+  template<typename numeric_type>
+  class gmsh_reader : public triangle_mesh<numeric_type> {
+  public:
+
+    // Without pWithTriangles only the vertices are read
+    gmsh_reader(std::string const& pFilePath, bool pWithTriangles = true):
+      triangle_mesh<numeric_type>(pFilePath) {
+      auto lock = gmsh_session::acquire();
+      // Remove the model of a previously read file
+      gmsh::clear();
+      {
+        d2d::util::profile::phase phase {"gmsh::open"};
+        gmsh::open(pFilePath);
+        phase.set_bytes_of_file(pFilePath);
+      }
+      {
+        d2d::util::profile::phase phase {"read_vertices"};
+        this->mVertices = read_vertices();
+        phase.set_items(this->mVertices.size());
+      }
+      if (pWithTriangles) {
+        d2d::util::profile::phase phase {"read_triangles"};
+        this->mTriangles = read_triangles();
+        phase.set_items(this->mTriangles.size());
+      }
+      gmsh::clear();
     }
 
   private:
-    std::string mMshFilePath;
-    std::vector<d2d::util::triple<numeric_type> > mVertices;
-    std::vector<d2d::util::triple<std::size_t> > mTriangles;
+    // Maps Gmsh's node tags to our vertex indices
+    node_index mNodeIndex;
 
     std::vector<d2d::util::triple<numeric_type> >
     read_vertices()
@@ -51,31 +80,23 @@ namespace d2d { namespace io {
       std::vector<double> vvxyz;
       std::vector<double> vvuvw;
       gmsh::model::mesh::getNodes(vvtags, vvxyz, vvuvw);
-      assert(vvxyz.size() == 3 * vvtags.size() && "Vertex data missmatch");
-
-      // In Gmsh's world node tags start from 1. In our world vertex tags
-      // start from 0. We adjust it here. Subtract one from each vertex
-      // identifier.
-      std::for_each(vvtags.begin(), vvtags.end(), [](auto &tt) {--tt;});
-      // assert(*std::min_element(std::begin(vvtags), std::end(vvtags)));
-      assert(*std::min_element(vvtags.begin(), vvtags.end()) == 0 &&
-             "Vertex tag assumption not met");
-      assert(*std::max_element(vvtags.begin(), vvtags.end()) == vvtags.size()-1
-             && "Vertex tag assumption not met");
-
-      std::vector<d2d::util::triple<numeric_type> > result(vvtags.size());
-      for (size_t idx = 0; idx < vvtags.size(); ++idx) {
-        size_t xyzidx = 3 * idx;
-        //assert(std::is_unsigned<decltype(xyzidx)>::value); // not necessary; unsigned type
+      if (vvxyz.size() != 3 * vvtags.size())
+        throw std::runtime_error("Vertex data missmatch in " + this->mMshFilePath);
+
+      // In Gmsh's world node tags start from 1 and need not be contiguous. In
+      // our world vertex indices start from 0. The node index assigns the
+      // vertex indices in ascending order of the tags.
+      this->mNodeIndex = node_index {vvtags};
+      auto order = this->mNodeIndex.get_order();
+
+      std::vector<d2d::util::triple<numeric_type> > result(order.size());
+      for (size_t idx = 0; idx < order.size(); ++idx) {
+        size_t xyzidx = 3 * order[idx];
         assert(xyzidx < vvxyz.size() && "Error in reading spatial data");
-        size_t vvtag = vvtags[idx];
-        //assert(std::is_unsigned<decltype(vvtag)>::value); // not necessary; unsigned type
-        assert(vvtag < vvtags.size() && "Error in tag/index computation");
-        d2d::util::triple<numeric_type> rr
+        result[idx] = d2d::util::triple<numeric_type>
           {(numeric_type)vvxyz[xyzidx],
            (numeric_type)vvxyz[xyzidx+1],
            (numeric_type)vvxyz[xyzidx+2]};
-        result[vvtag] = std::move(rr);
       }
       return result;
     }
@@ -95,41 +116,28 @@ namespace d2d { namespace io {
                                      nntags,
                                      selecttriangles, // dimension
                                      -1); // select all elements with respect to their tag
-      // When calling gmsh::getElements() with a dimension argument, then
-      // the vectors eetypes, eetags and nntags are of size 1.
-      assert(eetypes.size() == 1 && eetags.size() == 1 && nntags.size() == 1 &&
-             "Assumptions not met");
-      int selectresult = 0;
-      // Sanity check
-      size_t numTriangles = eetags[selectresult].size();
-      assert(nntags[selectresult].size() == 3 * numTriangles &&
-             "Size missmatch in triangle data");
-
-      std::vector<std::size_t> selected = nntags[selectresult];
-      // Again, like in the get_vertices function, adjust the tags of the
-      // vertices to start from 0 instead of 1.
-			std::for_each(selected.begin(), selected.end(), [](auto &nn) {--nn;});
-      // Some sanity checks
-      // Not needed because of unsigned type
-      //assert(*std::min_element(selected.begin(), selected.end()) >= 0 &&
-      //       "Vertex tag assumption not met");
-      if (this->mVertices.size() > 0) {
-        // We can verify this property only if the vertices are set in mVertices.
-        assert(*std::max_element(selected.begin(), selected.end()) < this->mVertices.size() &&
-               "Vertex tag assumption not met");
-      }
 
       // Note: we do not consider the element tags (eetags) from Gmsh here.
       // That is, the tags/ids of the triangels may be different than in Gmsh.
-
-      std::vector<d2d::util::triple<size_t> > result(numTriangles);
-      for (size_t idx = 0; idx < numTriangles; ++idx) {
-        size_t ntidx = 3 * idx;
-        //assert(0 <= ntidx); // not needed; unsigned type
-        assert(ntidx <= selected.size() && "Index out of bounds");
-        d2d::util::triple<size_t> rr
-          {selected[ntidx], selected[ntidx+1], selected[ntidx+2]};
-        result[idx] = std::move(rr);
+      std::vector<d2d::util::triple<size_t> > result;
+      for (size_t typeidx = 0; typeidx < eetypes.size(); ++typeidx) {
+        // Only (linear) triangles; element type 2 in Gmsh
+        if (eetypes[typeidx] != 2)
+          continue;
+        auto& selected = nntags[typeidx];
+        size_t numTriangles = eetags[typeidx].size();
+        if (selected.size() != 3 * numTriangles)
+          throw std::runtime_error("Size missmatch in triangle data in " + this->mMshFilePath);
+        result.reserve(result.size() + numTriangles);
+        for (size_t ntidx = 0; ntidx < selected.size(); ntidx += 3) {
+          d2d::util::triple<size_t> rr;
+          for (size_t cc = 0; cc < 3; ++cc)
+            if (!this->mNodeIndex.find(selected[ntidx + cc], rr[cc]))
+              throw std::runtime_error
+                ("Triangle refers to unknown node " + std::to_string(selected[ntidx + cc]) +
+                 " in " + this->mMshFilePath);
+          result.push_back(rr);
+        }
       }
       return result;
     }
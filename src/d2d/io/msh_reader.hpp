@@ -0,0 +1,602 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/io/node_index.hpp"
+#include "d2d/io/triangle_mesh.hpp"
+#include "d2d/util/mapped_file.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/stdio.hpp"
+#include "d2d/util/utils.hpp"
+
+namespace d2d { namespace io {
+
+  // Thrown if a file is not in one of the MSH formats the msh_reader can
+  // read. The Gmsh API (gmsh_reader) may still be able to read it.
+  class unsupported_msh_format : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // A reader for Gmsh's MSH file format which does not need the Gmsh
+  // runtime. It supports the versions 2.2 and 4.1, ASCII and binary (in
+  // native byte order). Like the gmsh_reader it reads all the nodes and the
+  // (linear) triangles of a mesh. The file is memory mapped and large node
+  // and element blocks are parsed in parallel. Without pWithTriangles only
+  // the nodes are read, e.g., for the later steps of a time series.
+  template<typename numeric_type>
+  class msh_reader : public triangle_mesh<numeric_type> {
+  public:
+
+    msh_reader(std::string const& pFilePath, bool pWithTriangles = true) :
+      triangle_mesh<numeric_type>(pFilePath),
+      mWithTriangles(pWithTriangles)
+    {
+      d2d::util::profile::phase phase {"msh read"};
+      if (d2d::util::stdio::is_stdio(pFilePath)) {
+        // The sections of MSH files refer to each other; stdin is read as a
+        // whole before it is parsed
+        auto data = d2d::util::stdio::read_all(STDIN_FILENO);
+        parse(data.data(), data.data() + data.size());
+        phase.set_bytes(data.size());
+      } else {
+        auto file = d2d::util::mapped_file {pFilePath};
+        parse(file.begin(), file.end());
+        phase.set_bytes(file.size());
+      }
+      create_mesh();
+      phase.set_items(this->mVertices.size() + this->mTriangles.size());
+    }
+
+  private:
+    // The number of lines parsed by one task
+    static constexpr std::size_t linesPerTask = 16384;
+    // The type number of 3-node triangles in Gmsh
+    static constexpr int triangleType = 2;
+
+    int mVersion = 0; // major version; 2 or 4
+    bool mBinary = false;
+    bool mWithTriangles = true;
+    // The raw data of the file. The nodes are identified by their tags.
+    std::vector<std::size_t> mNodeTags;
+    std::vector<d2d::util::triple<numeric_type> > mNodeCoords;
+    std::vector<d2d::util::triple<std::size_t> > mTriangleTags;
+
+    // A range of lines of a node block or element block which is parsed by
+    // one task. The results are written from index offset onwards.
+    struct line_task {
+      char const* tags; // MSH 4.1: node tags; otherwise the whole lines
+      char const* coords; // MSH 4.1: node coordinates
+      std::size_t numlines;
+      std::size_t offset;
+    };
+
+    // A range of binary records
+    struct binary_task {
+      char const* data; // MSH 4.1: node tags; otherwise the records
+      char const* coords; // MSH 4.1: node coordinates
+      std::size_t numrecords;
+      std::size_t offset;
+      // MSH 2.2: the number of tags of the elements; MSH 4.1: the number of
+      // coordinates of the nodes
+      std::size_t numvalues;
+    };
+
+    [[noreturn]] void error(std::string const& pMsg) const
+    {
+      throw std::runtime_error
+        ("Error in reading " + this->mMshFilePath + ": " + pMsg);
+    }
+
+    [[noreturn]] void unsupported(std::string const& pMsg) const
+    {
+      throw unsupported_msh_format
+        ("Unsupported MSH file " + this->mMshFilePath + ": " + pMsg);
+    }
+
+    // The number of nodes of the element types of Gmsh (up to type 31)
+    std::size_t get_num_nodes(int pType) const
+    {
+      static int const numnodes[] =
+        {0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13,
+         9, 10, 12, 15, 15, 21, 4, 5, 6, 20, 35, 56};
+      if (pType <= 0 || pType >= (int) (sizeof(numnodes) / sizeof(numnodes[0])))
+        unsupported("element type " + std::to_string(pType));
+      return (std::size_t) numnodes[pType];
+    }
+
+    // Returns the current line without the line break and advances pPos to
+    // the next line
+    static std::string get_line(char const*& pPos, char const* pEnd)
+    {
+      auto next = d2d::util::parse::next_line(pPos, pEnd);
+      auto last = next;
+      while (last > pPos && (last[-1] == '\n' || last[-1] == '\r'))
+        --last;
+      auto result = std::string(pPos, last);
+      pPos = next;
+      return result;
+    }
+
+    // Returns the start of every linesPerTask-th line of the next pNumLines
+    // lines. The last element points past the last of these lines.
+    std::vector<char const*>
+    split_lines(char const*& pPos, char const* pEnd, std::size_t pNumLines) const
+    {
+      auto result = std::vector<char const*> {};
+      // Each line takes at least one byte, whatever the count declared
+      result.reserve(std::min(pNumLines, (std::size_t) (pEnd - pPos)) / linesPerTask + 2);
+      for (std::size_t idx = 0; idx < pNumLines; ++idx) {
+        if (pPos >= pEnd)
+          error("unexpected end of file");
+        if (idx % linesPerTask == 0)
+          result.push_back(pPos);
+        pPos = d2d::util::parse::next_line(pPos, pEnd);
+      }
+      result.push_back(pPos);
+      return result;
+    }
+
+    template<typename value_type>
+    value_type load(char const*& pPos, char const* pEnd) const
+    {
+      if ((std::size_t) (pEnd - pPos) < sizeof(value_type))
+        error("unexpected end of file");
+      value_type result;
+      std::memcpy(&result, pPos, sizeof(value_type));
+      pPos += sizeof(value_type);
+      return result;
+    }
+
+    char const* skip_bytes
+    (char const*& pPos, char const* pEnd, std::size_t pNumRecords, std::size_t pRecordSize) const
+    {
+      auto start = pPos;
+      if (pRecordSize != 0 && pNumRecords > (std::size_t) (pEnd - pPos) / pRecordSize)
+        error("unexpected end of file");
+      pPos += pNumRecords * pRecordSize;
+      return start;
+    }
+
+    std::size_t parse_size(char const*& pPos, char const* pEnd) const
+    {
+      auto result = std::size_t {0};
+      if (!d2d::util::parse::parse_size(pPos, pEnd, result))
+        error("expected an unsigned integer");
+      return result;
+    }
+
+    int parse_int(char const*& pPos, char const* pEnd) const
+    {
+      auto result = int32_t {0};
+      if (!d2d::util::parse::parse_int32(pPos, pEnd, result))
+        error("expected an integer");
+      return result;
+    }
+
+    numeric_type parse_coordinate(char const*& pPos, char const* pEnd) const
+    {
+      auto result = 0.0;
+      if (!d2d::util::parse::parse_double(pPos, pEnd, result))
+        error("expected a floating point number");
+      return (numeric_type) result;
+    }
+
+    void parse(char const* pBegin, char const* pEnd)
+    {
+      auto pos = pBegin;
+      while (pos < pEnd) {
+        auto line = get_line(pos, pEnd);
+        if (line.empty() || line[0] != '$')
+          continue;
+        auto name = line.substr(1);
+        if (name == "MeshFormat") {
+          parse_format(pos, pEnd);
+        } else if (mVersion == 0) {
+          // Also MSH 1 files (which start with $NOD) end up here
+          unsupported("missing $MeshFormat section");
+        } else if (name == "Nodes") {
+          if (mVersion == 2)
+            parse_nodes_v2(pos, pEnd);
+          else
+            parse_nodes_v4(pos, pEnd);
+        } else if (name == "Elements" && mWithTriangles) {
+          if (mVersion == 2)
+            parse_elements_v2(pos, pEnd);
+          else
+            parse_elements_v4(pos, pEnd);
+        }
+        skip_section(pos, pEnd, name);
+      }
+      if (mVersion == 0)
+        unsupported("missing $MeshFormat section");
+    }
+
+    // Advances pPos past the $End line of the section pName
+    void skip_section(char const*& pPos, char const* pEnd, std::string const& pName) const
+    {
+      auto endtag = "$End" + pName;
+      while (pPos < pEnd) {
+        auto pos = d2d::util::parse::skip_blanks(pPos, pEnd);
+        if ((std::size_t) (pEnd - pos) >= endtag.size() &&
+            std::memcmp(pos, endtag.data(), endtag.size()) == 0) {
+          pPos = d2d::util::parse::next_line(pos, pEnd);
+          return;
+        }
+        // Binary data may contain any byte; search for the end tag at the
+        // start of a line
+        auto nl = std::string {"\n"} + endtag;
+        auto found = std::search(pPos, pEnd, nl.begin(), nl.end());
+        if (found == pEnd)
+          break;
+        pPos = found + 1;
+      }
+      error("missing " + endtag);
+    }
+
+    void parse_format(char const*& pPos, char const* pEnd)
+    {
+      auto version = 0.0;
+      if (!d2d::util::parse::parse_double(pPos, pEnd, version))
+        error("invalid $MeshFormat section");
+      auto filetype = parse_int(pPos, pEnd);
+      auto datasize = parse_int(pPos, pEnd);
+      pPos = d2d::util::parse::next_line(pPos, pEnd);
+      if (2.0 <= version && version < 3.0)
+        mVersion = 2;
+      else if (version == 4.1)
+        mVersion = 4;
+      else
+        unsupported("version " + std::to_string(version));
+      mBinary = filetype == 1;
+      if (datasize != 8)
+        unsupported("data size " + std::to_string(datasize));
+      if (mBinary) {
+        // Binary files contain the integer 1 to detect the byte order
+        if (load<int32_t>(pPos, pEnd) != 1)
+          unsupported("binary data in non-native byte order");
+        pPos = d2d::util::parse::next_line(pPos, pEnd);
+      }
+    }
+
+    void parse_nodes_v2(char const*& pPos, char const* pEnd)
+    {
+      auto numnodes = parse_size(pPos, pEnd);
+      pPos = d2d::util::parse::next_line(pPos, pEnd);
+      // The nodes are allocated only when the file is known to hold them
+      auto offset = mNodeTags.size();
+      if (mBinary) {
+        // Each node is an int tag followed by three doubles
+        auto recordsize = sizeof(int32_t) + 3 * sizeof(double);
+        auto data = skip_bytes(pPos, pEnd, numnodes, recordsize);
+        mNodeTags.resize(offset + numnodes);
+        mNodeCoords.resize(offset + numnodes);
+        d2d::util::parallel::for_each_range
+          (numnodes, [&](std::size_t pFirst, std::size_t pLast) {
+            for (auto idx = pFirst; idx < pLast; ++idx) {
+              auto record = data + idx * recordsize;
+              auto tag = load<int32_t>(record, pEnd);
+              mNodeTags[offset + idx] = (std::size_t) tag;
+              for (std::size_t cc = 0; cc < 3; ++cc)
+                mNodeCoords[offset + idx][cc] = (numeric_type) load<double>(record, pEnd);
+            }
+          });
+        return;
+      }
+      // Each line holds the tag and the coordinates of a node
+      auto tasks = std::vector<line_task> {};
+      auto marks = split_lines(pPos, pEnd, numnodes);
+      mNodeTags.resize(offset + numnodes);
+      mNodeCoords.resize(offset + numnodes);
+      for (std::size_t midx = 0; midx + 1 < marks.size(); ++midx)
+        tasks.push_back({marks[midx], nullptr,
+                         std::min(linesPerTask, numnodes - midx * linesPerTask),
+                         offset + midx * linesPerTask});
+      d2d::util::parallel::for_each_index(tasks.size(), [&](std::size_t pTaskIdx) {
+          auto const& task = tasks[pTaskIdx];
+          auto pos = task.tags;
+          for (std::size_t idx = 0; idx < task.numlines; ++idx) {
+            mNodeTags[task.offset + idx] = parse_size(pos, pEnd);
+            auto& coords = mNodeCoords[task.offset + idx];
+            for (std::size_t cc = 0; cc < 3; ++cc)
+              coords[cc] = parse_coordinate(pos, pEnd);
+            pos = d2d::util::parse::next_line(pos, pEnd);
+          }
+        });
+    }
+
+    void parse_nodes_v4(char const*& pPos, char const* pEnd)
+    {
+      std::size_t numblocks, numnodes;
+      if (mBinary) {
+        numblocks = load<uint64_t>(pPos, pEnd);
+        numnodes = load<uint64_t>(pPos, pEnd);
+        skip_bytes(pPos, pEnd, 2, sizeof(uint64_t)); // min and max tag
+      } else {
+        numblocks = parse_size(pPos, pEnd);
+        numnodes = parse_size(pPos, pEnd);
+        pPos = d2d::util::parse::next_line(pPos, pEnd);
+      }
+      // The nodes are allocated only when the blocks are known to hold them
+      auto offset = mNodeTags.size();
+      if (numnodes > SIZE_MAX - offset)
+        error("invalid number of nodes");
+      auto last = offset + numnodes;
+
+      // Collect the tasks of all the blocks first, then parse them in parallel
+      auto texttasks = std::vector<line_task> {};
+      auto binarytasks = std::vector<binary_task> {};
+      for (std::size_t bidx = 0; bidx < numblocks; ++bidx) {
+        int entitydim, parametric;
+        std::size_t numblocknodes;
+        if (mBinary) {
+          entitydim = load<int32_t>(pPos, pEnd);
+          load<int32_t>(pPos, pEnd); // entity tag
+          parametric = load<int32_t>(pPos, pEnd);
+          numblocknodes = load<uint64_t>(pPos, pEnd);
+        } else {
+          entitydim = parse_int(pPos, pEnd);
+          parse_int(pPos, pEnd); // entity tag
+          parametric = parse_int(pPos, pEnd);
+          numblocknodes = parse_size(pPos, pEnd);
+          pPos = d2d::util::parse::next_line(pPos, pEnd);
+        }
+        if (numblocknodes > last - offset)
+          error("node blocks hold more than the declared number of nodes");
+        if (entitydim < 0 || entitydim > 3)
+          error("invalid entity dimension " + std::to_string(entitydim));
+        if (mBinary) {
+          // With parametric coordinates each node has entitydim additional values
+          auto numcoords = 3 + (parametric != 0 ? (std::size_t) entitydim : 0);
+          auto tags = skip_bytes(pPos, pEnd, numblocknodes, sizeof(uint64_t));
+          auto coords = skip_bytes(pPos, pEnd, numblocknodes, numcoords * sizeof(double));
+          for (std::size_t first = 0; first < numblocknodes; first += linesPerTask)
+            binarytasks.push_back({tags + first * sizeof(uint64_t),
+                                   coords + first * numcoords * sizeof(double),
+                                   std::min(linesPerTask, numblocknodes - first),
+                                   offset + first, numcoords});
+        } else {
+          // All the tags come first, then all the coordinates (one node per line)
+          auto tagmarks = split_lines(pPos, pEnd, numblocknodes);
+          auto coordmarks = split_lines(pPos, pEnd, numblocknodes);
+          for (std::size_t midx = 0; midx + 1 < tagmarks.size(); ++midx)
+            texttasks.push_back({tagmarks[midx], coordmarks[midx],
+                                 std::min(linesPerTask, numblocknodes - midx * linesPerTask),
+                                 offset + midx * linesPerTask});
+        }
+        offset += numblocknodes;
+      }
+      if (offset != last)
+        error("node blocks hold less than the declared number of nodes");
+      mNodeTags.resize(last);
+      mNodeCoords.resize(last);
+
+      if (mBinary) {
+        d2d::util::parallel::for_each_index(binarytasks.size(), [&](std::size_t pTaskIdx) {
+            auto const& task = binarytasks[pTaskIdx];
+            auto tags = task.data;
+            for (std::size_t idx = 0; idx < task.numrecords; ++idx) {
+              mNodeTags[task.offset + idx] = (std::size_t) load<uint64_t>(tags, pEnd);
+              auto& point = mNodeCoords[task.offset + idx];
+              auto record = task.coords + idx * task.numvalues * sizeof(double);
+              for (std::size_t cc = 0; cc < 3; ++cc)
+                point[cc] = (numeric_type) load<double>(record, pEnd);
+            }
+          });
+        return;
+      }
+      d2d::util::parallel::for_each_index(texttasks.size(), [&](std::size_t pTaskIdx) {
+          auto const& task = texttasks[pTaskIdx];
+          auto tags = task.tags;
+          auto coords = task.coords;
+          for (std::size_t idx = 0; idx < task.numlines; ++idx) {
+            mNodeTags[task.offset + idx] = parse_size(tags, pEnd);
+            tags = d2d::util::parse::next_line(tags, pEnd);
+            // Parametric coordinates (if any) follow on the same line
+            auto& point = mNodeCoords[task.offset + idx];
+            for (std::size_t cc = 0; cc < 3; ++cc)
+              point[cc] = parse_coordinate(coords, pEnd);
+            coords = d2d::util::parse::next_line(coords, pEnd);
+          }
+        });
+    }
+
+    void parse_elements_v2(char const*& pPos, char const* pEnd)
+    {
+      auto numelements = parse_size(pPos, pEnd);
+      pPos = d2d::util::parse::next_line(pPos, pEnd);
+      if (mBinary) {
+        // The elements come in blocks of the same type and number of tags.
+        // Each element is an int tag, the int tags and the int node tags.
+        auto tasks = std::vector<binary_task> {};
+        auto numtriangles = mTriangleTags.size();
+        for (std::size_t numread = 0; numread < numelements; ) {
+          auto type = load<int32_t>(pPos, pEnd);
+          auto numfollow = (std::size_t) load<int32_t>(pPos, pEnd);
+          auto numtags = load<int32_t>(pPos, pEnd);
+          if (numfollow == 0 || numfollow > numelements - numread || numtags < 0)
+            error("invalid element block");
+          auto recordsize = (1 + (std::size_t) numtags + get_num_nodes(type)) * sizeof(int32_t);
+          auto data = skip_bytes(pPos, pEnd, numfollow, recordsize);
+          if (type == triangleType) {
+            for (std::size_t first = 0; first < numfollow; first += linesPerTask) {
+              tasks.push_back({data + first * recordsize, nullptr,
+                               std::min(linesPerTask, numfollow - first),
+                               numtriangles + first, (std::size_t) numtags});
+            }
+            numtriangles += numfollow;
+          }
+          numread += numfollow;
+        }
+        mTriangleTags.resize(numtriangles);
+        d2d::util::parallel::for_each_index(tasks.size(), [&](std::size_t pTaskIdx) {
+            auto const& task = tasks[pTaskIdx];
+            auto recordsize = (1 + task.numvalues + 3) * sizeof(int32_t);
+            for (std::size_t idx = 0; idx < task.numrecords; ++idx) {
+              auto record = task.data + idx * recordsize + (1 + task.numvalues) * sizeof(int32_t);
+              auto& triangle = mTriangleTags[task.offset + idx];
+              for (std::size_t cc = 0; cc < 3; ++cc)
+                triangle[cc] = (std::size_t) load<int32_t>(record, pEnd);
+            }
+          });
+        return;
+      }
+      // Each line holds the tag, the type, the number of tags, the tags and the
+      // node tags of an element. The number of triangles per task is not known
+      // in advance. Hence, the tasks collect them separately.
+      auto marks = split_lines(pPos, pEnd, numelements);
+      auto numtasks = marks.size() - 1;
+      auto triangles = std::vector<std::vector<d2d::util::triple<std::size_t> > > (numtasks);
+      d2d::util::parallel::for_each_index(numtasks, [&](std::size_t pTaskIdx) {
+          auto pos = marks[pTaskIdx];
+          auto numlines = std::min(linesPerTask, numelements - pTaskIdx * linesPerTask);
+          auto& result = triangles[pTaskIdx];
+          for (std::size_t idx = 0; idx < numlines; ++idx) {
+            parse_size(pos, pEnd); // element tag
+            auto type = parse_int(pos, pEnd);
+            auto numtags = parse_int(pos, pEnd);
+            if (type == triangleType) {
+              for (int tidx = 0; tidx < numtags; ++tidx)
+                parse_int(pos, pEnd);
+              d2d::util::triple<std::size_t> triangle;
+              for (std::size_t cc = 0; cc < 3; ++cc)
+                triangle[cc] = parse_size(pos, pEnd);
+              result.push_back(triangle);
+            }
+            pos = d2d::util::parse::next_line(pos, pEnd);
+          }
+        });
+      append_triangles(triangles);
+    }
+
+    void parse_elements_v4(char const*& pPos, char const* pEnd)
+    {
+      std::size_t numblocks;
+      if (mBinary) {
+        numblocks = load<uint64_t>(pPos, pEnd);
+        skip_bytes(pPos, pEnd, 3, sizeof(uint64_t)); // number of elements, min and max tag
+      } else {
+        numblocks = parse_size(pPos, pEnd);
+        pPos = d2d::util::parse::next_line(pPos, pEnd);
+      }
+      auto texttasks = std::vector<line_task> {};
+      auto binarytasks = std::vector<binary_task> {};
+      auto numtriangles = mTriangleTags.size();
+      for (std::size_t bidx = 0; bidx < numblocks; ++bidx) {
+        int type;
+        std::size_t numblockelements;
+        if (mBinary) {
+          load<int32_t>(pPos, pEnd); // entity dimension
+          load<int32_t>(pPos, pEnd); // entity tag
+          type = load<int32_t>(pPos, pEnd);
+          numblockelements = load<uint64_t>(pPos, pEnd);
+        } else {
+          parse_int(pPos, pEnd); // entity dimension
+          parse_int(pPos, pEnd); // entity tag
+          type = parse_int(pPos, pEnd);
+          numblockelements = parse_size(pPos, pEnd);
+          pPos = d2d::util::parse::next_line(pPos, pEnd);
+        }
+        if (mBinary) {
+          // Each element is the element tag followed by the node tags
+          auto recordsize = (1 + get_num_nodes(type)) * sizeof(uint64_t);
+          auto data = skip_bytes(pPos, pEnd, numblockelements, recordsize);
+          if (type == triangleType)
+            for (std::size_t first = 0; first < numblockelements; first += linesPerTask)
+              binarytasks.push_back({data + first * recordsize, nullptr,
+                                     std::min(linesPerTask, numblockelements - first),
+                                     numtriangles + first, 0});
+        } else {
+          auto marks = split_lines(pPos, pEnd, numblockelements);
+          if (type == triangleType)
+            for (std::size_t midx = 0; midx + 1 < marks.size(); ++midx)
+              texttasks.push_back({marks[midx], nullptr,
+                                   std::min(linesPerTask, numblockelements - midx * linesPerTask),
+                                   numtriangles + midx * linesPerTask});
+        }
+        if (type == triangleType)
+          numtriangles += numblockelements;
+      }
+      mTriangleTags.resize(numtriangles);
+
+      if (mBinary) {
+        d2d::util::parallel::for_each_index(binarytasks.size(), [&](std::size_t pTaskIdx) {
+            auto const& task = binarytasks[pTaskIdx];
+            auto recordsize = 4 * sizeof(uint64_t);
+            for (std::size_t idx = 0; idx < task.numrecords; ++idx) {
+              auto record = task.data + idx * recordsize + sizeof(uint64_t);
+              auto& triangle = mTriangleTags[task.offset + idx];
+              for (std::size_t cc = 0; cc < 3; ++cc)
+                triangle[cc] = (std::size_t) load<uint64_t>(record, pEnd);
+            }
+          });
+        return;
+      }
+      d2d::util::parallel::for_each_index(texttasks.size(), [&](std::size_t pTaskIdx) {
+          auto const& task = texttasks[pTaskIdx];
+          auto pos = task.tags;
+          for (std::size_t idx = 0; idx < task.numlines; ++idx) {
+            parse_size(pos, pEnd); // element tag
+            auto& triangle = mTriangleTags[task.offset + idx];
+            for (std::size_t cc = 0; cc < 3; ++cc)
+              triangle[cc] = parse_size(pos, pEnd);
+            pos = d2d::util::parse::next_line(pos, pEnd);
+          }
+        });
+    }
+
+    void append_triangles
+    (std::vector<std::vector<d2d::util::triple<std::size_t> > > const& pTriangles)
+    {
+      auto offsets = std::vector<std::size_t> (pTriangles.size() + 1, mTriangleTags.size());
+      for (std::size_t idx = 0; idx < pTriangles.size(); ++idx)
+        offsets[idx + 1] = offsets[idx] + pTriangles[idx].size();
+      mTriangleTags.resize(offsets.back());
+      d2d::util::parallel::for_each_index(pTriangles.size(), [&](std::size_t pIdx) {
+          std::copy(pTriangles[pIdx].begin(), pTriangles[pIdx].end(),
+                    mTriangleTags.begin() + offsets[pIdx]);
+        });
+    }
+
+    // Maps the node tags to vertex indices
+    void create_mesh()
+    {
+      auto index = node_index {mNodeTags};
+      if (index.is_identity()) {
+        this->mVertices = std::move(mNodeCoords);
+      } else {
+        auto order = index.get_order();
+        this->mVertices.resize(order.size());
+        d2d::util::parallel::for_each_range
+          (order.size(), [&](std::size_t pFirst, std::size_t pLast) {
+            for (auto idx = pFirst; idx < pLast; ++idx)
+              this->mVertices[idx] = mNodeCoords[order[idx]];
+          });
+      }
+      mNodeTags = {};
+      mNodeCoords = {};
+
+      d2d::util::parallel::for_each_range
+        (mTriangleTags.size(), [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto idx = pFirst; idx < pLast; ++idx)
+            for (auto& tag : mTriangleTags[idx])
+              if (!index.find(tag, tag))
+                error("triangle refers to unknown node");
+        });
+      this->mTriangles = std::move(mTriangleTags);
+    }
+  };
+
+  template<typename numeric_type>
+  constexpr std::size_t msh_reader<numeric_type>::linesPerTask;
+
+  template<typename numeric_type>
+  constexpr int msh_reader<numeric_type>::triangleType;
+}}
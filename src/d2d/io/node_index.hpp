@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+
+namespace d2d { namespace io {
+
+  // Maps the node tags of a mesh file, which need not be contiguous nor
+  // sorted, to vertex indices 0, 1, ... in ascending order of the tags.
+  // Nodes with a tag which occurs more than once are kept only once.
+  class node_index {
+  public:
+
+    node_index() = default;
+
+    node_index(d2d::util::array_view<std::size_t const> pTags)
+    {
+      if (pTags.empty())
+        return;
+      auto minmax = std::minmax_element(pTags.begin(), pTags.end());
+      mMinTag = *minmax.first;
+      auto range = *minmax.second - mMinTag + 1;
+      // A lookup table is affordable unless the tags are very sparse
+      if (range <= 2 * pTags.size() + 1024)
+        build_dense(pTags, range);
+      else
+        build_sparse(pTags);
+      mIdentity = mOrder.size() == pTags.size();
+      for (std::size_t idx = 0; mIdentity && idx < mOrder.size(); ++idx)
+        mIdentity = mOrder[idx] == idx;
+    }
+
+    // The number of distinct nodes
+    std::size_t size() const
+    {
+      return mOrder.size();
+    }
+
+    // True if the vertex indices equal the positions of the tags
+    bool is_identity() const
+    {
+      return mIdentity;
+    }
+
+    // The position (in the list of tags) of the node of each vertex
+    d2d::util::array_view<std::size_t const> get_order() const
+    {
+      return mOrder;
+    }
+
+    // Returns false if pTag is not a node tag
+    bool find(std::size_t pTag, std::size_t& pVertexIdx) const
+    {
+      if (!mDense.empty()) {
+        if (pTag < mMinTag || pTag - mMinTag >= mDense.size())
+          return false;
+        pVertexIdx = mDense[pTag - mMinTag];
+        return pVertexIdx != npos;
+      }
+      auto it = std::lower_bound
+        (mSparse.begin(), mSparse.end(), std::make_pair(pTag, (std::size_t) 0));
+      if (it == mSparse.end() || it->first != pTag)
+        return false;
+      pVertexIdx = it->second;
+      return true;
+    }
+
+  private:
+    void build_dense
+    (d2d::util::array_view<std::size_t const> pTags, std::size_t pRange)
+    {
+      mDense.assign(pRange, (std::size_t) npos);
+      for (std::size_t pos = 0; pos < pTags.size(); ++pos) {
+        auto& slot = mDense[pTags[pos] - mMinTag];
+        if (slot == npos)
+          slot = pos;
+      }
+      mOrder.reserve(pTags.size());
+      for (auto& slot : mDense) {
+        if (slot != npos) {
+          mOrder.push_back(slot);
+          slot = mOrder.size() - 1;
+        }
+      }
+    }
+
+    void build_sparse(d2d::util::array_view<std::size_t const> pTags)
+    {
+      mSparse.resize(pTags.size());
+      for (std::size_t pos = 0; pos < pTags.size(); ++pos)
+        mSparse[pos] = {pTags[pos], pos};
+      std::sort(mSparse.begin(), mSparse.end());
+      // Keep the first occurrence of each tag
+      mSparse.erase(std::unique(mSparse.begin(), mSparse.end(),
+                                [](std::pair<std::size_t, std::size_t> const& pA,
+                                   std::pair<std::size_t, std::size_t> const& pB) {
+                                  return pA.first == pB.first;
+                                }),
+                    mSparse.end());
+      mOrder.resize(mSparse.size());
+      for (std::size_t vidx = 0; vidx < mSparse.size(); ++vidx) {
+        mOrder[vidx] = mSparse[vidx].second;
+        mSparse[vidx].second = vidx;
+      }
+    }
+
+  private:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+    std::size_t mMinTag = 0;
+    std::vector<std::size_t> mDense;
+    std::vector<std::pair<std::size_t, std::size_t> > mSparse;
+    std::vector<std::size_t> mOrder;
+    bool mIdentity = true;
+  };
+}}
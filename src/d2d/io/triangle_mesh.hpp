@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/io/d2d_binary.hpp"
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/partition.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/reorder.hpp"
+#include "d2d/util/utils.hpp"
+#include "d2d/util/weld.hpp"
+
+namespace d2d { namespace io {
+
+  // The data of a triangle mesh as provided by the mesh readers (e.g.,
+  // gmsh_reader and msh_reader). The vertex indices of the triangles start
+  // from 0.
+  template<typename numeric_type>
+  class triangle_mesh {
+  public:
+
+    virtual ~triangle_mesh() = default;
+
+    triangle_mesh(triangle_mesh&&) = default;
+    triangle_mesh& operator=(triangle_mesh&&) = default;
+
+    // The views refer to the memory of this object (or to the file it maps,
+    // see load_binary()). They stay valid as long as it lives and the data
+    // has not been released.
+    d2d::util::array_view<d2d::util::triple<numeric_type> const>
+    get_vertices() const
+    {
+      if (this->mBinaryFile)
+        return this->mMappedVertices;
+      return this->mVertices;
+    }
+
+    d2d::util::array_view<d2d::util::triple<std::size_t> const>
+    get_triangles() const
+    {
+      if (this->mBinaryFile)
+        return this->mMappedTriangles;
+      return this->mTriangles;
+    }
+
+    // The release-functions move the data out of the mesh
+    std::vector<d2d::util::triple<numeric_type> >
+    release_vertices()
+    {
+      materialize();
+      return std::move(this->mVertices);
+    }
+
+    std::vector<d2d::util::triple<std::size_t> >
+    release_triangles()
+    {
+      materialize();
+      return std::move(this->mTriangles);
+    }
+
+    // Writes the vertices and triangles to a d2d binary file (see
+    // d2d/io/d2d_binary.hpp), which binary_mesh_reader loads
+    void save_binary(std::string const& pFilePath) const
+    {
+      static_assert(sizeof(std::size_t) == sizeof(uint64_t), "Indices are stored in 64 bits");
+      auto vertices = get_vertices();
+      auto triangles = get_triangles();
+      d2d::io::write_binary_file
+        (pFilePath, d2d::io::binary_kind::triangle_mesh, sizeof(numeric_type), 0,
+         {{d2d::io::binary_section::vertices, sizeof(vertices[0]), vertices.size(),
+              vertices.data()},
+          {d2d::io::binary_section::triangles, sizeof(triangles[0]), triangles.size(),
+              triangles.data()}});
+    }
+
+    // Merges the vertices within pTolerance of each other (see
+    // d2d/util/weld.hpp) and drops the triangles which degenerate. Returns
+    // the number of vertices removed.
+    std::size_t weld_vertices(double pTolerance)
+    {
+      materialize();
+      auto welded = d2d::util::weld_vertices(get_vertices(), pTolerance);
+      auto numremoved = this->mVertices.size() - welded.kept.size();
+      if (numremoved == 0)
+        return 0;
+      auto vertices = std::vector<d2d::util::triple<numeric_type> > (welded.kept.size());
+      for (std::size_t idx = 0; idx < vertices.size(); ++idx)
+        vertices[idx] = this->mVertices[welded.kept[idx]];
+      auto keptids = std::vector<std::size_t> {};
+      this->mTriangles = d2d::util::remap_triangles(get_triangles(), welded.remap, &keptids);
+      this->mVertices = std::move(vertices);
+      if (!this->mOriginalVertexIds.empty()) {
+        this->mOriginalVertexIds = d2d::util::gather(get_original_ids().points, welded.kept);
+        this->mOriginalTriangleIds = d2d::util::gather(get_original_ids().cells, keptids);
+      }
+      return numremoved;
+    }
+
+    // Sorts the vertices along a Morton curve and the triangles by the
+    // smallest new index of their vertices (see d2d/util/reorder.hpp)
+    void reorder_spatially()
+    {
+      materialize();
+      d2d::util::profile::phase phase {"reorder"};
+      phase.set_items(this->mVertices.size() + this->mTriangles.size());
+      auto vertexorder = d2d::util::spatial_order(get_vertices());
+      auto remap = d2d::util::invert_permutation(vertexorder);
+      this->mVertices = d2d::util::gather(get_vertices(), vertexorder);
+      auto triangleorder = d2d::util::renumber_and_order_triangles(this->mTriangles, remap);
+      this->mTriangles = d2d::util::gather(get_triangles(), triangleorder);
+      if (!this->mOriginalVertexIds.empty()) {
+        this->mOriginalVertexIds = d2d::util::gather(get_original_ids().points, vertexorder);
+        this->mOriginalTriangleIds = d2d::util::gather(get_original_ids().cells, triangleorder);
+      }
+    }
+
+    // Keeps track of the indices which the vertices and triangles have now
+    // through weld_vertices() and reorder_spatially()
+    void track_original_ids()
+    {
+      this->mOriginalVertexIds.resize(get_vertices().size());
+      std::iota(this->mOriginalVertexIds.begin(), this->mOriginalVertexIds.end(), (std::size_t) 0);
+      this->mOriginalTriangleIds.resize(get_triangles().size());
+      std::iota(this->mOriginalTriangleIds.begin(), this->mOriginalTriangleIds.end(), (std::size_t) 0);
+    }
+
+    // Empty views unless track_original_ids() was called
+    d2d::util::original_ids
+    get_original_ids() const
+    {
+      return {this->mOriginalVertexIds, this->mOriginalTriangleIds};
+    }
+
+    std::string get_input_file_path()
+    {
+      return this->mMshFilePath;
+    }
+
+  protected:
+    triangle_mesh() = default;
+
+    triangle_mesh(std::string const& pFilePath) :
+      mMshFilePath(pFilePath) {}
+
+    // Maps a d2d binary file written by save_binary(). The vertices and
+    // triangles are used in place; only a file of the other precision is
+    // converted into mVertices. Throws if a triangle refers to a vertex
+    // which the file does not hold.
+    void load_binary(std::string const& pFilePath)
+    {
+      auto file = std::make_shared<d2d::io::binary_file const>(pFilePath);
+      if (file->get_kind() != d2d::io::binary_kind::triangle_mesh)
+        throw std::runtime_error(pFilePath + " does not hold a triangle mesh");
+      this->mMappedVertices =
+        d2d::io::get_binary_reals<d2d::util::triple<numeric_type>, numeric_type, 3>
+        (*file, d2d::io::binary_section::vertices, this->mVertices);
+      this->mMappedTriangles =
+        file->template get_section<d2d::util::triple<std::size_t> >
+        (d2d::io::binary_section::triangles);
+      auto numvertices = this->mMappedVertices.size();
+      auto triangles = this->mMappedTriangles;
+      std::atomic<bool> valid {true};
+      d2d::util::parallel::for_each_range
+        (triangles.size(), [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto tidx = pFirst; tidx < pLast; ++tidx)
+            if (triangles[tidx][0] >= numvertices || triangles[tidx][1] >= numvertices ||
+                triangles[tidx][2] >= numvertices) {
+              valid = false;
+              return;
+            }
+        });
+      if (!valid)
+        throw std::runtime_error("A triangle of " + pFilePath + " refers to an unknown vertex");
+      this->mBinaryFile = std::move(file);
+    }
+
+  private:
+    // Copies mapped data into the vectors, for the functions which modify
+    // or release them
+    void materialize()
+    {
+      if (!this->mBinaryFile)
+        return;
+      this->mVertices = std::vector<d2d::util::triple<numeric_type> >
+        (this->mMappedVertices.begin(), this->mMappedVertices.end());
+      this->mTriangles = std::vector<d2d::util::triple<std::size_t> >
+        (this->mMappedTriangles.begin(), this->mMappedTriangles.end());
+      this->mBinaryFile.reset();
+    }
+
+  protected:
+    std::string mMshFilePath;
+    std::vector<d2d::util::triple<numeric_type> > mVertices;
+    std::vector<d2d::util::triple<std::size_t> > mTriangles;
+    std::vector<std::size_t> mOriginalVertexIds;
+    std::vector<std::size_t> mOriginalTriangleIds;
+    // Set while the data is the one of a mapped binary file
+    std::shared_ptr<d2d::io::binary_file const> mBinaryFile;
+    d2d::util::array_view<d2d::util::triple<numeric_type> const> mMappedVertices;
+    d2d::util::array_view<d2d::util::triple<std::size_t> const> mMappedTriangles;
+  };
+}}
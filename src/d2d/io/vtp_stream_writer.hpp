@@ -0,0 +1,1033 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/io/dsv_chunk_reader.hpp"
+#include "d2d/io/dsv_reader.hpp"
+#include "d2d/io/triangle_mesh.hpp"
+#include "d2d/io/write_options.hpp"
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/disc_attributes.hpp"
+#include "d2d/util/lod.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/partition.hpp"
+#include "d2d/util/pipeline.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/reorder.hpp"
+#include "d2d/util/simd.hpp"
+#include "d2d/util/stdio.hpp"
+#include "d2d/util/utils.hpp"
+
+// A VTK XML PolyData writer which does not depend on VTK. It streams the
+// arrays straight from the buffers of the readers to the output file in
+// bounded-size blocks instead of building a vtkPolyData first. Arrays
+// which do not exist in memory (e.g., the connectivity of vertex cells)
+// are generated block by block while writing.
+
+namespace d2d { namespace io {
+
+  // The types of DataArray elements this writer supports
+  enum class vtk_type {float32, float64, int32, int64, uint64};
+
+  template<typename type> struct vtk_type_of;
+  template<> struct vtk_type_of<float> {
+    static constexpr vtk_type value = vtk_type::float32; };
+  template<> struct vtk_type_of<double> {
+    static constexpr vtk_type value = vtk_type::float64; };
+  template<> struct vtk_type_of<int32_t> {
+    static constexpr vtk_type value = vtk_type::int32; };
+  template<> struct vtk_type_of<int64_t> {
+    static constexpr vtk_type value = vtk_type::int64; };
+  template<> struct vtk_type_of<uint64_t> {
+    static constexpr vtk_type value = vtk_type::uint64; };
+
+  inline char const* vtk_type_name(vtk_type pType)
+  {
+    switch (pType) {
+    case vtk_type::float32: return "Float32";
+    case vtk_type::float64: return "Float64";
+    case vtk_type::int32: return "Int32";
+    case vtk_type::int64: return "Int64";
+    case vtk_type::uint64: return "UInt64";
+    }
+    return "";
+  }
+
+  inline std::size_t vtk_type_size(vtk_type pType)
+  {
+    switch (pType) {
+    case vtk_type::float32: return 4;
+    case vtk_type::int32: return 4;
+    default: return 8;
+    }
+  }
+
+  // Description of one DataArray element. The values are either read from
+  // contiguous memory or produced by a generator function.
+  struct vtp_data_array {
+    // Fills pOut with the values [pFirst, pFirst + pCount)
+    using generator_type =
+      std::function<void (std::size_t pFirst, std::size_t pCount, void* pOut)>;
+
+    std::string name;
+    vtk_type type;
+    std::size_t numcomponents;
+    std::size_t numtuples;
+    void const* data = nullptr;
+    generator_type generate;
+
+    std::size_t num_values() const { return numcomponents * numtuples; }
+    std::size_t num_bytes() const { return num_values() * vtk_type_size(type); }
+
+    template<typename value_type>
+    static vtp_data_array
+    from_memory
+    (std::string pName, value_type const* pData,
+     std::size_t pNumComponents, std::size_t pNumTuples)
+    {
+      return {pName, vtk_type_of<value_type>::value, pNumComponents,
+              pNumTuples, pData, nullptr};
+    }
+
+    // pGenerator has to be callable as pGenerator(first, count, value_type*)
+    template<typename value_type, typename generator_function>
+    static vtp_data_array
+    generated
+    (std::string pName, std::size_t pNumComponents, std::size_t pNumTuples,
+     generator_function pGenerator)
+    {
+      return {pName, vtk_type_of<value_type>::value, pNumComponents, pNumTuples,
+              nullptr,
+              [pGenerator](std::size_t pFirst, std::size_t pCount, void* pOut) {
+                pGenerator(pFirst, pCount, static_cast<value_type*>(pOut));
+              }};
+    }
+  };
+
+  // One piece of a PolyData file
+  struct vtp_piece {
+    std::size_t numpoints = 0;
+    std::size_t numverts = 0;
+    std::size_t numpolys = 0;
+    std::vector<vtp_data_array> points; // zero or one array
+    std::vector<vtp_data_array> verts; // connectivity and offsets
+    std::vector<vtp_data_array> polys; // connectivity and offsets
+    std::vector<vtp_data_array> pointdata;
+    std::vector<vtp_data_array> celldata;
+    // The name of the cell data array which holds the normals, if any
+    std::string cellnormals;
+
+    // Appends the connectivity and offsets arrays of pNumCells vertex cells
+    // with one point each to pArrays, starting with point index pFirstPoint.
+    static void
+    add_vertex_cells
+    (std::vector<vtp_data_array>& pArrays, std::size_t pNumCells,
+     std::size_t pFirstPoint = 0)
+    {
+      pArrays.push_back(vtp_data_array::generated<int64_t>
+        ("connectivity", 1, pNumCells,
+         [pFirstPoint](std::size_t pFirst, std::size_t pCount, int64_t* pOut) {
+          for (std::size_t idx = 0; idx < pCount; ++idx)
+            pOut[idx] = (int64_t) (pFirstPoint + pFirst + idx);
+        }));
+      add_offsets(pArrays, pNumCells, 1);
+    }
+
+    // Appends an offsets array for pNumCells cells with pPointsPerCell points
+    static void
+    add_offsets
+    (std::vector<vtp_data_array>& pArrays, std::size_t pNumCells,
+     std::size_t pPointsPerCell)
+    {
+      pArrays.push_back(vtp_data_array::generated<int64_t>
+        ("offsets", 1, pNumCells,
+         [pPointsPerCell](std::size_t pFirst, std::size_t pCount, int64_t* pOut) {
+          // VTK XML files store the end offset of each cell
+          for (std::size_t idx = 0; idx < pCount; ++idx)
+            pOut[idx] = (int64_t) (pPointsPerCell * (pFirst + idx + 1));
+        }));
+    }
+  };
+
+  // The names of the files of partitioned output. For an output file
+  // "surface.vtp" (or "surface.pvtp") the index file is "surface.pvtp" and
+  // the pieces are "surface_0.vtp", "surface_1.vtp", ...
+  inline std::string get_pvtp_stem(std::string const& pOutFileName)
+  {
+    for (auto ext : {".pvtp", ".vtp"}) {
+      auto extlen = std::strlen(ext);
+      if (pOutFileName.size() > extlen &&
+          pOutFileName.compare(pOutFileName.size() - extlen, extlen, ext) == 0)
+        return pOutFileName.substr(0, pOutFileName.size() - extlen);
+    }
+    return pOutFileName;
+  }
+
+  inline std::string get_pvtp_index_file_name(std::string const& pOutFileName)
+  {
+    return get_pvtp_stem(pOutFileName) + ".pvtp";
+  }
+
+  inline std::string
+  get_pvtp_piece_file_name(std::string const& pOutFileName, std::size_t pIdx)
+  {
+    return get_pvtp_stem(pOutFileName) + "_" + std::to_string(pIdx) + ".vtp";
+  }
+
+  // The output file of the level of detail of pFactor
+  inline std::string
+  get_lod_file_name(std::string const& pOutFileName, std::size_t pFactor)
+  {
+    return get_pvtp_stem(pOutFileName) + "_lod" + std::to_string(pFactor) + ".vtp";
+  }
+
+  // All the files which may be written for pOutFileName with pOptions: the
+  // file itself or the index and the pieces, for each level of detail too
+  inline std::vector<std::string>
+  get_output_file_names(std::string const& pOutFileName, write_options const& pOptions)
+  {
+    auto names = std::vector<std::string> {pOutFileName};
+    for (auto factor : pOptions.lodfactors)
+      names.push_back(get_lod_file_name(pOutFileName, factor));
+    if (pOptions.numpieces <= 1)
+      return names;
+    auto result = std::vector<std::string> {};
+    for (auto const& name : names) {
+      result.push_back(get_pvtp_index_file_name(name));
+      for (std::size_t pidx = 0; pidx < pOptions.numpieces; ++pidx)
+        result.push_back(get_pvtp_piece_file_name(name, pidx));
+    }
+    return result;
+  }
+
+  // Writes a PolyData file from a list of pieces
+  class vtp_xml_writer {
+  public:
+
+    vtp_xml_writer(write_options const& pOptions) :
+      mOptions(pOptions)
+    {
+      if (mOptions.compression != write_options::compressor::none)
+        throw std::runtime_error
+          ("The native VTP writer does not support compression;"
+           " use the VTK writer for compressed output");
+    }
+
+    void write(std::string const& pFileName, std::vector<vtp_piece> const& pPieces)
+    {
+      d2d::util::profile::phase phase {"native write"};
+      open(pFileName);
+      write_header();
+      auto numpoints = (uint64_t) 0;
+      for (auto const& piece : pPieces) {
+        write_piece(piece);
+        numpoints += piece.numpoints;
+      }
+      phase.set_items(numpoints);
+      put("  </PolyData>\n");
+      if (mOptions.mode == write_options::data_mode::appended) {
+        put("  <AppendedData encoding=\"raw\">\n   _");
+        for (auto const& piece : pPieces)
+          for_each_array(piece, [this](vtp_data_array const& pArray) {
+              write_raw(pArray);
+            });
+        put("\n  </AppendedData>\n");
+      }
+      put("</VTKFile>\n");
+      phase.set_bytes(get_position());
+      close();
+    }
+
+    // The functions begin(), append() and finish() write a file piece by
+    // piece, such that the data of only one piece has to be in memory at a
+    // time. The number of pieces has to be known in advance. All the pieces
+    // have the arrays of pLayout. The header is written with placeholders
+    // first and rewritten in place by finish(). Only the appended data mode
+    // is supported.
+    void begin
+    (std::string const& pFileName, std::size_t pNumPieces, vtp_piece const& pLayout)
+    {
+      if (mOptions.mode != write_options::data_mode::appended)
+        throw std::runtime_error
+          ("Writing piece by piece requires the appended data mode");
+      if (d2d::util::stdio::is_stdio(pFileName))
+        throw std::runtime_error
+          ("Writing piece by piece requires a seekable output file, not stdout");
+      mPieces.assign(pNumPieces, describe(pLayout));
+      mNumAppended = 0;
+      mPadNumbers = true;
+      open(pFileName);
+      write_head_of_appended();
+      mHeadSize = std::ftell(mFile);
+    }
+
+    void append(vtp_piece const& pPiece)
+    {
+      if (mNumAppended == mPieces.size())
+        throw std::logic_error("More pieces appended than announced");
+      d2d::util::profile::phase phase {"native write"};
+      auto start = get_position();
+      for_each_array(pPiece, [this](vtp_data_array const& pArray) {
+          write_raw(pArray);
+        });
+      mPieces[mNumAppended++] = describe(pPiece);
+      phase.set_bytes(get_position() - start);
+      phase.set_items(pPiece.numpoints);
+    }
+
+    void finish()
+    {
+      if (mNumAppended != mPieces.size())
+        throw std::logic_error("Fewer pieces appended than announced");
+      put("\n  </AppendedData>\n");
+      put("</VTKFile>\n");
+      // Now the sizes of all the pieces are known
+      std::fseek(mFile, 0, SEEK_SET);
+      write_head_of_appended();
+      if (std::ftell(mFile) != mHeadSize)
+        throw std::logic_error("The size of the rewritten header differs");
+      mPadNumbers = false;
+      mPieces.clear();
+      close();
+    }
+
+    // Writes a PPolyData file which refers to the piece files pPieceFiles.
+    // pLayout describes the arrays of the pieces.
+    void write_index
+    (std::string const& pFileName, std::vector<std::string> const& pPieceFiles,
+     vtp_piece const& pLayout)
+    {
+      open(pFileName);
+      put("<?xml version=\"1.0\"?>\n");
+      put(std::string {"<VTKFile type=\"PPolyData\" version=\"0.1\" byte_order=\""} +
+          (is_little_endian() ? "LittleEndian" : "BigEndian") +
+          "\" header_type=\"UInt64\">\n");
+      put("  <PPolyData GhostLevel=\"0\">\n");
+      write_index_section("PPointData", "", pLayout.pointdata);
+      write_index_section("PCellData", pLayout.cellnormals, pLayout.celldata);
+      write_index_section("PPoints", "", pLayout.points);
+      for (auto const& piecefile : pPieceFiles) {
+        // The sources are relative to the directory of the index file
+        auto slash = piecefile.find_last_of('/');
+        auto source = slash == std::string::npos ? piecefile : piecefile.substr(slash + 1);
+        put("    <Piece Source=\"" + source + "\"/>\n");
+      }
+      put("  </PPolyData>\n");
+      put("</VTKFile>\n");
+      close();
+    }
+
+  private:
+    using header_type = uint64_t;
+
+    void write_index_section
+    (char const* pTag, std::string const& pNormals,
+     std::vector<vtp_data_array> const& pArrays)
+    {
+      put(std::string {"    <"} + pTag);
+      if (!pNormals.empty())
+        put(" Normals=\"" + pNormals + "\"");
+      put(">\n");
+      for (auto const& arr : pArrays) {
+        put(std::string {"      <PDataArray type=\""} + vtk_type_name(arr.type) +
+            "\" Name=\"" + arr.name + "\"");
+        if (arr.numcomponents != 1)
+          put(" NumberOfComponents=\"" + std::to_string(arr.numcomponents) + "\"");
+        put("/>\n");
+      }
+      put(std::string {"    </"} + pTag + ">\n");
+    }
+
+    // "-" is stdout
+    void open(std::string const& pFileName)
+    {
+      mFileName = pFileName;
+      mAppendedOffset = 0;
+      if (d2d::util::stdio::is_stdio(pFileName)) {
+        mFile = stdout;
+        return;
+      }
+      mOwnedFile.reset(std::fopen(pFileName.c_str(), "wb"));
+      if (!mOwnedFile)
+        throw std::runtime_error
+          ("Could not open " + pFileName + " for writing: " + std::strerror(errno));
+      mFile = mOwnedFile.get();
+      std::setvbuf(mFile, nullptr, _IOFBF, blockBytes);
+    }
+
+    void close()
+    {
+      auto file = mFile;
+      mFile = nullptr;
+      if (!mOwnedFile) {
+        if (std::fflush(file) != 0 || std::ferror(file) != 0)
+          throw std::runtime_error("Could not write stdout");
+        return;
+      }
+      auto error = std::ferror(mOwnedFile.get()) != 0;
+      if (std::fclose(mOwnedFile.release()) != 0 || error)
+        throw std::runtime_error("Could not write " + mFileName);
+    }
+
+    // The number of bytes written so far; 0 for stdout, which may be a pipe
+    uint64_t get_position() const
+    {
+      auto position = std::ftell(mFile);
+      return position > 0 ? (uint64_t) position : 0;
+    }
+
+    // Everything in front of the appended data of the incremental writes
+    void write_head_of_appended()
+    {
+      mAppendedOffset = 0;
+      write_header();
+      for (auto const& piece : mPieces)
+        write_piece(piece);
+      put("  </PolyData>\n");
+      put("  <AppendedData encoding=\"raw\">\n   _");
+    }
+
+    // A copy of the piece without its data. Sufficient to write its XML
+    // elements in appended data mode.
+    static vtp_piece describe(vtp_piece const& pPiece)
+    {
+      auto result = vtp_piece {};
+      result.numpoints = pPiece.numpoints;
+      result.numverts = pPiece.numverts;
+      result.numpolys = pPiece.numpolys;
+      result.cellnormals = pPiece.cellnormals;
+      auto strip = [](std::vector<vtp_data_array> const& pArrays) {
+        auto stripped = std::vector<vtp_data_array> {};
+        for (auto const& arr : pArrays)
+          stripped.push_back({arr.name, arr.type, arr.numcomponents, arr.numtuples,
+                              nullptr, nullptr});
+        return stripped;
+      };
+      result.points = strip(pPiece.points);
+      result.verts = strip(pPiece.verts);
+      result.polys = strip(pPiece.polys);
+      result.pointdata = strip(pPiece.pointdata);
+      result.celldata = strip(pPiece.celldata);
+      return result;
+    }
+
+    // The value of a numeric attribute followed by the closing quote. The
+    // incremental writes pad it (behind the quote) to a fixed width, so that
+    // the header can be rewritten in place.
+    std::string number(std::size_t pValue) const
+    {
+      auto result = std::to_string(pValue) + "\"";
+      if (mPadNumbers)
+        result.resize(21, ' '); // up to 20 digits and the quote
+      return result;
+    }
+
+    template<typename function_type>
+    static void for_each_array(vtp_piece const& pPiece, function_type pFun)
+    {
+      // The order has to match the order in which write_piece() assigns the
+      // appended offsets.
+      for (auto const& arr : pPiece.pointdata) pFun(arr);
+      for (auto const& arr : pPiece.celldata) pFun(arr);
+      for (auto const& arr : pPiece.points) pFun(arr);
+      for (auto const& arr : pPiece.verts) pFun(arr);
+      for (auto const& arr : pPiece.polys) pFun(arr);
+    }
+
+    static bool is_little_endian()
+    {
+      uint16_t probe = 1;
+      unsigned char firstbyte;
+      std::memcpy(&firstbyte, &probe, 1);
+      return firstbyte == 1;
+    }
+
+    void put(char const* pStr)
+    {
+      std::fputs(pStr, mFile);
+    }
+
+    void put(std::string const& pStr)
+    {
+      std::fwrite(pStr.data(), 1, pStr.size(), mFile);
+    }
+
+    void write_header()
+    {
+      put("<?xml version=\"1.0\"?>\n");
+      put(std::string {"<VTKFile type=\"PolyData\" version=\"0.1\" byte_order=\""} +
+          (is_little_endian() ? "LittleEndian" : "BigEndian") +
+          "\" header_type=\"UInt64\">\n");
+      put("  <PolyData>\n");
+    }
+
+    void write_piece(vtp_piece const& pPiece)
+    {
+      put("    <Piece NumberOfPoints=\"" + number(pPiece.numpoints) +
+          " NumberOfVerts=\"" + number(pPiece.numverts) +
+          " NumberOfLines=\"0\" NumberOfStrips=\"0\" NumberOfPolys=\"" +
+          number(pPiece.numpolys) + ">\n");
+      write_section("PointData", "", pPiece.pointdata);
+      write_section("CellData", pPiece.cellnormals, pPiece.celldata);
+      write_section("Points", "", pPiece.points);
+      // The sections of the pieces of incremental writes must not depend on
+      // the number of cells
+      if (pPiece.numverts > 0 || (mPadNumbers && !pPiece.verts.empty()))
+        write_section("Verts", "", pPiece.verts);
+      if (pPiece.numpolys > 0 || (mPadNumbers && !pPiece.polys.empty()))
+        write_section("Polys", "", pPiece.polys);
+      put("    </Piece>\n");
+    }
+
+    void write_section
+    (char const* pTag, std::string const& pNormals,
+     std::vector<vtp_data_array> const& pArrays)
+    {
+      put(std::string {"      <"} + pTag);
+      if (!pNormals.empty())
+        put(" Normals=\"" + pNormals + "\"");
+      put(">\n");
+      for (auto const& arr : pArrays)
+        write_data_array(arr);
+      put(std::string {"      </"} + pTag + ">\n");
+    }
+
+    void write_data_array(vtp_data_array const& pArray)
+    {
+      auto head = std::string {"        <DataArray type=\""} +
+        vtk_type_name(pArray.type) + "\" Name=\"" + pArray.name + "\"";
+      if (pArray.numcomponents != 1)
+        head += " NumberOfComponents=\"" +
+          std::to_string(pArray.numcomponents) + "\"";
+      switch (mOptions.mode) {
+      case write_options::data_mode::appended:
+        put(head + " format=\"appended\" offset=\"" +
+            number(mAppendedOffset) + "/>\n");
+        mAppendedOffset += sizeof(header_type) + pArray.num_bytes();
+        break;
+      case write_options::data_mode::binary:
+        put(head + " format=\"binary\">\n          ");
+        write_base64(pArray);
+        put("\n        </DataArray>\n");
+        break;
+      case write_options::data_mode::ascii:
+        put(head + " format=\"ascii\">\n");
+        write_ascii(pArray);
+        put("        </DataArray>\n");
+        break;
+      }
+    }
+
+    // Calls pFun(pointer, numvalues) for consecutive blocks of the values of
+    // pArray. Generated values are produced into a bounded buffer.
+    template<typename function_type>
+    void for_each_block(vtp_data_array const& pArray, function_type pFun)
+    {
+      auto valuesize = vtk_type_size(pArray.type);
+      auto numvalues = pArray.num_values();
+      auto blockvalues = blockBytes / valuesize;
+      for (std::size_t first = 0; first < numvalues; first += blockvalues) {
+        auto count = std::min(blockvalues, numvalues - first);
+        if (pArray.data != nullptr) {
+          pFun(static_cast<char const*>(pArray.data) + first * valuesize, count);
+        } else {
+          mBlock.resize(blockBytes);
+          pArray.generate(first, count, mBlock.data());
+          pFun(mBlock.data(), count);
+        }
+      }
+    }
+
+    void write_raw(vtp_data_array const& pArray)
+    {
+      header_type numbytes = pArray.num_bytes();
+      std::fwrite(&numbytes, sizeof(numbytes), 1, mFile);
+      auto valuesize = vtk_type_size(pArray.type);
+      for_each_block(pArray, [this, valuesize](char const* pData, std::size_t pCount) {
+          std::fwrite(pData, valuesize, pCount, mFile);
+        });
+    }
+
+    void write_base64(vtp_data_array const& pArray)
+    {
+      // The header and the data form one base64 stream
+      auto encoder = base64_encoder {mFile};
+      header_type numbytes = pArray.num_bytes();
+      encoder.put(reinterpret_cast<char const*>(&numbytes), sizeof(numbytes));
+      auto valuesize = vtk_type_size(pArray.type);
+      for_each_block(pArray, [&encoder, valuesize](char const* pData, std::size_t pCount) {
+          encoder.put(pData, pCount * valuesize);
+        });
+      encoder.finish();
+    }
+
+    void write_ascii(vtp_data_array const& pArray)
+    {
+      // One tuple per line; scalars are written six per line
+      auto perline = pArray.numcomponents == 1 ? 6 : pArray.numcomponents;
+      std::size_t column = 0;
+      auto type = pArray.type;
+      for_each_block(pArray, [&](char const* pData, std::size_t pCount) {
+          char buffer[32];
+          for (std::size_t idx = 0; idx < pCount; ++idx) {
+            format_value(type, pData, idx, buffer);
+            if (column == 0)
+              put("          ");
+            else
+              std::fputc(' ', mFile);
+            put(buffer);
+            if (++column == perline) {
+              std::fputc('\n', mFile);
+              column = 0;
+            }
+          }
+        });
+      if (column != 0)
+        std::fputc('\n', mFile);
+    }
+
+    static void
+    format_value
+    (vtk_type pType, char const* pData, std::size_t pIdx, char* pBuffer)
+    {
+      // The precisions are sufficient to restore the exact binary values
+      switch (pType) {
+      case vtk_type::float32: {
+        float value;
+        std::memcpy(&value, pData + 4 * pIdx, 4);
+        std::snprintf(pBuffer, 32, "%.9g", value);
+        break;
+      }
+      case vtk_type::float64: {
+        double value;
+        std::memcpy(&value, pData + 8 * pIdx, 8);
+        std::snprintf(pBuffer, 32, "%.17g", value);
+        break;
+      }
+      case vtk_type::int32: {
+        int32_t value;
+        std::memcpy(&value, pData + 4 * pIdx, 4);
+        std::snprintf(pBuffer, 32, "%" PRId32, value);
+        break;
+      }
+      case vtk_type::int64: {
+        int64_t value;
+        std::memcpy(&value, pData + 8 * pIdx, 8);
+        std::snprintf(pBuffer, 32, "%" PRId64, value);
+        break;
+      }
+      case vtk_type::uint64: {
+        uint64_t value;
+        std::memcpy(&value, pData + 8 * pIdx, 8);
+        std::snprintf(pBuffer, 32, "%" PRIu64, value);
+        break;
+      }
+      }
+    }
+
+    // A base64 encoder which may be fed in pieces of arbitrary size
+    class base64_encoder {
+    public:
+      base64_encoder(std::FILE* pFile) :
+        mFile(pFile) {}
+
+      void put(char const* pData, std::size_t pSize)
+      {
+        auto data = reinterpret_cast<unsigned char const*>(pData);
+        for (std::size_t idx = 0; idx < pSize; ++idx) {
+          mPending[mNumPending++] = data[idx];
+          if (mNumPending == 3)
+            flush_group();
+        }
+      }
+
+      void finish()
+      {
+        if (mNumPending > 0)
+          flush_group();
+        flush_output();
+      }
+
+    private:
+      void flush_group()
+      {
+        static char const* const alphabet =
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        auto numbytes = mNumPending;
+        for (auto idx = numbytes; idx < 3; ++idx)
+          mPending[idx] = 0;
+        uint32_t group =
+          ((uint32_t) mPending[0] << 16) | ((uint32_t) mPending[1] << 8) |
+          (uint32_t) mPending[2];
+        mOut[mNumOut++] = alphabet[(group >> 18) & 0x3f];
+        mOut[mNumOut++] = alphabet[(group >> 12) & 0x3f];
+        mOut[mNumOut++] = numbytes > 1 ? alphabet[(group >> 6) & 0x3f] : '=';
+        mOut[mNumOut++] = numbytes > 2 ? alphabet[group & 0x3f] : '=';
+        mNumPending = 0;
+        if (mNumOut + 4 > sizeof(mOut))
+          flush_output();
+      }
+
+      void flush_output()
+      {
+        std::fwrite(mOut, 1, mNumOut, mFile);
+        mNumOut = 0;
+      }
+
+      std::FILE* mFile;
+      unsigned char mPending[3];
+      std::size_t mNumPending = 0;
+      char mOut[4096];
+      std::size_t mNumOut = 0;
+    };
+
+  private:
+    static constexpr std::size_t blockBytes = 1 << 20;
+    write_options mOptions;
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> mOwnedFile {nullptr, &std::fclose};
+    std::string mFileName;
+    std::FILE* mFile = nullptr;
+    std::size_t mAppendedOffset = 0;
+    std::vector<char> mBlock;
+    // The state of incremental writes
+    std::vector<vtp_piece> mPieces;
+    std::size_t mNumAppended = 0;
+    bool mPadNumbers = false;
+    long mHeadSize = 0;
+  };
+
+  // The counterpart of vtp_writer which does not need VTK
+  template<typename numeric_type>
+  class vtp_stream_writer {
+
+  public:
+    static void
+    write_disc_surface
+    (d2d::io::dsv_reader<numeric_type>& dsvreader,
+     std::string outfilename,
+     write_options const& options = write_options {})
+    {
+      auto radii = dsvreader.get_sqrts_of_areas();
+      write_discs(dsvreader.get_vertices(), dsvreader.get_normals(), radii,
+                  outfilename, options, dsvreader.get_original_ids());
+    }
+
+    // Writes one piece per chunk of the reader. The chunks are read, their
+    // radii derived and their pieces written in a pipeline of three stages
+    // (see d2d/util/pipeline.hpp), hence up to five chunks are in memory at
+    // a time. Requires the appended data mode.
+    static void
+    write_disc_surface
+    (d2d::io::dsv_chunk_reader<numeric_type>& chunkreader,
+     std::string outfilename,
+     write_options const& options)
+    {
+      struct chunk {
+        dsv_columns<numeric_type> columns;
+        std::vector<numeric_type> radii;
+      };
+      auto writer = vtp_xml_writer {options};
+      auto numchunks = chunkreader.get_num_chunks();
+      writer.begin(outfilename, numchunks, disc_piece({}, {}, {}));
+      std::size_t nextchunk = 0;
+      d2d::util::pipeline<chunk> stages {1};
+      stages.set_source("read", [&](chunk& pChunk) {
+          if (nextchunk == numchunks)
+            return false;
+          pChunk.columns = chunkreader.read_chunk(nextchunk++);
+          return true;
+        });
+      stages.add_stage("derive", [](chunk& pChunk) {
+          auto const& areas = pChunk.columns.areas;
+          pChunk.radii.resize(areas.size());
+          d2d::util::simd::batch_sqrt(areas.data(), pChunk.radii.data(), areas.size());
+        });
+      stages.add_stage("write", [&](chunk& pChunk) {
+          writer.append(disc_piece(pChunk.columns.vertices, pChunk.columns.normals, pChunk.radii));
+        });
+      stages.run();
+      writer.finish();
+    }
+
+    static void
+    write_disc_surface
+    (d2d::io::triangle_mesh<numeric_type> const& mesh,
+     std::string outfilename,
+     write_options const& options = write_options {})
+    {
+      auto vertices = mesh.get_vertices();
+      auto triangles = mesh.get_triangles();
+      auto adjacency = d2d::util::vertex_triangle_adjacency
+        {vertices.size(), triangles, true};
+      auto discs = d2d::util::create_disc_attributes_from_triangles
+        (vertices, triangles, adjacency);
+      write_discs
+        (vertices, discs.normals, discs.radii, outfilename, options,
+         mesh.get_original_ids());
+    }
+
+    static void
+    write_triangle_surface
+    (d2d::io::triangle_mesh<numeric_type> const& mesh,
+     std::string outfilename,
+     write_options const& options = write_options {})
+    {
+      write_triangles(mesh.get_vertices(), mesh.get_triangles(),
+                      outfilename, options, mesh.get_original_ids());
+    }
+
+    static void
+    write_discs
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> normals,
+     d2d::util::array_view<numeric_type const> radii,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids = {})
+    {
+      if (!options.lodfactors.empty()) {
+        write_levels_of_detail(vertices, normals, radii, outfilename, options, ids);
+        return;
+      }
+      if (options.numpieces > 1) {
+        write_partitioned_discs(vertices, normals, radii, outfilename, options, ids);
+        return;
+      }
+      auto pieces = std::vector<vtp_piece> (1);
+      pieces[0] = disc_piece(vertices, normals, radii);
+      add_original_ids(pieces[0], ids.points, {});
+      vtp_xml_writer {options}.write(outfilename, pieces);
+    }
+
+    static void
+    write_triangles
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> triangles,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids = {})
+    {
+      if (options.numpieces > 1) {
+        write_partitioned_triangles(vertices, triangles, outfilename, options, ids);
+        return;
+      }
+      auto pieces = std::vector<vtp_piece> (1);
+      pieces[0] = triangle_piece(vertices, triangles);
+      add_original_ids(pieces[0], ids.points, ids.cells);
+      vtp_xml_writer {options}.write(outfilename, pieces);
+    }
+
+    // Writes the full surface and a reduced one per factor of
+    // options.lodfactors. The merged discs of the levels have no original
+    // ids.
+    static void
+    write_levels_of_detail
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> normals,
+     d2d::util::array_view<numeric_type const> radii,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids)
+    {
+      auto leveloptions = options;
+      leveloptions.lodfactors.clear();
+      write_discs(vertices, normals, radii, outfilename, leveloptions, ids);
+      d2d::util::for_each_level_of_detail
+        (vertices, normals, radii, options.lodfactors,
+         [&](std::size_t pFactor, d2d::util::disc_set<numeric_type> const& pLevel) {
+          auto levelfilename = get_lod_file_name(outfilename, pFactor);
+          if (options.verbose)
+            std::cout << "Writing " << pLevel.vertices.size() << " discs (level of detail "
+                      << pFactor << ") to "
+                      << (options.numpieces > 1 ? get_pvtp_index_file_name(levelfilename)
+                                                : levelfilename) << std::endl;
+          write_discs(pLevel.vertices, pLevel.normals, pLevel.radii, levelfilename, leveloptions);
+        });
+    }
+
+    // The discs are partitioned spatially into options.numpieces pieces
+    // which are written concurrently
+    static void
+    write_partitioned_discs
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> normals,
+     d2d::util::array_view<numeric_type const> radii,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids)
+    {
+      auto parts = d2d::util::partition_points(vertices, options.numpieces);
+      // In partition order each piece is a contiguous range
+      auto partvertices = d2d::util::gather(vertices, parts.order);
+      auto partnormals = d2d::util::gather(normals, parts.order);
+      auto partradii = d2d::util::gather(radii, parts.order);
+      auto partids = std::vector<std::size_t> {};
+      if (!ids.points.empty())
+        partids = d2d::util::gather(ids.points, parts.order);
+      auto files = std::vector<std::string> (parts.num_parts());
+      d2d::util::parallel::for_each_index(parts.num_parts(), [&](std::size_t pidx) {
+          auto first = parts.offsets[pidx];
+          auto count = parts.offsets[pidx + 1] - first;
+          auto pieces = std::vector<vtp_piece> (1);
+          pieces[0] = disc_piece
+            (d2d::util::array_view<d2d::util::triple<numeric_type> const> {partvertices}.subview(first, count),
+             d2d::util::array_view<d2d::util::triple<numeric_type> const> {partnormals}.subview(first, count),
+             d2d::util::array_view<numeric_type const> {partradii}.subview(first, count));
+          if (!partids.empty())
+            add_original_ids
+              (pieces[0], d2d::util::array_view<std::size_t const> {partids}.subview(first, count), {});
+          files[pidx] = get_pvtp_piece_file_name(outfilename, pidx);
+          vtp_xml_writer {options}.write(files[pidx], pieces);
+        });
+      auto layout = disc_piece({}, {}, {});
+      add_original_ids(layout, ids.points, {});
+      vtp_xml_writer {options}.write_index
+        (get_pvtp_index_file_name(outfilename), files, layout);
+    }
+
+    // The triangles are partitioned spatially (by their centroids). Each
+    // piece holds a copy of the vertices of its triangles.
+    static void
+    write_partitioned_triangles
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> triangles,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids)
+    {
+      auto centroids = std::vector<d2d::util::triple<numeric_type> > (triangles.size());
+      d2d::util::parallel::for_each_range
+        (triangles.size(), [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto tidx = pFirst; tidx < pLast; ++tidx) {
+            auto const& triangle = triangles[tidx];
+            for (std::size_t cc = 0; cc < 3; ++cc)
+              centroids[tidx][cc] =
+                (vertices[triangle[0]][cc] + vertices[triangle[1]][cc] +
+                 vertices[triangle[2]][cc]) / 3;
+          }
+        });
+      auto parts = d2d::util::partition_points
+        (d2d::util::array_view<d2d::util::triple<numeric_type> const> {centroids},
+         options.numpieces);
+      centroids = {};
+      auto files = std::vector<std::string> (parts.num_parts());
+      d2d::util::parallel::for_each_index(parts.num_parts(), [&](std::size_t pidx) {
+          auto part = d2d::util::extract_submesh(vertices, triangles, parts.get_part(pidx));
+          auto pieces = std::vector<vtp_piece> (1);
+          pieces[0] = triangle_piece(part.vertices, part.triangles);
+          auto pointids = std::vector<std::size_t> {};
+          auto cellids = std::vector<std::size_t> {};
+          if (!ids.points.empty()) {
+            pointids = d2d::util::gather(ids.points, part.globalids);
+            cellids = d2d::util::gather(ids.cells, parts.get_part(pidx));
+          }
+          add_original_ids(pieces[0], pointids, cellids);
+          files[pidx] = get_pvtp_piece_file_name(outfilename, pidx);
+          vtp_xml_writer {options}.write(files[pidx], pieces);
+        });
+      auto layout = triangle_piece({}, {});
+      add_original_ids(layout, ids.points, ids.cells);
+      vtp_xml_writer {options}.write_index
+        (get_pvtp_index_file_name(outfilename), files, layout);
+    }
+
+    // The points are stored in single precision, as by the VTK writer (see
+    // vtp_writer::create_point_array()); double coordinates are converted
+    // block by block while they are written
+    static vtp_data_array
+    point_array(d2d::util::triple<float> const* pVertices, std::size_t pNum)
+    {
+      return vtp_data_array::from_memory
+        ("Points", reinterpret_cast<float const*>(pVertices), 3, pNum);
+    }
+
+    static vtp_data_array
+    point_array(d2d::util::triple<double> const* pVertices, std::size_t pNum)
+    {
+      return vtp_data_array::generated<float>
+        ("Points", 3, pNum, [pVertices](std::size_t pFirst, std::size_t pCount, float* pOut) {
+          // pFirst and pCount count coordinates, not points
+          auto values = reinterpret_cast<double const*>(pVertices) + pFirst;
+          for (std::size_t idx = 0; idx < pCount; ++idx)
+            pOut[idx] = (float) values[idx];
+        });
+    }
+
+    // Each vertex becomes a vertex cell which carries a normal and a radius
+    static vtp_piece
+    disc_piece
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> normals,
+     d2d::util::array_view<numeric_type const> radii)
+    {
+      auto numpoints = vertices.size();
+      auto piece = vtp_piece {};
+      piece.numpoints = numpoints;
+      piece.numverts = numpoints;
+      piece.points.push_back(point_array(vertices.data(), numpoints));
+      vtp_piece::add_vertex_cells(piece.verts, numpoints);
+      piece.celldata.push_back(vtp_data_array::from_memory
+        ("Normals", reinterpret_cast<numeric_type const*>(normals.data()),
+         3, numpoints));
+      piece.celldata.push_back(vtp_data_array::from_memory
+        (radiusStr, radii.data(), 1, numpoints));
+      piece.cellnormals = "Normals";
+      return piece;
+    }
+
+    static vtp_piece
+    triangle_piece
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> triangles)
+    {
+      static_assert(sizeof(std::size_t) == sizeof(int64_t),
+                    "The connectivity is written straight from memory");
+      auto piece = vtp_piece {};
+      piece.numpoints = vertices.size();
+      piece.numpolys = triangles.size();
+      piece.points.push_back(point_array(vertices.data(), vertices.size()));
+      // The vertex indices are far below 2^63, hence their size_t
+      // representation equals their Int64 representation.
+      piece.polys.push_back(vtp_data_array::from_memory
+        ("connectivity",
+         reinterpret_cast<int64_t const*>(triangles.data()),
+         1, 3 * triangles.size()));
+      vtp_piece::add_offsets(piece.polys, triangles.size(), 3);
+      return piece;
+    }
+
+    // Adds the original ids (see d2d/util/reorder.hpp) as Int64 point and
+    // cell data; empty ones are left out
+    static void
+    add_original_ids
+    (vtp_piece& piece,
+     d2d::util::array_view<std::size_t const> pointids,
+     d2d::util::array_view<std::size_t const> cellids)
+    {
+      if (!pointids.empty())
+        piece.pointdata.push_back(vtp_data_array::from_memory
+          (pointIdsStr, reinterpret_cast<int64_t const*>(pointids.data()), 1,
+           pointids.size()));
+      if (!cellids.empty())
+        piece.celldata.push_back(vtp_data_array::from_memory
+          (cellIdsStr, reinterpret_cast<int64_t const*>(cellids.data()), 1,
+           cellids.size()));
+    }
+
+  private:
+    static constexpr char const* radiusStr = "radius";
+    static constexpr char const* pointIdsStr = "vtkOriginalPointIds";
+    static constexpr char const* cellIdsStr = "vtkOriginalCellIds";
+  };
+}}
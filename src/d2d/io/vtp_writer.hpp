@@ -1,18 +1,45 @@
 #pragma once
 
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
 #include <vtkCellArray.h>
 #include <vtkCellData.h>
 #include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
 #include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
-#include <vtkTriangle.h>
+#include <vtkVersionMacros.h>
 #include <vtkXMLPolyDataWriter.h>
 
 #include "d2d/io/dsv_reader.hpp"
-#include "d2d/io/gmsh_reader.hpp"
+#include "d2d/io/triangle_mesh.hpp"
+#include "d2d/io/vtp_stream_writer.hpp"
+#include "d2d/io/write_options.hpp"
+#include "d2d/util/disc_attributes.hpp"
+#include "d2d/util/lod.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/partition.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/reorder.hpp"
+#include "d2d/util/stdio.hpp"
 
 namespace d2d { namespace io {
+
+  // The VTK array class which holds values of numeric_type
+  template<typename type> struct vtk_array_of;
+  template<> struct vtk_array_of<float> {
+    using type = vtkFloatArray; };
+  template<> struct vtk_array_of<double> {
+    using type = vtkDoubleArray; };
+
   template<typename numeric_type>
   class vtp_writer {
 
@@ -20,67 +47,345 @@ namespace d2d { namespace io {
     static void
     write_disc_surface
     (d2d::io::dsv_reader<numeric_type>& dsvreader,
-     std::string outfilename)
+     std::string outfilename,
+     write_options const& options = write_options {})
     {
+      // The views do not copy the data of the reader
       auto vertices = dsvreader.get_vertices();
       auto normals = dsvreader.get_normals();
       auto radii = dsvreader.get_sqrts_of_areas();
-      auto polydata = create_disc_polydata(vertices, normals, radii);
-      write(polydata, outfilename);
+      write_discs(vertices, normals, radii, outfilename, options,
+                  dsvreader.get_original_ids());
     }
 
     static void
     write_disc_surface
-    (d2d::io::gmsh_reader<numeric_type>& gmshreader,
-     std::string outfilename)
+    (d2d::io::triangle_mesh<numeric_type> const& mesh,
+     std::string outfilename,
+     write_options const& options = write_options {})
     {
-      auto vertices = gmshreader.get_vertices();
-      auto triangles = gmshreader.get_triangles();
-      auto normals = create_disc_normals_from_triangles(vertices, triangles);
-      auto radii = create_disc_radii_from_triangles(vertices, triangles);
-      auto polydata = create_disc_polydata(vertices, normals, radii);
-      write(polydata, outfilename);
+      auto vertices = mesh.get_vertices();
+      auto triangles = mesh.get_triangles();
+      auto adjacency = d2d::util::vertex_triangle_adjacency
+        {vertices.size(), triangles, true};
+      auto discs = d2d::util::create_disc_attributes_from_triangles
+        (vertices, triangles, adjacency);
+      write_discs(vertices, discs.normals, discs.radii, outfilename, options,
+                  mesh.get_original_ids());
     }
 
     static void
     write_triangle_surface
-    (d2d::io::gmsh_reader<numeric_type>& gmshreader,
-     std::string outfilename)
+    (d2d::io::triangle_mesh<numeric_type> const& mesh,
+     std::string outfilename,
+     write_options const& options = write_options {})
     {
-      auto polydata = create_triangle_polydata(gmshreader);
-      write(polydata, outfilename);
+      write_triangles(mesh.get_vertices(), mesh.get_triangles(), outfilename, options,
+                      mesh.get_original_ids());
+    }
+
+    static void
+    write_discs
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> normals,
+     d2d::util::array_view<numeric_type const> radii,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids = {})
+    {
+      if (!options.lodfactors.empty()) {
+        write_levels_of_detail(vertices, normals, radii, outfilename, options, ids);
+        return;
+      }
+      if (options.numpieces <= 1) {
+        auto polydata = create_disc_polydata(vertices, normals, radii);
+        add_original_ids(polydata, ids.points, {});
+        write(polydata, outfilename, options);
+        return;
+      }
+      // Partition spatially; in partition order each piece is a contiguous range
+      auto parts = d2d::util::partition_points(vertices, options.numpieces);
+      auto partvertices = d2d::util::gather(vertices, parts.order);
+      auto partnormals = d2d::util::gather(normals, parts.order);
+      auto partradii = d2d::util::gather(radii, parts.order);
+      auto partids = std::vector<std::size_t> {};
+      if (!ids.points.empty())
+        partids = d2d::util::gather(ids.points, parts.order);
+      write_pieces(parts.num_parts(), outfilename, options,
+                   [&](std::size_t pidx, std::string const& pFileName, write_options const& pOptions) {
+          auto first = parts.offsets[pidx];
+          auto count = parts.offsets[pidx + 1] - first;
+          auto polydata = create_disc_polydata
+            (d2d::util::array_view<d2d::util::triple<numeric_type> const> {partvertices}.subview(first, count),
+             d2d::util::array_view<d2d::util::triple<numeric_type> const> {partnormals}.subview(first, count),
+             d2d::util::array_view<numeric_type const> {partradii}.subview(first, count));
+          if (!partids.empty())
+            add_original_ids
+              (polydata, d2d::util::array_view<std::size_t const> {partids}.subview(first, count), {});
+          write(polydata, pFileName, pOptions);
+        });
+      auto layout = vtp_piece {};
+      layout.points.push_back({"Points", vtk_type::float32, 3, 0, nullptr, nullptr});
+      layout.celldata.push_back
+        ({"Normals", vtk_type_of<numeric_type>::value, 3, 0, nullptr, nullptr});
+      layout.celldata.push_back
+        ({radiusStr, vtk_type_of<numeric_type>::value, 1, 0, nullptr, nullptr});
+      layout.cellnormals = "Normals";
+      if (!ids.points.empty())
+        layout.pointdata.push_back({pointIdsStr, vtk_type::int64, 1, 0, nullptr, nullptr});
+      write_index(outfilename, parts.num_parts(), options, layout);
+    }
+
+    // Writes the full surface and a reduced one per factor of
+    // options.lodfactors. The merged discs of the levels have no original
+    // ids.
+    static void
+    write_levels_of_detail
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> normals,
+     d2d::util::array_view<numeric_type const> radii,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids)
+    {
+      auto leveloptions = options;
+      leveloptions.lodfactors.clear();
+      write_discs(vertices, normals, radii, outfilename, leveloptions, ids);
+      d2d::util::for_each_level_of_detail
+        (vertices, normals, radii, options.lodfactors,
+         [&](std::size_t pFactor, d2d::util::disc_set<numeric_type> const& pLevel) {
+          auto levelfilename = get_lod_file_name(outfilename, pFactor);
+          if (options.verbose)
+            std::cout << "Writing " << pLevel.vertices.size() << " discs (level of detail "
+                      << pFactor << ") to "
+                      << (options.numpieces > 1 ? get_pvtp_index_file_name(levelfilename)
+                                                : levelfilename) << std::endl;
+          write_discs(pLevel.vertices, pLevel.normals, pLevel.radii, levelfilename, leveloptions);
+        });
+    }
+
+    static void
+    write_triangles
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> triangles,
+     std::string outfilename,
+     write_options const& options,
+     d2d::util::original_ids const& ids = {})
+    {
+      if (options.numpieces <= 1) {
+        auto polydata = create_triangle_polydata(vertices, triangles);
+        add_original_ids(polydata, ids.points, ids.cells);
+        write(polydata, outfilename, options);
+        return;
+      }
+      // Partition by the centroids of the triangles. Each piece holds a copy
+      // of the vertices of its triangles.
+      auto centroids = std::vector<d2d::util::triple<numeric_type> > (triangles.size());
+      d2d::util::parallel::for_each_range
+        (triangles.size(), [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto tidx = pFirst; tidx < pLast; ++tidx)
+            for (std::size_t cc = 0; cc < 3; ++cc)
+              centroids[tidx][cc] =
+                (vertices[triangles[tidx][0]][cc] + vertices[triangles[tidx][1]][cc] +
+                 vertices[triangles[tidx][2]][cc]) / 3;
+        });
+      auto parts = d2d::util::partition_points
+        (d2d::util::array_view<d2d::util::triple<numeric_type> const> {centroids},
+         options.numpieces);
+      centroids = {};
+      write_pieces(parts.num_parts(), outfilename, options,
+                   [&](std::size_t pidx, std::string const& pFileName, write_options const& pOptions) {
+          auto part = d2d::util::extract_submesh(vertices, triangles, parts.get_part(pidx));
+          auto polydata = create_triangle_polydata(part.vertices, part.triangles);
+          auto pointids = std::vector<std::size_t> {};
+          auto cellids = std::vector<std::size_t> {};
+          if (!ids.points.empty()) {
+            pointids = d2d::util::gather(ids.points, part.globalids);
+            cellids = d2d::util::gather(ids.cells, parts.get_part(pidx));
+            add_original_ids(polydata, pointids, cellids);
+          }
+          write(polydata, pFileName, pOptions);
+        });
+      auto layout = vtp_piece {};
+      layout.points.push_back({"Points", vtk_type::float32, 3, 0, nullptr, nullptr});
+      if (!ids.points.empty()) {
+        layout.pointdata.push_back({pointIdsStr, vtk_type::int64, 1, 0, nullptr, nullptr});
+        layout.celldata.push_back({cellIdsStr, vtk_type::int64, 1, 0, nullptr, nullptr});
+      }
+      write_index(outfilename, parts.num_parts(), options, layout);
     }
 
   private:
+    // Creates and writes the pieces concurrently. pWrite(pidx, filename,
+    // options) writes piece pidx; the data the polydata of a piece refers
+    // to has to live until it is written.
+    template<typename function_type>
+    static void
+    write_pieces
+    (std::size_t pNumPieces, std::string const& outfilename,
+     write_options const& options, function_type pWrite)
+    {
+      auto pieceoptions = options;
+      pieceoptions.verbose = false;
+      auto start = std::chrono::steady_clock::now();
+      d2d::util::parallel::for_each_index(pNumPieces, [&](std::size_t pidx) {
+          pWrite(pidx, get_pvtp_piece_file_name(outfilename, pidx), pieceoptions);
+        });
+      auto seconds = std::chrono::duration<double>
+        (std::chrono::steady_clock::now() - start).count();
+      if (options.verbose)
+        std::cout << "Wrote " << pNumPieces << " pieces in " << seconds << " s" << std::endl;
+    }
+
+    // The index file of partitioned output. pLayout describes the arrays
+    // as written by VTK.
+    static void
+    write_index
+    (std::string const& outfilename, std::size_t pNumPieces,
+     write_options const& options, vtp_piece const& pLayout)
+    {
+      auto files = std::vector<std::string> {};
+      for (std::size_t pidx = 0; pidx < pNumPieces; ++pidx)
+        files.push_back(get_pvtp_piece_file_name(outfilename, pidx));
+      // The index holds no array data, hence no compression
+      auto indexoptions = options;
+      indexoptions.compression = write_options::compressor::none;
+      vtp_xml_writer {indexoptions}.write_index
+        (get_pvtp_index_file_name(outfilename), files, pLayout);
+    }
+
+    // The polydata are built in bulk: the arrays of the reader are wrapped
+    // without copying wherever VTK stores the same type, and the others are
+    // filled in parallel. VTK only reads the arrays when writing, hence the
+    // const_casts; the caller keeps the data alive while the polydata is in
+    // use.
+
+    // An array of pNumComponents values per tuple using pData
+    template<typename array_type, typename value_type>
+    static vtkSmartPointer<array_type>
+    wrap_array(value_type const* pData, std::size_t pNumTuples, int pNumComponents)
+    {
+      auto array = vtkSmartPointer<array_type>::New();
+      array->SetNumberOfComponents(pNumComponents);
+      if (pNumTuples > 0)
+        // 1: the array does not own (and free) the data
+        array->SetArray(const_cast<value_type*>(pData),
+                        (vtkIdType) (pNumTuples * pNumComponents), 1);
+      return array;
+    }
+
+    // The points are stored in single precision (VTK's default)
+    static vtkSmartPointer<vtkFloatArray>
+    create_point_array(d2d::util::array_view<d2d::util::triple<float> const> invertices)
+    {
+      return wrap_array<vtkFloatArray>
+        (reinterpret_cast<float const*>(invertices.data()), invertices.size(), 3);
+    }
+
+    static vtkSmartPointer<vtkFloatArray>
+    create_point_array(d2d::util::array_view<d2d::util::triple<double> const> invertices)
+    {
+      auto array = vtkSmartPointer<vtkFloatArray>::New();
+      array->SetNumberOfComponents(3);
+      array->SetNumberOfTuples((vtkIdType) invertices.size());
+      auto data = array->GetPointer(0);
+      d2d::util::parallel::for_each_range
+        (invertices.size(), [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto pidx = pFirst; pidx < pLast; ++pidx)
+            for (std::size_t cc = 0; cc < 3; ++cc)
+              data[3 * pidx + cc] = (float) invertices[pidx][cc];
+        });
+      return array;
+    }
+
+    // Ids as vtkIdType, wrapped if the types are of the same size
+    static vtkSmartPointer<vtkIdTypeArray>
+    create_id_array(std::size_t const* pIds, std::size_t pNumIds)
+    {
+      if (sizeof(vtkIdType) == sizeof(std::size_t))
+        return wrap_array<vtkIdTypeArray>(reinterpret_cast<vtkIdType const*>(pIds), pNumIds, 1);
+      auto array = vtkSmartPointer<vtkIdTypeArray>::New();
+      array->SetNumberOfValues((vtkIdType) pNumIds);
+      auto data = array->GetPointer(0);
+      d2d::util::parallel::for_each_range(pNumIds, [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto idx = pFirst; idx < pLast; ++idx)
+            data[idx] = (vtkIdType) pIds[idx];
+        });
+      return array;
+    }
+
+    // pNumCells cells of pCellSize points each. pConnectivity holds their
+    // points one cell after the other; if it is null, cell idx consists of
+    // point idx (vertices).
+    static vtkSmartPointer<vtkCellArray>
+    create_cell_array
+    (std::size_t pNumCells, std::size_t pCellSize, std::size_t const* pConnectivity)
+    {
+      auto cells = vtkSmartPointer<vtkCellArray>::New();
+      auto pointid = [&](std::size_t pIdx) {
+        return (vtkIdType) (pConnectivity != nullptr ? pConnectivity[pIdx] : pIdx);
+      };
+#if VTK_MAJOR_VERSION >= 9
+      // Offsets and connectivity (VTK >= 9)
+      auto offsets = vtkSmartPointer<vtkIdTypeArray>::New();
+      offsets->SetNumberOfValues((vtkIdType) (pNumCells + 1));
+      auto offsetdata = offsets->GetPointer(0);
+      auto connectivity = vtkSmartPointer<vtkIdTypeArray> {};
+      if (pConnectivity != nullptr && sizeof(vtkIdType) == sizeof(std::size_t)) {
+        connectivity = create_id_array(pConnectivity, pNumCells * pCellSize);
+      } else {
+        connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+        connectivity->SetNumberOfValues((vtkIdType) (pNumCells * pCellSize));
+      }
+      auto connectivitydata = connectivity->GetPointer(0);
+      d2d::util::parallel::for_each_range(pNumCells, [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto cidx = pFirst; cidx < pLast; ++cidx) {
+            offsetdata[cidx] = (vtkIdType) (cidx * pCellSize);
+            if (pConnectivity == nullptr || sizeof(vtkIdType) != sizeof(std::size_t))
+              for (std::size_t cc = 0; cc < pCellSize; ++cc)
+                connectivitydata[cidx * pCellSize + cc] = pointid(cidx * pCellSize + cc);
+          }
+        });
+      offsetdata[pNumCells] = (vtkIdType) (pNumCells * pCellSize);
+      cells->SetData(offsets, connectivity);
+#else
+      // The legacy layout: the number of points of each cell followed by
+      // their ids
+      auto legacy = vtkSmartPointer<vtkIdTypeArray>::New();
+      legacy->SetNumberOfValues((vtkIdType) (pNumCells * (pCellSize + 1)));
+      auto legacydata = legacy->GetPointer(0);
+      d2d::util::parallel::for_each_range(pNumCells, [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto cidx = pFirst; cidx < pLast; ++cidx) {
+            auto cell = legacydata + cidx * (pCellSize + 1);
+            cell[0] = (vtkIdType) pCellSize;
+            for (std::size_t cc = 0; cc < pCellSize; ++cc)
+              cell[cc + 1] = pointid(cidx * pCellSize + cc);
+          }
+        });
+      cells->SetCells((vtkIdType) pNumCells, legacy);
+#endif
+      return cells;
+    }
+
     static vtkSmartPointer<vtkPolyData>
     create_disc_polydata
-    (std::vector<d2d::util::triple<numeric_type> >& invertices,
-     std::vector<d2d::util::triple<numeric_type> >& innormals,
-     std::vector<numeric_type>& inradii)
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> invertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> innormals,
+     d2d::util::array_view<numeric_type const> inradii)
     {
       auto numpoints = invertices.size();
+      d2d::util::profile::phase phase {"vtk polydata"};
+      phase.set_items(numpoints);
 
+      using array_type = typename vtk_array_of<numeric_type>::type;
       auto points = vtkSmartPointer<vtkPoints>::New();
-      auto cells = vtkSmartPointer<vtkCellArray>::New();
-      auto normals = vtkSmartPointer<vtkDoubleArray>::New();
-      normals->SetNumberOfComponents(3); // 3 dimensions
-      normals->SetNumberOfTuples(numpoints);
-      auto radii = vtkSmartPointer<vtkDoubleArray>::New();
-      radii->SetNumberOfComponents(1); // 1 dimension
-      radii->SetNumberOfTuples(numpoints);
-
-      // insert points into vtk data structure
-      for (size_t pidx = 0; pidx < numpoints; ++pidx) {
-        auto point = invertices[pidx];
-        auto normal = innormals[pidx];
-        auto radius = inradii[pidx];
-        auto writePointId = points->InsertNextPoint(point.data());
-        cells->InsertNextCell(1, &writePointId); // one cell for writePointId
-        //normals.push_back(normal);
-        normals->SetTuple(pidx, normal.data());
-        //radii.push_back(point[3]);
-        radii->SetTuple(pidx, &radius);
-      }
+      points->SetData(create_point_array(invertices));
+      // One vertex cell per point. The normals and the radii are stored in
+      // numeric_type.
+      auto cells = create_cell_array(numpoints, 1, nullptr);
+      auto normals = wrap_array<array_type>
+        (reinterpret_cast<numeric_type const*>(innormals.data()), numpoints, 3);
+      auto radii = wrap_array<array_type>(inradii.data(), numpoints, 1);
       auto polydata = vtkSmartPointer<vtkPolyData>::New();
       polydata->SetPoints(points);
       polydata->SetVerts(cells);
@@ -93,132 +398,133 @@ namespace d2d { namespace io {
 
     static vtkSmartPointer<vtkPolyData>
     create_triangle_polydata
-    (d2d::io::gmsh_reader<numeric_type>& gmshreader)
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> inpoints,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> intriangles)
     {
-      auto inpoints = gmshreader.get_vertices();
-      auto intriangles = gmshreader.get_triangles();
       auto numpoints = inpoints.size();
       auto numtriangles = intriangles.size();
+      d2d::util::profile::phase phase {"vtk polydata"};
+      phase.set_items(numpoints + numtriangles);
 
       auto vtkpoints = vtkSmartPointer<vtkPoints>::New();
-      auto vtkcells = vtkSmartPointer<vtkCellArray>::New();
-
-      // Handle points
-      for (size_t idx = 0; idx < numpoints; ++idx) {
-        auto& point = inpoints[idx];
-        auto writepointID =
-          vtkpoints->InsertNextPoint(point[0], point[1], point[2]);
-      }
-      // Handle triangles
-      for (size_t idx = 0; idx < numtriangles; ++idx) {
-        auto& intriangle = intriangles[idx];
-        auto outtriangle = vtkSmartPointer<vtkTriangle>::New();
-        outtriangle->GetPointIds()->SetId (0, intriangle[0]);
-        outtriangle->GetPointIds()->SetId (1, intriangle[1]);
-        outtriangle->GetPointIds()->SetId (2, intriangle[2]);
-        vtkcells->InsertNextCell(outtriangle);
-      }
+      vtkpoints->SetData(create_point_array(inpoints));
+      auto vtkcells = create_cell_array
+        (numtriangles, 3, reinterpret_cast<std::size_t const*>(intriangles.data()));
       auto polydata = vtkSmartPointer<vtkPolyData>::New();
       polydata->SetPoints(vtkpoints);
       polydata->SetPolys(vtkcells);
       return polydata;
     }
 
+    // Adds the original ids (see d2d/util/reorder.hpp) as point and cell
+    // data; empty ones are left out
     static void
-    write(vtkSmartPointer<vtkPolyData>& polydata, std::string outfilename)
+    add_original_ids
+    (vtkSmartPointer<vtkPolyData>& polydata,
+     d2d::util::array_view<std::size_t const> pointids,
+     d2d::util::array_view<std::size_t const> cellids)
     {
-      auto vtkwriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
-      vtkwriter->SetFileName(outfilename.c_str());
-      vtkwriter->SetInputData(polydata);
-      vtkwriter->SetDataModeToAscii(); // human readable XML output
-      vtkwriter->Write();
-    }
-
-  private:
-    static std::vector<d2d::util::triple<numeric_type> >
-    create_disc_normals_from_triangles
-    (std::vector<d2d::util::triple<numeric_type> >& vertices,
-     std::vector<d2d::util::triple<size_t> >& triangles)
-    {
-      auto numvertices = vertices.size();
-      auto p2tmap = create_point_indices_to_set_of_triangle_indices_map
-        (numvertices, triangles);
-      auto normals = std::vector<d2d::util::triple<numeric_type> > (vertices.size());
-      for (size_t vidx = 0; vidx < numvertices; ++vidx) {
-        normals[vidx] = compute_average_normal
-          (vertices, triangles, p2tmap[vidx]);
-      }
-      return normals;
+      auto toarray = [](d2d::util::array_view<std::size_t const> pIds, char const* pName) {
+        auto array = create_id_array(pIds.data(), pIds.size());
+        array->SetName(pName);
+        return array;
+      };
+      if (!pointids.empty())
+        polydata->GetPointData()->AddArray(toarray(pointids, pointIdsStr));
+      if (!cellids.empty())
+        polydata->GetCellData()->AddArray(toarray(cellids, cellIdsStr));
     }
 
-    static std::vector<numeric_type>
-    create_disc_radii_from_triangles
-    (std::vector<d2d::util::triple<numeric_type> >& vertices,
-     std::vector<d2d::util::triple<size_t> >& triangles)
+    static void
+    write
+    (vtkSmartPointer<vtkPolyData>& polydata,
+     std::string outfilename,
+     write_options const& options)
     {
-      auto numvertices = vertices.size();
-      auto p2tmap = create_point_indices_to_set_of_triangle_indices_map(numvertices, triangles);
-      auto radii = std::vector<numeric_type> (vertices.size());
-      for (size_t vidx = 0; vidx < numvertices; ++vidx) {
-        radii[vidx] = compute_radius(vertices, triangles, vidx, p2tmap[vidx]);
+      auto vtkwriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+      // VTK writes to files or strings only; the output for stdout is
+      // formed in memory
+      auto tostdout = d2d::util::stdio::is_stdio(outfilename);
+      if (tostdout)
+        vtkwriter->SetWriteToOutputString(1);
+      else
+        vtkwriter->SetFileName(outfilename.c_str());
+      vtkwriter->SetInputData(polydata);
+      switch (options.mode) {
+      case write_options::data_mode::ascii:
+        vtkwriter->SetDataModeToAscii(); // human readable XML output
+        if (options.compression != write_options::compressor::none)
+          std::cerr
+            << "Warning: compression is ignored for ASCII output" << std::endl;
+        break;
+      case write_options::data_mode::binary:
+        vtkwriter->SetDataModeToBinary(); // base64 encoded inline data
+        break;
+      case write_options::data_mode::appended:
+        vtkwriter->SetDataModeToAppended();
+        vtkwriter->SetEncodeAppendedData(0); // raw bytes; no base64
+        break;
       }
-      return radii;
-    }
-
-    static d2d::util::triple<numeric_type>
-    compute_average_normal
-    (std::vector<d2d::util::triple<numeric_type> >& vertices,
-     std::vector<d2d::util::triple<size_t> >& triangles,
-     std::vector<size_t>& adjtriangles)
-    {
-      auto result = d2d::util::triple<numeric_type> {0, 0, 0};
-      for (auto const& tidx: adjtriangles) {
-        auto pidcs = triangles[tidx];
-        auto tridata =
-          d2d::util::triple<d2d::util::triple<numeric_type> >
-          {vertices[pidcs[0]], vertices[pidcs[1]], vertices[pidcs[2]]};
-        auto normal = d2d::util::compute_normal(tridata);
-        result = d2d::util::sum(result, normal);
+      switch (options.compression) {
+      case write_options::compressor::none:
+        vtkwriter->SetCompressorTypeToNone();
+        break;
+      case write_options::compressor::zlib:
+        vtkwriter->SetCompressorTypeToZLib();
+        break;
+      case write_options::compressor::lz4:
+        vtkwriter->SetCompressorTypeToLZ4();
+        break;
       }
-      d2d::util::normalize(result);
-      return result;
-    }
-
-    static numeric_type
-    compute_radius
-    (std::vector<d2d::util::triple<numeric_type> >& vertices,
-     std::vector<d2d::util::triple<size_t> >& triangles,
-     size_t pidx,
-     std::vector<size_t>& adjtriangles)
-    {
-      auto result = (numeric_type) 0;
-      for (auto const& tidx: adjtriangles) {
-        auto pidcs = triangles[tidx];
-        auto tridata =
-          d2d::util::triple<d2d::util::triple<numeric_type> >
-          {vertices[pidcs[0]], vertices[pidcs[1]], vertices[pidcs[2]]};
-        auto centroid = d2d::util::get_centroid(tridata);
-        auto distance = d2d::util::distance(vertices[pidx], centroid);
-        if (result < distance)
-          result = distance;
+      vtkwriter->SetBlockSize(options.blocksize);
+      // 32 bit headers limit a binary array to 4 GiB
+      vtkwriter->SetHeaderTypeToUInt64();
+
+      auto start = std::chrono::steady_clock::now();
+      {
+        d2d::util::profile::phase phase {"vtk write"};
+        if (vtkwriter->Write() == 0)
+          throw std::runtime_error("Could not write " + outfilename);
+        if (tostdout) {
+          auto output = vtkwriter->GetOutputString();
+          if (std::fwrite(output.data(), 1, output.size(), stdout) != output.size() ||
+              std::fflush(stdout) != 0)
+            throw std::runtime_error("Could not write stdout");
+          phase.set_bytes(output.size());
+        } else {
+          phase.set_bytes_of_file(outfilename);
+        }
+        phase.set_items((uint64_t) polydata->GetNumberOfCells());
       }
-      return result;
+      auto seconds = std::chrono::duration<double>
+        (std::chrono::steady_clock::now() - start).count();
+      if (options.verbose)
+        report_throughput(outfilename, options, seconds);
     }
 
-    static std::vector<std::vector<size_t> >
-    create_point_indices_to_set_of_triangle_indices_map
-    (size_t numpoints, std::vector<d2d::util::triple<size_t> >& intriangles)
+    static void
+    report_throughput
+    (std::string const& outfilename,
+     write_options const& options,
+     double seconds)
     {
-      auto map = std::vector<std::vector<size_t> > (numpoints);
-      for (size_t tidx = 0; tidx < intriangles.size(); ++tidx) {
-        for (auto const& pnt : intriangles[tidx]) {
-          map[pnt].push_back(tidx);
-        }
-      }
-      return map;
+      struct stat filestat;
+      if (::stat(outfilename.c_str(), &filestat) != 0)
+        return;
+      auto megabytes = (double) filestat.st_size / (1024 * 1024);
+      std::cout
+        << "Wrote " << megabytes << " MiB ("
+        << write_options::to_string(options.mode) << ", "
+        << write_options::to_string(options.compression) << ") in "
+        << seconds << " s";
+      if (seconds > 0)
+        std::cout << " (" << megabytes / seconds << " MiB/s)";
+      std::cout << std::endl;
     }
 
   private:
     static constexpr char const* radiusStr = "radius";
+    static constexpr char const* pointIdsStr = "vtkOriginalPointIds";
+    static constexpr char const* cellIdsStr = "vtkOriginalCellIds";
   };
 }}
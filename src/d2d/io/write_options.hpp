@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/clo.hpp"
+#include "d2d/util/parse.hpp"
+
+namespace d2d { namespace io {
+
+  // Options which control the encoding of the VTK XML output
+  struct write_options {
+    enum class data_mode {ascii, binary, appended};
+    enum class compressor {none, zlib, lz4};
+    // vtk: build a vtkPolyData and write it with vtkXMLPolyDataWriter
+    // native: stream the data with vtp_stream_writer
+    enum class backend {vtk, native};
+
+    // ASCII output is the default for backward compatibility
+    data_mode mode = data_mode::ascii;
+    compressor compression = compressor::none;
+    // The size of the blocks in which compressed data is written. The default
+    // is the one of VTK; larger blocks only cost memory.
+    std::size_t blocksize = 32768;
+    static constexpr std::size_t maxBlockSize = std::size_t {1} << 30;
+    backend writer = backend::vtk;
+    // Print the throughput of each written file
+    bool verbose = true;
+    // More than one piece: the surface is partitioned spatially and each
+    // piece is written to its own file, along with a .pvtp index file
+    std::size_t numpieces = 1;
+    // Disc surfaces are also written at these levels of detail; a disc of
+    // level f stands for about f discs of the full surface
+    std::vector<std::size_t> lodfactors;
+
+    static bool parse_data_mode(std::string const& pStr, data_mode& pMode)
+    {
+      if (pStr == "ascii")
+        pMode = data_mode::ascii;
+      else if (pStr == "binary")
+        pMode = data_mode::binary;
+      else if (pStr == "appended")
+        pMode = data_mode::appended;
+      else
+        return false;
+      return true;
+    }
+
+    static bool parse_compressor(std::string const& pStr, compressor& pComp)
+    {
+      if (pStr == "none")
+        pComp = compressor::none;
+      else if (pStr == "zlib")
+        pComp = compressor::zlib;
+      else if (pStr == "lz4")
+        pComp = compressor::lz4;
+      else
+        return false;
+      return true;
+    }
+
+    static bool parse_backend(std::string const& pStr, backend& pBackend)
+    {
+      if (pStr == "vtk")
+        pBackend = backend::vtk;
+      else if (pStr == "native")
+        pBackend = backend::native;
+      else
+        return false;
+      return true;
+    }
+
+    // A comma separated list of factors greater than one
+    static bool parse_factors(std::string const& pStr, std::vector<std::size_t>& pFactors)
+    {
+      pFactors.clear();
+      std::size_t pos = 0;
+      while (pos <= pStr.size()) {
+        auto end = std::min(pStr.find(',', pos), pStr.size());
+        try {
+          std::size_t len = 0;
+          auto factor = std::stoul(pStr.substr(pos, end - pos), &len);
+          if (len != end - pos || factor < 2)
+            return false;
+          pFactors.push_back(factor);
+        } catch (std::exception const&) {
+          return false;
+        }
+        pos = end + 1;
+      }
+      return true;
+    }
+
+    static char const* to_string(data_mode pMode)
+    {
+      switch (pMode) {
+      case data_mode::binary: return "binary";
+      case data_mode::appended: return "appended";
+      default: return "ascii";
+      }
+    }
+
+    static char const* to_string(compressor pComp)
+    {
+      switch (pComp) {
+      case compressor::zlib: return "zlib";
+      case compressor::lz4: return "lz4";
+      default: return "none";
+      }
+    }
+
+    // Registers the command line options which control the output encoding
+    static void add_cml_params(d2d::util::clo::manager& pOptMan)
+    {
+      pOptMan.addCmlParam(d2d::util::clo::string_option
+        {"DATA_MODE", {"--data-mode"},
+           "output encoding: ascii (default), binary (base64) or appended (raw)"});
+      pOptMan.addCmlParam(d2d::util::clo::string_option
+        {"COMPRESSOR", {"--compressor"},
+           "compression of binary and appended output: none (default), zlib or lz4"});
+      pOptMan.addCmlParam(d2d::util::clo::string_option
+        {"BLOCK_SIZE", {"--block-size"},
+           "size in bytes of the blocks of compressed output, e.g., 65536 or 64K"
+           " (default: 32K; at most 1G)"});
+      pOptMan.addCmlParam(d2d::util::clo::string_option
+        {"WRITER", {"--writer"},
+           "vtk or native (streams the output without building VTK objects;"
+           " no compression)"});
+      pOptMan.addCmlParam(d2d::util::clo::string_option
+        {"PIECES", {"--pieces"},
+           "partitions the surface into the given number of pieces which are"
+           " written concurrently to separate files indexed by a .pvtp file"});
+      pOptMan.addCmlParam(d2d::util::clo::string_option
+        {"LOD", {"--lod"},
+           "also writes disc surfaces reduced by the given factors, e.g., 4,16,64,"
+           " to <name>_lod<factor>.vtp"});
+    }
+
+    // Reads the options registered by add_cml_params(). Returns false if one
+    // of the given values is invalid.
+    bool read_cml_params(d2d::util::clo::manager& pOptMan)
+    {
+      auto modestr = pOptMan.get_string_option_value("DATA_MODE");
+      auto compstr = pOptMan.get_string_option_value("COMPRESSOR");
+      auto blockstr = pOptMan.get_string_option_value("BLOCK_SIZE");
+      auto writerstr = pOptMan.get_string_option_value("WRITER");
+      auto piecesstr = pOptMan.get_string_option_value("PIECES");
+      auto lodstr = pOptMan.get_string_option_value("LOD");
+      if (!modestr.empty() && !parse_data_mode(modestr, mode))
+        return false;
+      if (!compstr.empty() && !parse_compressor(compstr, compression))
+        return false;
+      if (!writerstr.empty() && !parse_backend(writerstr, writer))
+        return false;
+      if (!blockstr.empty() &&
+          (!d2d::util::parse::parse_byte_size(blockstr, blocksize) ||
+           blocksize == 0 || blocksize > maxBlockSize))
+        return false;
+      if (!piecesstr.empty() && !d2d::util::parse::parse_count(piecesstr, numpieces))
+        return false;
+      if (!lodstr.empty() && !parse_factors(lodstr, lodfactors))
+        return false;
+      return true;
+    }
+  };
+}}
@@ -1,35 +1,392 @@
+#include <cmath>
+#include <memory>
+
+#include "d2d/io/binary_mesh_reader.hpp"
 #include "d2d/io/gmsh_reader.hpp"
+#include "d2d/io/msh_reader.hpp"
+#include "d2d/io/vtp_stream_writer.hpp"
 #include "d2d/io/vtp_writer.hpp"
+#include "d2d/util/batch.hpp"
+#include "d2d/util/cache.hpp"
+#include "d2d/util/adjacency.hpp"
 #include "d2d/util/clo.hpp"
+#include "d2d/util/disc_attributes.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/reorder.hpp"
+#include "d2d/util/stdio.hpp"
+#include "d2d/util/time_series.hpp"
 #include "d2d/util/utils.hpp"
+#include "d2d/util/watch.hpp"
+
+// With several pieces the output is indexed by a .pvtp file
+static std::string output_name
+(std::string const& outfilename, d2d::io::write_options const& writeoptions)
+{
+  if (writeoptions.numpieces > 1)
+    return d2d::io::get_pvtp_index_file_name(outfilename);
+  return outfilename;
+}
+
+// d2d binary files are mapped. The native reader handles MSH 2.2 and 4.1
+// files. Everything else is left to the Gmsh API. Without withtriangles the
+// triangles may be left out.
+template<typename numeric_type>
+static std::unique_ptr<d2d::io::triangle_mesh<numeric_type> > read_mesh
+(std::string const& infilename,
+ bool usegmshapi,
+ bool withtriangles,
+ bool verbose)
+{
+  auto mesh = std::unique_ptr<d2d::io::triangle_mesh<numeric_type> > {};
+  auto fromstdin = d2d::util::stdio::is_stdio(infilename);
+  if (!fromstdin && d2d::io::is_binary_file(infilename)) {
+    mesh.reset(new d2d::io::binary_mesh_reader<numeric_type> {infilename});
+  } else if (!usegmshapi) {
+    try {
+      mesh.reset(new d2d::io::msh_reader<numeric_type> {infilename, withtriangles});
+    } catch (d2d::io::unsupported_msh_format const& ee) {
+      // stdin has been consumed, and Gmsh reads named files only
+      if (fromstdin)
+        throw;
+      if (verbose)
+        std::cout << ee.what() << "; falling back to the Gmsh API" << std::endl;
+    }
+  }
+  if (!mesh)
+    mesh.reset(new d2d::io::gmsh_reader<numeric_type> {infilename, withtriangles});
+  return mesh;
+}
+
+template<typename numeric_type>
+static void convert
+(std::string const& infilename,
+ std::string const& outfilename,
+ bool todiscs,
+ bool usegmshapi,
+ double weldtolerance,
+ std::string const& savebinary,
+ d2d::util::reorder_options const& reorderoptions,
+ d2d::io::write_options const& writeoptions)
+{
+  auto native = writeoptions.writer == d2d::io::write_options::backend::native;
+  auto mesh = read_mesh<numeric_type>(infilename, usegmshapi, true, writeoptions.verbose);
+  auto& transferobject = *mesh;
+  if (!savebinary.empty()) {
+    if (writeoptions.verbose)
+      std::cout << "Saving mesh to " << savebinary << std::endl;
+    transferobject.save_binary(savebinary);
+  }
+  if (reorderoptions.originalids)
+    transferobject.track_original_ids();
+  if (weldtolerance >= 0) {
+    auto numwelded = transferobject.weld_vertices(weldtolerance);
+    if (writeoptions.verbose)
+      std::cout << "Welded " << numwelded << " vertices" << std::endl;
+  }
+  if (reorderoptions.reorder)
+    transferobject.reorder_spatially();
+  if (todiscs) {
+    if (writeoptions.verbose)
+      std::cout << "Writing disc-based surface to "
+        << output_name(outfilename, writeoptions) << std::endl;
+    if (native)
+      d2d::io::vtp_stream_writer<numeric_type>::write_disc_surface
+        (transferobject, outfilename, writeoptions);
+    else
+      d2d::io::vtp_writer<numeric_type>::write_disc_surface
+        (transferobject, outfilename, writeoptions);
+  } else {
+    if (writeoptions.verbose)
+      std::cout << "Writing triangle mesh to "
+        << output_name(outfilename, writeoptions) << std::endl;
+    if (native)
+      d2d::io::vtp_stream_writer<numeric_type>::write_triangle_surface
+        (transferobject, outfilename, writeoptions);
+    else
+      d2d::io::vtp_writer<numeric_type>::write_triangle_surface
+        (transferobject, outfilename, writeoptions);
+  }
+}
+
+// Converts the steps of a time series whose connectivity does not change.
+// The triangles are read from the first step only and its adjacency is
+// reused; each step only reads its vertices and computes the disc
+// attributes. Step N+1 is read while step N is written.
+template<typename numeric_type>
+static void convert_series
+(std::vector<d2d::util::series::step> const& steps,
+ std::string const& outfilename,
+ bool todiscs,
+ bool usegmshapi,
+ d2d::io::write_options const& writeoptions)
+{
+  auto native = writeoptions.writer == d2d::io::write_options::backend::native;
+  auto triangles = std::vector<d2d::util::triple<std::size_t> > {};
+  auto adjacency = d2d::util::vertex_triangle_adjacency {};
+  auto numvertices = std::size_t {0};
+  auto files = std::vector<std::string> (steps.size());
+  auto read = [&](std::size_t pIdx) {
+    return read_mesh<numeric_type>(steps[pIdx].input, usegmshapi, pIdx == 0, writeoptions.verbose);
+  };
+  auto write = [&](std::size_t pIdx, std::unique_ptr<d2d::io::triangle_mesh<numeric_type> >& pMesh) {
+    if (pIdx == 0) {
+      triangles = pMesh->release_triangles();
+      numvertices = pMesh->get_vertices().size();
+      if (todiscs)
+        adjacency = d2d::util::vertex_triangle_adjacency {numvertices, triangles, true};
+    }
+    auto vertices = pMesh->get_vertices();
+    if (vertices.size() != numvertices)
+      throw std::runtime_error
+        (steps[pIdx].input + " has " + std::to_string(vertices.size()) +
+         " vertices but the first step of the time series has " + std::to_string(numvertices));
+    auto stepfilename = d2d::util::series::get_step_file_name(outfilename, pIdx, steps.size());
+    files[pIdx] = output_name(stepfilename, writeoptions);
+    if (writeoptions.verbose)
+      std::cout << "Writing step " << pIdx << " (time " << steps[pIdx].time << ") to "
+                << files[pIdx] << std::endl;
+    if (todiscs) {
+      auto discs = d2d::util::create_disc_attributes_from_triangles
+        (vertices, triangles, adjacency);
+      if (native)
+        d2d::io::vtp_stream_writer<numeric_type>::write_discs
+          (vertices, discs.normals, discs.radii, stepfilename, writeoptions);
+      else
+        d2d::io::vtp_writer<numeric_type>::write_discs
+          (vertices, discs.normals, discs.radii, stepfilename, writeoptions);
+    } else {
+      if (native)
+        d2d::io::vtp_stream_writer<numeric_type>::write_triangles
+          (vertices, triangles, stepfilename, writeoptions);
+      else
+        d2d::io::vtp_writer<numeric_type>::write_triangles
+          (vertices, triangles, stepfilename, writeoptions);
+    }
+  };
+  d2d::util::series::run(steps.size(), read, write);
+  d2d::util::series::write_pvd(outfilename, steps, files);
+}
+
+static void convert
+(std::string const& infilename,
+ std::string const& outfilename,
+ bool todiscs,
+ bool usegmshapi,
+ double weldtolerance,
+ bool singleprecision,
+ std::string const& savebinary,
+ d2d::util::reorder_options const& reorderoptions,
+ d2d::io::write_options const& writeoptions)
+{
+  if (singleprecision)
+    convert<float>(infilename, outfilename, todiscs, usegmshapi, weldtolerance,
+                   savebinary, reorderoptions, writeoptions);
+  else
+    convert<double>(infilename, outfilename, todiscs, usegmshapi, weldtolerance,
+                    savebinary, reorderoptions, writeoptions);
+}
+
+static void convert_series
+(std::vector<d2d::util::series::step> const& steps,
+ std::string const& outfilename,
+ bool todiscs,
+ bool usegmshapi,
+ bool singleprecision,
+ d2d::io::write_options const& writeoptions)
+{
+  if (singleprecision)
+    convert_series<float>(steps, outfilename, todiscs, usegmshapi, writeoptions);
+  else
+    convert_series<double>(steps, outfilename, todiscs, usegmshapi, writeoptions);
+}
 
 int main(int argc, char* argv[])
 {
   auto optman = d2d::util::clo::manager {};
   optman.addCmlParam(d2d::util::clo::string_option
                      {"INPUT_FILE", {"--infile", "-i"},
-                        "specifies the name of the input file", true});
+                        "specifies the name of the input file (not with --batch or --glob)"});
   optman.addCmlParam(d2d::util::clo::string_option
                      {"OUTPUT_FILE", {"--outfile", "-o"},
-                        "specifies the name of the output file", true});
+                        "specifies the name of the output file (not with --batch or --glob)"});
   optman.addCmlParam(d2d::util::clo::bool_option
                      {"CONVERT_TO_DISCS", {"--convert-to-discs", "-c"},
                         "convert input to disc-based surface"});
-  auto succ = optman.parse_args(argc, argv);
+  optman.addCmlParam(d2d::util::clo::bool_option
+                     {"GMSH_API", {"--gmsh-api"},
+                        "read the input file with the Gmsh API instead of the native MSH reader"});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"WELD", {"--weld"},
+                        "merges vertices closer than the given tolerance (0: coincident ones) before the conversion"});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"PRECISION", {"--precision"},
+                        "float or double (default); float reads, processes and writes 32 bit values"});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"SAVE_BINARY", {"--save-binary"},
+                        "also saves the read mesh to the given d2d binary file, which can be used as input instead of the mesh file (not with --batch or --glob)"});
+  optman.addCmlParam(d2d::util::clo::string_option
+                     {"THREADS", {"--threads"},
+                        "specifies the number of threads (default: all hardware threads)"});
+  d2d::util::reorder_options::add_cml_params(optman);
+  d2d::io::write_options::add_cml_params(optman);
+  d2d::util::batch::add_cml_params(optman);
+  d2d::util::series::add_cml_params(optman);
+  d2d::util::watch::add_cml_params(optman);
+  d2d::util::cache::add_cml_params(optman);
+  d2d::util::profile::add_cml_params(optman);
+  auto writeoptions = d2d::io::write_options {};
+  auto succ = optman.parse_args(argc, argv) &&
+    writeoptions.read_cml_params(optman);
+  auto batchmode = succ && d2d::util::batch::is_requested(optman);
+  auto precision = std::string {};
+  if (succ) {
+    precision = optman.get_string_option_value("PRECISION");
+    succ = precision.empty() || precision == "float" || precision == "double";
+  }
+  auto numthreads = std::size_t {0};
+  if (succ && !optman.get_string_option_value("THREADS").empty()) {
+    succ = d2d::util::parse::parse_count(optman.get_string_option_value("THREADS"), numthreads);
+    if (!succ)
+      std::cerr << "Error: invalid value of --threads" << std::endl;
+  }
+  if (succ && !d2d::util::batch::check_cml_params(optman)) {
+    std::cerr << "Error: invalid value of --jobs" << std::endl;
+    succ = false;
+  }
+  auto weldtolerance = -1.0;
+  if (succ && !optman.get_string_option_value("WELD").empty()) {
+    auto weldstr = optman.get_string_option_value("WELD");
+    try {
+      auto end = std::size_t {0};
+      weldtolerance = std::stod(weldstr, &end);
+      if (end != weldstr.size() || !std::isfinite(weldtolerance))
+        weldtolerance = -1;
+    } catch (std::exception const&) {
+      weldtolerance = -1;
+    }
+    succ = weldtolerance >= 0;
+    if (!succ)
+      std::cerr << "Error: invalid value of --weld" << std::endl;
+  }
+  if (succ && !writeoptions.lodfactors.empty() &&
+      !optman.get_bool_option_value("CONVERT_TO_DISCS")) {
+    std::cerr << "Error: --lod requires --convert-to-discs" << std::endl;
+    succ = false;
+  }
+  auto savebinary = std::string {};
+  if (succ) {
+    savebinary = optman.get_string_option_value("SAVE_BINARY");
+    if (!savebinary.empty() && batchmode) {
+      std::cerr << "Error: --save-binary cannot be combined with --batch or --glob" << std::endl;
+      succ = false;
+    }
+  }
+  auto seriesmode = succ && d2d::util::series::is_requested(optman);
+  if (succ && seriesmode) {
+    if (batchmode || weldtolerance >= 0 || optman.get_bool_option_value("REORDER") ||
+        optman.get_bool_option_value("ORIGINAL_IDS") ||
+        !writeoptions.lodfactors.empty() || !savebinary.empty() ||
+        optman.get_bool_option_value("INCREMENTAL") ||
+        !optman.get_string_option_value("CACHE_DIR").empty()) {
+      std::cerr << "Error: --time-series cannot be combined with --batch, --glob, --weld,"
+        " --reorder, --original-ids, --lod, --save-binary, --incremental or --cache-dir"
+                << std::endl;
+      succ = false;
+    }
+  }
+  auto watchmode = succ && d2d::util::watch::is_requested(optman);
+  if (succ && watchmode && (batchmode || seriesmode || !savebinary.empty())) {
+    std::cerr << "Error: --watch cannot be combined with --batch, --glob, --time-series or"
+      " --save-binary" << std::endl;
+    succ = false;
+  }
+  if (succ && !batchmode && !watchmode) {
+    succ = (seriesmode || !optman.get_string_option_value("INPUT_FILE").empty()) &&
+      !optman.get_string_option_value("OUTPUT_FILE").empty();
+  }
+  auto usestdio = succ &&
+    (d2d::util::stdio::is_stdio(optman.get_string_option_value("INPUT_FILE")) ||
+     d2d::util::stdio::is_stdio(optman.get_string_option_value("OUTPUT_FILE")));
+  if (usestdio &&
+      (batchmode || watchmode || seriesmode || writeoptions.numpieces > 1 ||
+       !writeoptions.lodfactors.empty() || optman.get_bool_option_value("GMSH_API") ||
+       optman.get_bool_option_value("INCREMENTAL") ||
+       !optman.get_string_option_value("CACHE_DIR").empty())) {
+    std::cerr << "Error: - (stdin or stdout) cannot be combined with --batch, --glob, --watch,"
+      " --time-series, --pieces, --lod, --gmsh-api, --incremental or --cache-dir" << std::endl;
+    succ = false;
+  }
   if (!succ) {
     std::cout << optman.get_usage_msg();
     return EXIT_FAILURE;
   }
   auto infilename = optman.get_string_option_value("INPUT_FILE");
   auto outfilename = optman.get_string_option_value("OUTPUT_FILE");
+  // The output goes to stdout; all the messages go to stderr
+  if (d2d::util::stdio::is_stdio(outfilename))
+    std::cout.rdbuf(std::cerr.rdbuf());
+  if (numthreads > 0)
+    d2d::util::parallel::set_num_threads(numthreads);
 
-  auto transferobject = d2d::io::gmsh_reader<double> {infilename};
-  if (optman.get_bool_option_value("CONVERT_TO_DISCS")) {
-    std::cout << "Writing disc-based surface to " << outfilename << std::endl;
-    d2d::io::vtp_writer<double>::write_disc_surface(transferobject, outfilename);
-  } else {
-    std::cout << "Writing triangle mesh to " << outfilename << std::endl;
-    d2d::io::vtp_writer<double>::write_triangle_surface(transferobject, outfilename);
+  auto todiscs = optman.get_bool_option_value("CONVERT_TO_DISCS");
+  auto usegmshapi = optman.get_bool_option_value("GMSH_API");
+  auto singleprecision = precision == "float";
+  auto reorderoptions = d2d::util::reorder_options {};
+  reorderoptions.read_cml_params(optman);
+  auto profilefile = d2d::util::profile::read_cml_params(optman);
+  auto cache = std::unique_ptr<d2d::util::cache::incremental> {};
+  // Converts unless incremental conversion finds the output up to date
+  auto run = [&](std::string const& pInput, std::string const& pOutput) {
+    auto doconvert = [&] {
+      convert(pInput, pOutput, todiscs, usegmshapi, weldtolerance, singleprecision,
+              savebinary, reorderoptions, writeoptions);
+    };
+    if (cache)
+      cache->run(pInput, pOutput, d2d::io::get_output_file_names(pOutput, writeoptions),
+                 writeoptions.verbose, doconvert);
+    else
+      doconvert();
+  };
+
+  try {
+    if (seriesmode) {
+      auto steps = d2d::util::series::read_cml_params(optman);
+      convert_series(steps, outfilename, todiscs, usegmshapi, singleprecision, writeoptions);
+      d2d::util::profile::report(profilefile);
+      return EXIT_SUCCESS;
+    }
+    cache = d2d::util::cache::read_cml_params(optman, "msh2vtp");
+    if (watchmode) {
+      writeoptions.verbose = false;
+      // Binary inputs are recognized by their contents; .d2d is their name in
+      // watched directories
+      d2d::util::watch::run(optman, {".msh", ".d2d"}, ".vtp", run);
+      if (cache)
+        d2d::util::cache::print_summary(*cache);
+      d2d::util::profile::report(profilefile);
+      return EXIT_SUCCESS;
+    }
+    if (batchmode) {
+      auto jobs = d2d::util::batch::read_cml_params(optman, ".vtp");
+      writeoptions.verbose = false;
+      auto summary = d2d::util::batch::run
+        (jobs, d2d::util::batch::get_num_jobs(optman),
+         [&](d2d::util::batch::job const& jj) {
+          run(jj.input, jj.output);
+        });
+      d2d::util::batch::print_summary(summary);
+      if (cache)
+        d2d::util::cache::print_summary(*cache);
+      d2d::util::profile::report(profilefile);
+      return summary.numfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    run(infilename, outfilename);
+    d2d::util::profile::report(profilefile);
+  } catch (std::exception const& ee) {
+    std::cerr << "Error: " << ee.what() << std::endl;
+    return EXIT_FAILURE;
   }
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,225 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "d2d/util/simd.hpp"
+#include "d2d/util/utils.hpp"
+
+// Checks that the batch kernels of d2d/util/simd.hpp compute bit-identical
+// results to the scalar functions of d2d/util/utils.hpp, for float and
+// double, for all lengths up to a few vector widths (hence for every length
+// of the scalar tail) and for inputs including zeros, denormals, huge values
+// and degenerate triangles (zero-length normals). It tests the instruction
+// set which is selected at runtime; D2D_SIMD=scalar, avx2 or avx512 requests
+// a particular one. Returns 77 (skipped) if the CPU does not support the
+// requested instruction set.
+//
+// Built with NDEBUG, since util::normalize() asserts that its result has
+// unit length, which zero-length vectors do not.
+
+namespace {
+
+  constexpr int exitSkipped = 77;
+
+  // The largest vector width is 16 (floats with AVX-512)
+  constexpr std::size_t maxLength = 3 * 16 + 5;
+
+  std::size_t numFailures = 0;
+
+  // Equal bits, or both NaN (whose payload is not specified)
+  template<typename numeric_type>
+  bool same(numeric_type pA, numeric_type pB)
+  {
+    return (std::isnan(pA) && std::isnan(pB)) || std::memcmp(&pA, &pB, sizeof(pA)) == 0;
+  }
+
+  template<typename numeric_type>
+  void check
+  (char const* pKernel, std::size_t pLength, std::size_t pIdx,
+   numeric_type pExpected, numeric_type pActual)
+  {
+    if (same(pExpected, pActual))
+      return;
+    if (++numFailures <= 20)
+      std::cerr << "Error: " << pKernel << "<" << (sizeof(numeric_type) == 4 ? "float" : "double")
+                << "> of length " << pLength << " differs at " << pIdx << ": expected "
+                << pExpected << ", got " << pActual << std::endl;
+  }
+
+  // Vectors in structure-of-arrays form
+  template<typename numeric_type>
+  struct vectors {
+    std::vector<numeric_type> x, y, z;
+
+    explicit vectors(std::size_t pNum) : x(pNum), y(pNum), z(pNum) {}
+
+    d2d::util::simd::soa<numeric_type> get() { return {x.data(), y.data(), z.data()}; }
+
+    d2d::util::simd::soa<numeric_type const> get() const
+    {
+      return {x.data(), y.data(), z.data()};
+    }
+
+    d2d::util::triple<numeric_type> at(std::size_t pIdx) const
+    {
+      return {x[pIdx], y[pIdx], z[pIdx]};
+    }
+  };
+
+  // Values of all magnitudes, including the special ones
+  template<typename numeric_type>
+  class value_source {
+  public:
+    using limits = std::numeric_limits<numeric_type>;
+
+    numeric_type next()
+    {
+      auto uniform = std::uniform_real_distribution<numeric_type> {-1, 1};
+      auto value = uniform(mEngine);
+      switch (std::uniform_int_distribution<int> {0, 7}(mEngine)) {
+      case 0:
+        return 0;
+      case 1:
+        return -value * 0;
+      case 2:
+        // Denormal
+        return limits::denorm_min() * std::uniform_int_distribution<int> {1, 1000}(mEngine) *
+          (value < 0 ? -1 : 1);
+      case 3:
+        // Whose squares are denormal or zero
+        return value * std::sqrt(limits::min());
+      case 4:
+        // Whose squares overflow
+        return value * limits::max() / 2;
+      default:
+        return value * 1000;
+      }
+    }
+
+    void fill(vectors<numeric_type>& pV)
+    {
+      for (std::size_t idx = 0; idx < pV.x.size(); ++idx) {
+        pV.x[idx] = next();
+        pV.y[idx] = next();
+        pV.z[idx] = next();
+      }
+    }
+
+  private:
+    std::mt19937_64 mEngine {1};
+  };
+
+  template<typename numeric_type>
+  void test(std::size_t pLength, value_source<numeric_type>& pSource)
+  {
+    namespace simd = d2d::util::simd;
+    using triple = d2d::util::triple<numeric_type>;
+    auto p0 = vectors<numeric_type> {pLength};
+    auto p1 = vectors<numeric_type> {pLength};
+    auto p2 = vectors<numeric_type> {pLength};
+    pSource.fill(p0);
+    pSource.fill(p1);
+    pSource.fill(p2);
+    // Degenerate triangles: a point, and three points on a line
+    for (std::size_t idx = 0; idx < pLength; idx += 3) {
+      p1.x[idx] = p2.x[idx] = p0.x[idx];
+      p1.y[idx] = p2.y[idx] = p0.y[idx];
+      p1.z[idx] = p2.z[idx] = p0.z[idx];
+    }
+    for (std::size_t idx = 1; idx < pLength; idx += 5) {
+      p0.x[idx] = 1; p0.y[idx] = 2; p0.z[idx] = 3;
+      p1.x[idx] = 2; p1.y[idx] = 4; p1.z[idx] = 6;
+      p2.x[idx] = 4; p2.y[idx] = 8; p2.z[idx] = 12;
+    }
+    auto out = vectors<numeric_type> {pLength};
+    auto check_triples = [&](char const* pKernel, std::size_t pIdx, triple const& pExpected) {
+      check(pKernel, pLength, pIdx, pExpected[0], out.x[pIdx]);
+      check(pKernel, pLength, pIdx, pExpected[1], out.y[pIdx]);
+      check(pKernel, pLength, pIdx, pExpected[2], out.z[pIdx]);
+    };
+
+    simd::batch_sum<numeric_type>(p0.get(), p1.get(), out.get(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx)
+      check_triples("batch_sum", idx, d2d::util::sum(p0.at(idx), p1.at(idx)));
+
+    simd::batch_diff<numeric_type>(p0.get(), p1.get(), out.get(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx)
+      check_triples("batch_diff", idx, d2d::util::diff(p0.at(idx), p1.at(idx)));
+
+    simd::batch_cross_product<numeric_type>(p0.get(), p1.get(), out.get(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx)
+      check_triples("batch_cross_product", idx, d2d::util::cross_product(p0.at(idx), p1.at(idx)));
+
+    simd::batch_get_centroid<numeric_type>(p0.get(), p1.get(), p2.get(), out.get(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx)
+      check_triples("batch_get_centroid", idx,
+                    d2d::util::get_centroid<numeric_type>({p0.at(idx), p1.at(idx), p2.at(idx)}));
+
+    auto distances = std::vector<numeric_type> (pLength);
+    simd::batch_distance<numeric_type>(p0.get(), p1.get(), distances.data(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx)
+      check("batch_distance", pLength, idx,
+            d2d::util::distance<numeric_type>(p0.at(idx), p1.at(idx)), distances[idx]);
+
+    auto roots = std::vector<numeric_type> (pLength);
+    for (auto& value : distances)
+      value = std::fabs(value);
+    simd::batch_sqrt<numeric_type>(distances.data(), roots.data(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx)
+      check("batch_sqrt", pLength, idx, std::sqrt(distances[idx]), roots[idx]);
+
+    // The normals of the degenerate triangles have zero length
+    simd::batch_compute_normal<numeric_type>(p0.get(), p1.get(), p2.get(), out.get(), pLength);
+    auto normals = std::vector<triple> (pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx) {
+      auto triangle = d2d::util::triple<triple> {p0.at(idx), p1.at(idx), p2.at(idx)};
+      normals[idx] = d2d::util::compute_normal(triangle);
+      check_triples("batch_compute_normal", idx, normals[idx]);
+    }
+    for (std::size_t idx = 0; idx < pLength; ++idx) {
+      out.x[idx] = normals[idx][0];
+      out.y[idx] = normals[idx][1];
+      out.z[idx] = normals[idx][2];
+    }
+    simd::batch_normalize<numeric_type>(out.get(), pLength);
+    for (std::size_t idx = 0; idx < pLength; ++idx) {
+      d2d::util::normalize(normals[idx]);
+      check_triples("batch_normalize", idx, normals[idx]);
+    }
+  }
+
+  template<typename numeric_type>
+  void test_all()
+  {
+    auto source = value_source<numeric_type> {};
+    for (std::size_t length = 0; length <= maxLength; ++length)
+      test<numeric_type>(length, source);
+    test<numeric_type>(10000, source);
+  }
+}
+
+int main()
+{
+  auto const* requested = std::getenv("D2D_SIMD");
+  auto selected = d2d::util::simd::to_string(d2d::util::simd::get_isa());
+  if (requested != nullptr && *requested != '\0' && std::strcmp(requested, selected) != 0) {
+    std::cout << "The CPU does not support " << requested << " (selected: " << selected
+              << "); skipped" << std::endl;
+    return exitSkipped;
+  }
+  test_all<float>();
+  test_all<double>();
+  if (numFailures > 0) {
+    std::cerr << "Error: " << numFailures << " result(s) of " << selected
+              << " differ from the scalar functions" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "The " << selected << " kernels match the scalar functions" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/utils.hpp"
+
+namespace d2d { namespace util {
+
+  // The triangles adjacent to each vertex of a triangle mesh in compressed
+  // sparse row format: the indices of the triangles adjacent to vertex vidx
+  // are triangles[offsets[vidx]] to triangles[offsets[vidx+1] - 1] in
+  // ascending order.
+  class vertex_triangle_adjacency {
+  public:
+
+    vertex_triangle_adjacency() = default;
+
+    // Builds the adjacency by counting the triangles of each vertex first and
+    // scattering the triangle indices afterwards. The result does not depend
+    // on pParallel.
+    vertex_triangle_adjacency
+    (std::size_t pNumVertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> pTriangles,
+     bool pParallel = false)
+    {
+      d2d::util::profile::phase phase {"adjacency"};
+      phase.set_items(pTriangles.size());
+      if (pParallel && d2d::util::parallel::get_num_threads() > 1)
+        build_parallel(pNumVertices, pTriangles);
+      else
+        build(pNumVertices, pTriangles);
+    }
+
+    std::size_t num_vertices() const
+    {
+      return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    d2d::util::array_view<std::size_t const>
+    get_triangles(std::size_t pVertexIdx) const
+    {
+      assert(pVertexIdx < num_vertices() && "Index out of bounds");
+      return {triangles.data() + offsets[pVertexIdx],
+              offsets[pVertexIdx + 1] - offsets[pVertexIdx]};
+    }
+
+    d2d::util::array_view<std::size_t const>
+    operator[](std::size_t pVertexIdx) const
+    {
+      return get_triangles(pVertexIdx);
+    }
+
+    d2d::util::array_view<std::size_t const> get_offsets() const
+    {
+      return offsets;
+    }
+
+    d2d::util::array_view<std::size_t const> get_triangle_indices() const
+    {
+      return triangles;
+    }
+
+  private:
+    void build
+    (std::size_t pNumVertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> pTriangles)
+    {
+      offsets.assign(pNumVertices + 1, 0);
+      for (auto const& tri : pTriangles)
+        for (auto const& vidx : tri)
+          ++offsets[vidx + 1];
+      for (std::size_t vidx = 0; vidx < pNumVertices; ++vidx)
+        offsets[vidx + 1] += offsets[vidx];
+      triangles.resize(offsets.back());
+      // Scattering in triangle order leaves each row sorted
+      auto cursor = std::vector<std::size_t> (offsets.begin(), offsets.end() - 1);
+      for (std::size_t tidx = 0; tidx < pTriangles.size(); ++tidx)
+        for (auto const& vidx : pTriangles[tidx])
+          triangles[cursor[vidx]++] = tidx;
+    }
+
+    void build_parallel
+    (std::size_t pNumVertices,
+     d2d::util::array_view<d2d::util::triple<std::size_t> const> pTriangles)
+    {
+      namespace parallel = d2d::util::parallel;
+      auto counts = std::unique_ptr<std::atomic<std::size_t>[]>
+        (new std::atomic<std::size_t>[pNumVertices]);
+      parallel::for_each_range(pNumVertices, [&](std::size_t pBegin, std::size_t pEnd) {
+          for (auto vidx = pBegin; vidx < pEnd; ++vidx)
+            counts[vidx].store(0, std::memory_order_relaxed);
+        });
+      parallel::for_each_range(pTriangles.size(), [&](std::size_t pBegin, std::size_t pEnd) {
+          for (auto tidx = pBegin; tidx < pEnd; ++tidx)
+            for (auto const& vidx : pTriangles[tidx])
+              counts[vidx].fetch_add(1, std::memory_order_relaxed);
+        });
+      offsets.resize(pNumVertices + 1);
+      offsets[0] = 0;
+      for (std::size_t vidx = 0; vidx < pNumVertices; ++vidx)
+        offsets[vidx + 1] =
+          offsets[vidx] + counts[vidx].load(std::memory_order_relaxed);
+      // Reuse the counters as insertion cursors
+      parallel::for_each_range(pNumVertices, [&](std::size_t pBegin, std::size_t pEnd) {
+          for (auto vidx = pBegin; vidx < pEnd; ++vidx)
+            counts[vidx].store(offsets[vidx], std::memory_order_relaxed);
+        });
+      triangles.resize(offsets.back());
+      parallel::for_each_range(pTriangles.size(), [&](std::size_t pBegin, std::size_t pEnd) {
+          for (auto tidx = pBegin; tidx < pEnd; ++tidx)
+            for (auto const& vidx : pTriangles[tidx])
+              triangles[counts[vidx].fetch_add(1, std::memory_order_relaxed)] = tidx;
+        });
+      // The concurrent scatter leaves the rows in arbitrary order. Sorting
+      // them makes the result equal to the one of the sequential build.
+      parallel::for_each_range(pNumVertices, [&](std::size_t pBegin, std::size_t pEnd) {
+          for (auto vidx = pBegin; vidx < pEnd; ++vidx)
+            std::sort(triangles.begin() + offsets[vidx],
+                      triangles.begin() + offsets[vidx + 1]);
+        });
+    }
+
+  private:
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> triangles;
+  };
+}}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace d2d { namespace util {
+
+  // A non-owning view of a contiguous sequence of elements. The viewed
+  // memory has to outlive the view.
+  template<typename type>
+  class array_view {
+  public:
+    using value_type = typename std::remove_const<type>::type;
+    using iterator = type*;
+
+    array_view() = default;
+
+    array_view(type* pData, std::size_t pSize) :
+      mData(pData),
+      mSize(pSize) {}
+
+    // Views of std::vectors convert implicitly such that functions taking
+    // views accept vectors as well.
+    template<typename alloc_type>
+    array_view(std::vector<value_type, alloc_type>& pVector) :
+      mData(pVector.data()),
+      mSize(pVector.size()) {}
+
+    template<typename alloc_type>
+    array_view(std::vector<value_type, alloc_type> const& pVector) :
+      mData(pVector.data()),
+      mSize(pVector.size()) {}
+
+    // A view of mutable elements converts to a view of constant elements
+    template<typename other_type,
+             typename = typename std::enable_if
+               <std::is_same<type, other_type const>::value>::type>
+    array_view(array_view<other_type> const& pOther) :
+      mData(pOther.data()),
+      mSize(pOther.size()) {}
+
+    type* data() const { return mData; }
+    std::size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    iterator begin() const { return mData; }
+    iterator end() const { return mData + mSize; }
+
+    type& operator[](std::size_t pIdx) const
+    {
+      assert(pIdx < mSize && "Index out of bounds");
+      return mData[pIdx];
+    }
+
+    array_view subview(std::size_t pOffset, std::size_t pCount) const
+    {
+      assert(pOffset + pCount <= mSize && "Index out of bounds");
+      return {mData + pOffset, pCount};
+    }
+
+  private:
+    type* mData = nullptr;
+    std::size_t mSize = 0;
+  };
+}}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <glob.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/clo.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/parse.hpp"
+#include "d2d/util/thread_pool.hpp"
+
+// Converts many files within one process. The jobs come from a manifest
+// file or a glob pattern and are run on a bounded pool of workers. A failing
+// job is reported and does not affect the other jobs.
+
+namespace d2d { namespace util { namespace batch {
+
+  struct job {
+    std::string input;
+    std::string output;
+  };
+
+  struct summary {
+    std::size_t numsucceeded = 0;
+    std::size_t numfailed = 0;
+    uint64_t inbytes = 0;
+    uint64_t outbytes = 0;
+    double seconds = 0;
+  };
+
+  inline uint64_t get_file_size(std::string const& pFilePath)
+  {
+    struct stat filestat;
+    if (::stat(pFilePath.c_str(), &filestat) != 0)
+      return 0;
+    return (uint64_t) filestat.st_size;
+  }
+
+  // Reads a manifest with one job per line: the input file and the output
+  // file separated by whitespace. Empty lines and lines starting with # are
+  // ignored.
+  inline std::vector<job> read_manifest(std::string const& pFilePath)
+  {
+    auto file = std::ifstream {pFilePath};
+    if (!file)
+      throw std::runtime_error("Could not open manifest " + pFilePath);
+    auto result = std::vector<job> {};
+    auto line = std::string {};
+    for (std::size_t linenum = 1; std::getline(file, line); ++linenum) {
+      auto stream = std::istringstream {line};
+      auto jj = job {};
+      if (!(stream >> jj.input) || jj.input[0] == '#')
+        continue;
+      if (!(stream >> jj.output))
+        throw std::runtime_error
+          ("Missing output file in line " + std::to_string(linenum) + " of " + pFilePath);
+      result.push_back(jj);
+    }
+    return result;
+  }
+
+  // The suffixes of compressed inputs (see d2d/util/decompress.hpp)
+  inline std::vector<std::string> get_compression_suffixes()
+  {
+    return {".gz", ".xz", ".zst"};
+  }
+
+  // The output file of an input is its name with the extension (and the
+  // suffix of a compressed input before it, e.g., x.dsv.gz) replaced by
+  // pExtension, placed in pOutDir or, if pOutDir is empty, next to the input
+  inline std::string get_output_file_name
+  (std::string const& pInput, std::string const& pOutDir, std::string const& pExtension)
+  {
+    auto slash = pInput.find_last_of('/');
+    auto dir = slash == std::string::npos ? std::string {} : pInput.substr(0, slash + 1);
+    auto name = slash == std::string::npos ? pInput : pInput.substr(slash + 1);
+    for (auto const& suffix : get_compression_suffixes())
+      if (name.size() > suffix.size() &&
+          name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        name.erase(name.size() - suffix.size());
+        break;
+      }
+    auto dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot != 0)
+      name.erase(dot);
+    if (!pOutDir.empty())
+      dir = pOutDir.back() == '/' ? pOutDir : pOutDir + "/";
+    return dir + name + pExtension;
+  }
+
+  // Returns the jobs for the files matching pPattern (see
+  // get_output_file_name() for the names of the outputs)
+  inline std::vector<job> expand_glob
+  (std::string const& pPattern, std::string const& pOutDir, std::string const& pExtension)
+  {
+    glob_t globresult;
+    auto status = ::glob(pPattern.c_str(), 0, nullptr, &globresult);
+    if (status == GLOB_NOMATCH)
+      throw std::runtime_error("No files match " + pPattern);
+    if (status != 0)
+      throw std::runtime_error("Could not expand " + pPattern);
+    auto result = std::vector<job> {};
+    for (std::size_t idx = 0; idx < globresult.gl_pathc; ++idx) {
+      auto input = std::string {globresult.gl_pathv[idx]};
+      result.push_back({input, get_output_file_name(input, pOutDir, pExtension)});
+    }
+    ::globfree(&globresult);
+    return result;
+  }
+
+  inline void add_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"BATCH", {"--batch"},
+                           "converts the pairs of input and output files listed in the given manifest"});
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"GLOB", {"--glob"},
+                           "converts all the files matching the given pattern (quote it)"});
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"OUTDIR", {"--outdir"},
+                           "specifies the directory of the output files of --glob and --watch (default: next to the inputs)"});
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"JOBS", {"--jobs"},
+                           "specifies the number of files converted concurrently in batch mode (default: number of threads)"});
+  }
+
+  // Returns the jobs requested on the command line. The result is empty if
+  // neither --batch nor --glob was given.
+  inline std::vector<job>
+  read_cml_params(d2d::util::clo::manager& pOptMan, std::string const& pExtension)
+  {
+    auto result = std::vector<job> {};
+    auto manifest = pOptMan.get_string_option_value("BATCH");
+    if (!manifest.empty())
+      result = read_manifest(manifest);
+    auto pattern = pOptMan.get_string_option_value("GLOB");
+    if (!pattern.empty()) {
+      auto globbed = expand_glob(pattern, pOptMan.get_string_option_value("OUTDIR"), pExtension);
+      result.insert(result.end(), globbed.begin(), globbed.end());
+    }
+    return result;
+  }
+
+  inline bool is_requested(d2d::util::clo::manager& pOptMan)
+  {
+    return !pOptMan.get_string_option_value("BATCH").empty() ||
+      !pOptMan.get_string_option_value("GLOB").empty();
+  }
+
+  // Returns false if the value of --jobs is invalid. Called before any mode
+  // starts.
+  inline bool check_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    auto numjobs = pOptMan.get_string_option_value("JOBS");
+    auto value = std::size_t {0};
+    return numjobs.empty() || d2d::util::parse::parse_count(numjobs, value);
+  }
+
+  inline std::size_t get_num_jobs(d2d::util::clo::manager& pOptMan)
+  {
+    auto numjobs = pOptMan.get_string_option_value("JOBS");
+    auto value = std::size_t {0};
+    if (numjobs.empty())
+      return d2d::util::parallel::get_num_threads();
+    if (!d2d::util::parse::parse_count(numjobs, value))
+      throw std::runtime_error("invalid value of --jobs");
+    return value;
+  }
+
+  // Runs pConvert(job) for all the jobs on pNumWorkers workers. The threads
+  // are shared among the workers, that is, each conversion runs with
+  // (number of threads) / pNumWorkers threads.
+  template<typename function_type>
+  summary run(std::vector<job> const& pJobs, std::size_t pNumWorkers, function_type pConvert)
+  {
+    pNumWorkers = std::max<std::size_t>(1, std::min(pNumWorkers, pJobs.size()));
+    auto numthreads = d2d::util::parallel::get_num_threads();
+    d2d::util::parallel::set_num_threads(std::max<std::size_t>(1, numthreads / pNumWorkers));
+
+    auto result = summary {};
+    std::mutex mutex;
+    auto start = std::chrono::steady_clock::now();
+    {
+      d2d::util::thread_pool pool {pNumWorkers};
+      for (auto const& jj : pJobs) {
+        pool.submit([&] {
+            auto failure = std::string {};
+            try {
+              pConvert(jj);
+            } catch (std::exception const& ee) {
+              failure = ee.what();
+            }
+            auto inbytes = get_file_size(jj.input);
+            auto outbytes = failure.empty() ? get_file_size(jj.output) : 0;
+            std::lock_guard<std::mutex> lock {mutex};
+            if (failure.empty()) {
+              ++result.numsucceeded;
+              result.inbytes += inbytes;
+              result.outbytes += outbytes;
+            } else {
+              ++result.numfailed;
+              std::cerr << "Error: " << jj.input << ": " << failure << std::endl;
+            }
+          });
+      }
+      pool.wait();
+    }
+    result.seconds = std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - start).count();
+    d2d::util::parallel::set_num_threads(numthreads);
+    return result;
+  }
+
+  inline void print_summary(summary const& pSummary)
+  {
+    auto numfiles = pSummary.numsucceeded + pSummary.numfailed;
+    auto mib = 1024.0 * 1024.0;
+    std::cout
+      << "Converted " << pSummary.numsucceeded << " of " << numfiles << " files";
+    if (pSummary.numfailed > 0)
+      std::cout << " (" << pSummary.numfailed << " failed)";
+    std::cout
+      << " in " << pSummary.seconds << " s; read "
+      << pSummary.inbytes / mib << " MiB, wrote " << pSummary.outbytes / mib << " MiB";
+    if (pSummary.seconds > 0)
+      std::cout
+        << " (" << numfiles / pSummary.seconds << " files/s, "
+        << pSummary.inbytes / mib / pSummary.seconds << " MiB/s in, "
+        << pSummary.outbytes / mib / pSummary.seconds << " MiB/s out)";
+    std::cout << std::endl;
+  }
+}}}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+namespace d2d { namespace util {
+
+  // A queue of at most a fixed number of items between a producing and a
+  // consuming thread. push() blocks while the queue is full and pop() while
+  // it is empty, so a fast producer is held back by a slow consumer. The
+  // producer ends the queue with finish(), optionally with an exception,
+  // which pop() rethrows; either side may cancel() it to stop the other.
+  template<typename value_type>
+  class bounded_queue {
+  public:
+
+    bounded_queue(std::size_t pCapacity) :
+      mCapacity(pCapacity == 0 ? 1 : pCapacity)
+    {}
+
+    bounded_queue(bounded_queue const&) = delete;
+    bounded_queue& operator=(bounded_queue const&) = delete;
+
+    // Returns false if the queue has been cancelled
+    bool push(value_type pValue)
+    {
+      std::unique_lock<std::mutex> lock {mMutex};
+      mSpaceAvailable.wait(lock, [this] { return mCancelled || mValues.size() < mCapacity; });
+      if (mCancelled)
+        return false;
+      mValues.push_back(std::move(pValue));
+      lock.unlock();
+      mValueAvailable.notify_one();
+      return true;
+    }
+
+    // Returns false at the end of the queue or if it has been cancelled.
+    // Rethrows the exception the queue was finished with.
+    bool pop(value_type& pValue)
+    {
+      std::unique_lock<std::mutex> lock {mMutex};
+      mValueAvailable.wait(lock, [this] { return mCancelled || mFinished || !mValues.empty(); });
+      if (mCancelled)
+        return false;
+      if (mValues.empty()) {
+        if (mError)
+          std::rethrow_exception(mError);
+        return false;
+      }
+      pValue = std::move(mValues.front());
+      mValues.pop_front();
+      lock.unlock();
+      mSpaceAvailable.notify_one();
+      return true;
+    }
+
+    // Called by the producer at the end, with the exception if it failed
+    // (the items still queued are dropped then)
+    void finish(std::exception_ptr pError = nullptr)
+    {
+      {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mFinished = true;
+        mError = pError;
+        if (mError)
+          mValues.clear();
+      }
+      mValueAvailable.notify_all();
+    }
+
+    void cancel()
+    {
+      {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mCancelled = true;
+        mValues.clear();
+      }
+      mSpaceAvailable.notify_all();
+      mValueAvailable.notify_all();
+    }
+
+  private:
+    std::size_t mCapacity;
+    std::deque<value_type> mValues;
+    bool mFinished = false;
+    bool mCancelled = false;
+    std::exception_ptr mError;
+    std::mutex mMutex;
+    std::condition_variable mValueAvailable;
+    std::condition_variable mSpaceAvailable;
+  };
+}}
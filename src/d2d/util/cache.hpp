@@ -0,0 +1,447 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "d2d/util/clo.hpp"
+#include "d2d/util/mapped_file.hpp"
+#include "d2d/util/xxhash.hpp"
+
+// Incremental conversion (--incremental, --cache-dir). Each output gets a
+// sidecar file <output>.d2dcache which records the hash of the conversion
+// options, the size, modification time and hash of the input and of the
+// files written. A conversion is skipped if the sidecar matches:
+//
+// - input size and time unchanged: nothing is hashed at all;
+// - input touched but its hash unchanged: the sidecar is updated.
+//
+// The outputs must be unchanged as well: those whose size or time differ
+// from the record are hashed. With a cache directory the outputs are also
+// copied there under the hash of the options, the input and the output
+// name. Outputs found there (and matching their hashes) are copied instead
+// of converted again, e.g., for inputs which were moved or which are
+// duplicates. The cache never shares a file with the outputs, since a later
+// run without --incremental overwrites the outputs in place; the copies are
+// reflinks where the file system supports them.
+
+namespace d2d { namespace util { namespace cache {
+
+  // Changes whenever the same input and options may give different output
+  constexpr char const* formatVersion = "d2d-cache 2";
+
+  // The options which do not change the output
+  inline std::vector<std::string> get_ignored_option_ids()
+  {
+    return {"INPUT_FILE", "OUTPUT_FILE", "BATCH", "GLOB", "OUTDIR", "WATCH", "STATUS_FILE",
+            "JOBS", "THREADS", "PROFILE", "PROFILE_JSON", "INCREMENTAL", "CACHE_DIR"};
+  }
+
+  struct file_stamp {
+    uint64_t size = 0;
+    // Nanoseconds
+    int64_t mtime = 0;
+
+    bool operator==(file_stamp const& pOther) const
+    {
+      return size == pOther.size && mtime == pOther.mtime;
+    }
+  };
+
+  inline bool get_file_stamp(std::string const& pPath, file_stamp& pStamp)
+  {
+    struct stat filestat;
+    if (::stat(pPath.c_str(), &filestat) != 0)
+      return false;
+    pStamp.size = (uint64_t) filestat.st_size;
+    pStamp.mtime = (int64_t) filestat.st_mtim.tv_sec * 1000000000 + filestat.st_mtim.tv_nsec;
+    return true;
+  }
+
+  // The hash of the contents of a file (see xxhash64_blocks())
+  inline uint64_t hash_file(std::string const& pPath)
+  {
+    auto file = d2d::util::mapped_file {pPath, false};
+    return d2d::util::xxhash64_blocks(file.data(), file.size());
+  }
+
+  inline std::string to_hex(uint64_t pValue)
+  {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016" PRIx64, pValue);
+    return buffer;
+  }
+
+  // The directory of a path including the trailing slash (empty for the
+  // working directory) and the name of the file
+  inline std::string get_directory(std::string const& pPath)
+  {
+    auto slash = pPath.find_last_of('/');
+    return slash == std::string::npos ? std::string {} : pPath.substr(0, slash + 1);
+  }
+
+  inline std::string get_file_name(std::string const& pPath)
+  {
+    auto slash = pPath.find_last_of('/');
+    return slash == std::string::npos ? pPath : pPath.substr(slash + 1);
+  }
+
+  // A file written by a conversion
+  struct output_file {
+    // Without directory
+    std::string name;
+    file_stamp stamp;
+    uint64_t hash = 0;
+  };
+
+  // The contents of a sidecar file
+  struct record {
+    uint64_t options = 0;
+    file_stamp input;
+    uint64_t inputhash = 0;
+    std::vector<output_file> outputs;
+  };
+
+  inline bool read_record(std::string const& pPath, record& pRecord)
+  {
+    auto file = std::ifstream {pPath};
+    auto line = std::string {};
+    if (!std::getline(file, line) || line != formatVersion)
+      return false;
+    pRecord = record {};
+    auto hasinput = false;
+    while (std::getline(file, line)) {
+      auto stream = std::istringstream {line};
+      auto tag = std::string {};
+      stream >> tag;
+      if (tag == "options") {
+        stream >> std::hex >> pRecord.options;
+      } else if (tag == "input") {
+        stream >> pRecord.input.size >> pRecord.input.mtime >> std::hex >> pRecord.inputhash;
+        hasinput = true;
+      } else if (tag == "output") {
+        auto output = output_file {};
+        stream >> output.stamp.size >> output.stamp.mtime >> std::hex >> output.hash;
+        stream.get();
+        std::getline(stream, output.name);
+        if (output.name.empty())
+          return false;
+        pRecord.outputs.push_back(std::move(output));
+      }
+      if (!stream && !stream.eof())
+        return false;
+    }
+    return hasinput && !pRecord.outputs.empty();
+  }
+
+  // Writes a temporary file first, such that readers never see a partial
+  // record
+  inline void write_record(std::string const& pPath, record const& pRecord)
+  {
+    auto tmppath = pPath + ".tmp";
+    {
+      auto file = std::ofstream {tmppath};
+      file << formatVersion << "\n"
+           << "options " << to_hex(pRecord.options) << "\n"
+           << "input " << pRecord.input.size << " " << pRecord.input.mtime << " "
+           << to_hex(pRecord.inputhash) << "\n";
+      for (auto const& output : pRecord.outputs)
+        file << "output " << output.stamp.size << " " << output.stamp.mtime << " "
+             << to_hex(output.hash) << " " << output.name << "\n";
+      if (!file)
+        throw std::runtime_error("Could not write " + tmppath);
+    }
+    if (std::rename(tmppath.c_str(), pPath.c_str()) != 0)
+      throw std::runtime_error("Could not write " + pPath);
+  }
+
+  // Whether the files of pRecord are in pDirectory with the recorded
+  // contents. With pTrustStamps, a file whose size and time match the record
+  // is not hashed.
+  inline bool
+  has_outputs(std::string const& pDirectory, record const& pRecord, bool pTrustStamps)
+  {
+    for (auto const& output : pRecord.outputs) {
+      auto path = pDirectory + output.name;
+      auto stamp = file_stamp {};
+      if (!get_file_stamp(path, stamp) || stamp.size != output.stamp.size)
+        return false;
+      if (pTrustStamps && stamp == output.stamp)
+        continue;
+      try {
+        if (hash_file(path) != output.hash)
+          return false;
+      } catch (std::exception const&) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Copies pFrom to pTo through a temporary file, such that pTo is replaced
+  // rather than overwritten in place. Clones pFrom instead (copy-on-write)
+  // where the file system supports it.
+  inline void copy_file(std::string const& pFrom, std::string const& pTo)
+  {
+    auto tmppath = pTo + ".tmp";
+    auto copied = false;
+#ifdef FICLONE
+    auto in = ::open(pFrom.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in >= 0) {
+      auto out = ::open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+      if (out >= 0) {
+        copied = ::ioctl(out, FICLONE, in) == 0;
+        ::close(out);
+      }
+      ::close(in);
+    }
+#endif
+    if (!copied) {
+      auto in = std::ifstream {pFrom, std::ios::binary};
+      auto out = std::ofstream {tmppath, std::ios::binary | std::ios::trunc};
+      // An empty file sets failbit on the output stream
+      if (in.peek() != std::ifstream::traits_type::eof())
+        out << in.rdbuf();
+      out.close();
+      if (!in || !out) {
+        ::unlink(tmppath.c_str());
+        throw std::runtime_error("Could not copy " + pFrom + " to " + pTo);
+      }
+    }
+    if (std::rename(tmppath.c_str(), pTo.c_str()) != 0) {
+      ::unlink(tmppath.c_str());
+      throw std::runtime_error("Could not write " + pTo);
+    }
+  }
+
+  class incremental {
+  public:
+    // pOptions: the hash of the options (see get_options_hash()). An empty
+    // pCacheDir means no cache directory.
+    incremental(uint64_t pOptions, std::string pCacheDir) :
+      mOptions(pOptions),
+      mCacheDir(pCacheDir)
+    {
+      if (!mCacheDir.empty() && mCacheDir.back() != '/')
+        mCacheDir += '/';
+      if (!mCacheDir.empty() && ::mkdir(mCacheDir.c_str(), 0777) != 0 && errno != EEXIST)
+        throw std::runtime_error("Could not create the cache directory " + mCacheDir);
+    }
+
+    // Calls pConvert() unless the outputs for pInput are up to date.
+    // pCandidates are the files pConvert() may write for pOutput. Returns
+    // false if the conversion was skipped.
+    template<typename function_type>
+    bool run
+    (std::string const& pInput, std::string const& pOutput,
+     std::vector<std::string> const& pCandidates, bool pVerbose,
+     function_type pConvert)
+    {
+      auto current = record {};
+      current.options = mOptions;
+      if (!get_file_stamp(pInput, current.input)) {
+        // Not readable; let the conversion report it
+        pConvert();
+        return true;
+      }
+      auto sidecar = get_sidecar_name(pOutput);
+      auto directory = get_directory(pOutput);
+      auto previous = record {};
+      auto hasprevious = read_record(sidecar, previous) && previous.options == mOptions &&
+        has_outputs(directory, previous, true);
+      if (hasprevious && previous.input == current.input) {
+        ++mNumUpToDate;
+        if (pVerbose)
+          std::cout << "Skipping " << pInput << " (up to date)" << std::endl;
+        return false;
+      }
+      current.inputhash = hash_file(pInput);
+      current.outputs = previous.outputs;
+      if (hasprevious && previous.inputhash == current.inputhash &&
+          update_output_stamps(directory, current)) {
+        write_record(sidecar, current);
+        ++mNumUpToDate;
+        if (pVerbose)
+          std::cout << "Skipping " << pInput << " (unchanged)" << std::endl;
+        return false;
+      }
+      current.outputs.clear();
+      auto entry = get_entry_name(current.inputhash, pOutput);
+      auto cached = record {};
+      auto hascached = !mCacheDir.empty() && read_record(entry + "record", cached);
+      if (hascached && !has_outputs(entry, cached, false)) {
+        // Damaged; the conversion adds it again
+        remove_entry(entry, cached);
+        hascached = false;
+      }
+      if (hascached) {
+        ::unlink(sidecar.c_str());
+        for (auto const& output : cached.outputs)
+          copy_file(entry + output.name, directory + output.name);
+        current.outputs = cached.outputs;
+        if (update_output_stamps(directory, current)) {
+          write_record(sidecar, current);
+          ++mNumUpToDate;
+          ++mNumCopied;
+          if (pVerbose)
+            std::cout << "Copied " << pOutput << " from the cache" << std::endl;
+          return false;
+        }
+        current.outputs.clear();
+      }
+
+      // Outputs of an earlier conversion which this one does not write
+      // again must not be recorded
+      ::unlink(sidecar.c_str());
+      for (auto const& candidate : pCandidates)
+        ::unlink(candidate.c_str());
+      pConvert();
+      for (auto const& candidate : pCandidates) {
+        auto output = output_file {};
+        output.name = get_file_name(candidate);
+        if (get_file_stamp(candidate, output.stamp)) {
+          output.hash = hash_file(candidate);
+          current.outputs.push_back(std::move(output));
+        }
+      }
+      if (current.outputs.empty())
+        return true;
+      write_record(sidecar, current);
+      if (!mCacheDir.empty())
+        add_entry(entry, directory, current);
+      return true;
+    }
+
+    std::size_t get_num_up_to_date() const { return mNumUpToDate; }
+    std::size_t get_num_copied() const { return mNumCopied; }
+
+    static std::string get_sidecar_name(std::string const& pOutput)
+    {
+      return pOutput + ".d2dcache";
+    }
+
+  private:
+    // Records the current size and time of the outputs of pRecord, which are
+    // in pDirectory; returns false if one is missing
+    static bool update_output_stamps(std::string const& pDirectory, record& pRecord)
+    {
+      for (auto& output : pRecord.outputs)
+        if (!get_file_stamp(pDirectory + output.name, output.stamp))
+          return false;
+      return true;
+    }
+
+    // The directory of the cache entry. The output name is part of the key,
+    // since index files refer to their pieces by name.
+    std::string get_entry_name(uint64_t pInputHash, std::string const& pOutput) const
+    {
+      uint64_t key[2] = {mOptions, pInputHash};
+      auto name = get_file_name(pOutput);
+      auto hash = d2d::util::xxhash64(name.data(), name.size(),
+                                      d2d::util::xxhash64(key, sizeof(key)));
+      return mCacheDir + to_hex(hash) + "/";
+    }
+
+    // Copies the outputs into a temporary directory which is then renamed,
+    // such that concurrent conversions never see a partial entry. The copies
+    // are checked against the hashes of pRecord when the entry is used.
+    void add_entry
+    (std::string const& pEntry, std::string const& pDirectory, record const& pRecord) const
+    {
+      auto entrypath = pEntry.substr(0, pEntry.size() - 1);
+      auto tmppath = entrypath + ".tmp" +
+        to_hex(std::hash<std::thread::id> {}(std::this_thread::get_id()) ^
+               (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count());
+      if (::mkdir(tmppath.c_str(), 0777) != 0)
+        return;
+      try {
+        for (auto const& output : pRecord.outputs)
+          copy_file(pDirectory + output.name, tmppath + "/" + output.name);
+        write_record(tmppath + "/record", pRecord);
+      } catch (std::exception const&) {
+        // The cache is an optimization only
+      }
+      if (std::rename(tmppath.c_str(), entrypath.c_str()) != 0) {
+        // Another conversion added the entry first
+        remove_entry(tmppath + "/", pRecord);
+      }
+    }
+
+    static void remove_entry(std::string const& pEntry, record const& pRecord)
+    {
+      // The record first, such that no one uses the entry meanwhile
+      ::unlink((pEntry + "record").c_str());
+      for (auto const& output : pRecord.outputs)
+        ::unlink((pEntry + output.name).c_str());
+      ::rmdir(pEntry.c_str());
+    }
+
+    uint64_t mOptions;
+    std::string mCacheDir;
+    std::atomic<std::size_t> mNumUpToDate {0};
+    std::atomic<std::size_t> mNumCopied {0};
+  };
+
+  // The hash of the options which affect the output of pTool
+  inline uint64_t
+  get_options_hash(d2d::util::clo::manager& pOptMan, std::string const& pTool)
+  {
+    auto str = std::string {formatVersion} + "\n" + pTool + "\n" +
+      pOptMan.get_values_str(get_ignored_option_ids());
+    return d2d::util::xxhash64(str.data(), str.size());
+  }
+
+  inline void add_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    pOptMan.addCmlParam(d2d::util::clo::bool_option
+                        {"INCREMENTAL", {"--incremental"},
+                           "skips inputs whose outputs are up to date (as recorded in <output>.d2dcache)"});
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"CACHE_DIR", {"--cache-dir"},
+                           "keeps copies of the outputs in the given directory and copies them instead of"
+                           " converting identical inputs again (implies --incremental)"});
+  }
+
+  // Null unless incremental conversion was requested
+  inline std::unique_ptr<incremental>
+  read_cml_params(d2d::util::clo::manager& pOptMan, std::string const& pTool)
+  {
+    auto cachedir = pOptMan.get_string_option_value("CACHE_DIR");
+    if (!pOptMan.get_bool_option_value("INCREMENTAL") && cachedir.empty())
+      return nullptr;
+    return std::unique_ptr<incremental>
+      {new incremental {get_options_hash(pOptMan, pTool), cachedir}};
+  }
+
+  // Prints how many conversions were skipped
+  inline void print_summary(incremental const& pCache)
+  {
+    std::cout << pCache.get_num_up_to_date() << " file(s) up to date";
+    if (pCache.get_num_copied() > 0)
+      std::cout << " (" << pCache.get_num_copied() << " copied from the cache)";
+    std::cout << std::endl;
+  }
+}}}
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -44,7 +45,7 @@ namespace d2d { namespace util { namespace clo {
       i_option(pIdStr, pStrings, pHelpStr),
       mNecessary(pNecessary) {}
     //private:
-    bool mNecessary;
+    bool mNecessary = false;
     std::string value;
   };
 
@@ -150,6 +151,29 @@ namespace d2d { namespace util { namespace clo {
       return "";
     }
 
+    // The values of all options but the ones of pIgnoredIds as "ID=value"
+    // lines sorted by ID (booleans as 0 or 1)
+    std::string get_values_str(std::vector<std::string> const& pIgnoredIds = {}) {
+      std::vector<std::string> lines;
+      auto ignored = [&](std::string const& pIdStr) {
+        for (auto& id : pIgnoredIds)
+          if (id == pIdStr)
+            return true;
+        return false;
+      };
+      for (auto& bom : mBoolOpts)
+        if (!ignored(bom.first))
+          lines.push_back(bom.first + "=" + (bom.second.value ? "1" : "0"));
+      for (auto& som : mStrOpts)
+        if (!ignored(som.first))
+          lines.push_back(som.first + "=" + som.second.value);
+      std::sort(lines.begin(), lines.end());
+      std::string result;
+      for (auto& line : lines)
+        result += line + "\n";
+      return result;
+    }
+
     std::string get_usage_msg() {
       std::stringstream msg;
       msg << "Usage: " << mArgv[0] << " [options]";
@@ -0,0 +1,579 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef D2D_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef D2D_WITH_LZMA
+#include <lzma.h>
+#endif
+#ifdef D2D_WITH_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
+#include "d2d/util/bounded_queue.hpp"
+#include "d2d/util/mapped_file.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/stdio.hpp"
+
+// Compressed inputs. gzip, xz and zstd data are recognized by their magic
+// bytes, whatever the name of the file. Each codec is available if d2d is
+// built with it (D2D_WITH_ZLIB, D2D_WITH_LZMA, D2D_WITH_ZSTD).
+// The data is decoded by a thread of its own into a bounded queue of blocks,
+// from which the reader takes its input, hence decoding and parsing overlap
+// and only a few blocks of decoded data are held in memory. The independent
+// frames of a zstd file (e.g., as written by pzstd or by concatenation) are
+// decoded in parallel.
+
+namespace d2d { namespace util { namespace decompress {
+
+  enum class format {none, gzip, xz, zstd};
+
+  inline std::string get_name(format pFormat)
+  {
+    switch (pFormat) {
+    case format::gzip:
+      return "gzip";
+    case format::xz:
+      return "xz";
+    case format::zstd:
+      return "zstd";
+    default:
+      return "uncompressed";
+    }
+  }
+
+  // The number of bytes detect() needs
+  constexpr std::size_t magicSize = 6;
+
+  inline format detect(char const* pData, std::size_t pSize)
+  {
+    auto matches = [&](std::initializer_list<unsigned char> pMagic) {
+      return pSize >= pMagic.size() &&
+        std::equal(pMagic.begin(), pMagic.end(), reinterpret_cast<unsigned char const*>(pData));
+    };
+    if (matches({0x1f, 0x8b}))
+      return format::gzip;
+    if (matches({0xfd, '7', 'z', 'X', 'Z', 0x00}))
+      return format::xz;
+    if (matches({0x28, 0xb5, 0x2f, 0xfd}))
+      return format::zstd;
+    return format::none;
+  }
+
+  inline bool is_compressed_file(std::string const& pFilePath)
+  {
+    char magic[magicSize];
+    auto file = std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+      {std::fopen(pFilePath.c_str(), "rb"), &std::fclose};
+    return file && detect(magic, std::fread(magic, 1, sizeof(magic), file.get())) != format::none;
+  }
+
+  // Decodes a file (which is mapped) or stdin (whose first bytes, read for
+  // the detection of the format, are passed as pPrefix) in a thread of its
+  // own. read() returns the decoded data in order.
+  class decoder {
+  public:
+
+    // The size of the decoded blocks and the number of them which may wait
+    // in the queue
+    static constexpr std::size_t blockSize = 1 << 20;
+    static constexpr std::size_t numBlocks = 4;
+
+    decoder(std::string const& pFilePath, format pFormat) :
+      mName(pFilePath),
+      mFormat(pFormat),
+      mFile(new mapped_file {pFilePath, false}),
+      mQueue(numBlocks)
+    {
+      start();
+    }
+
+    decoder(int pFd, std::string pPrefix, format pFormat) :
+      mName("stdin"),
+      mFormat(pFormat),
+      mFd(pFd),
+      mPrefix(std::move(pPrefix)),
+      mQueue(numBlocks)
+    {
+      start();
+    }
+
+    decoder(decoder const&) = delete;
+    decoder& operator=(decoder const&) = delete;
+
+    ~decoder()
+    {
+      mQueue.cancel();
+      mThread.join();
+    }
+
+    // Copies up to pSize decoded bytes to pBuffer; returns 0 at the end
+    std::size_t read(char* pBuffer, std::size_t pSize)
+    {
+      while (mPosition == mBlock.size()) {
+        mPosition = 0;
+        if (!mQueue.pop(mBlock)) {
+          mBlock.clear();
+          return 0;
+        }
+      }
+      auto count = std::min(pSize, mBlock.size() - mPosition);
+      std::memcpy(pBuffer, mBlock.data() + mPosition, count);
+      mPosition += count;
+      return count;
+    }
+
+  private:
+    void start()
+    {
+      check_support();
+      mThread = std::thread([this] {
+          try {
+            d2d::util::profile::phase phase {"decompress"};
+            decode();
+            phase.set_bytes(mNumInputBytes);
+            mQueue.finish();
+          } catch (...) {
+            mQueue.finish(std::current_exception());
+          }
+        });
+    }
+
+    void check_support() const
+    {
+      auto macro = std::string {};
+#ifndef D2D_WITH_ZLIB
+      if (mFormat == format::gzip)
+        macro = "D2D_WITH_ZLIB";
+#endif
+#ifndef D2D_WITH_LZMA
+      if (mFormat == format::xz)
+        macro = "D2D_WITH_LZMA";
+#endif
+#ifndef D2D_WITH_ZSTD
+      if (mFormat == format::zstd)
+        macro = "D2D_WITH_ZSTD";
+#endif
+      if (!macro.empty())
+        throw std::runtime_error
+          (mName + " is " + get_name(mFormat) + " compressed, but d2d was built without " +
+           get_name(mFormat) + " support (" + macro + ")");
+    }
+
+    // Makes the next part of the compressed data available in pData and
+    // pSize; returns false at the end. The parts of a mapped file are
+    // limited in size for the codecs with 32 bit counters.
+    bool next_input(char const*& pData, std::size_t& pSize)
+    {
+      constexpr std::size_t maxPart = 1 << 26;
+      if (mFile) {
+        if (mNumInputBytes == mFile->size())
+          return false;
+        pData = mFile->data() + mNumInputBytes;
+        pSize = std::min(maxPart, mFile->size() - mNumInputBytes);
+      } else if (!mPrefix.empty()) {
+        mInput.assign(mPrefix.begin(), mPrefix.end());
+        mPrefix.clear();
+        pData = mInput.data();
+        pSize = mInput.size();
+      } else {
+        mInput.resize(blockSize);
+        pSize = d2d::util::stdio::read_some(mFd, mInput.data(), mInput.size());
+        if (pSize == 0)
+          return false;
+        pData = mInput.data();
+      }
+      mNumInputBytes += pSize;
+      return true;
+    }
+
+    // Hands a block to the reader; throws if the reader is gone, to stop
+    // decoding
+    void push(std::vector<char> pBlock)
+    {
+      if (!pBlock.empty() && !mQueue.push(std::move(pBlock)))
+        throw std::runtime_error("Decoding of " + mName + " cancelled");
+    }
+
+    // Hands the first pFilled bytes of pBlock to the reader and replaces it
+    // with an empty block
+    void emit(std::vector<char>& pBlock, std::size_t pFilled)
+    {
+      pBlock.resize(pFilled);
+      push(std::move(pBlock));
+      pBlock = std::vector<char> (blockSize);
+    }
+
+    std::runtime_error corrupt(std::string const& pDetail) const
+    {
+      return std::runtime_error
+        ("Corrupt " + get_name(mFormat) + " data in " + mName +
+         (pDetail.empty() ? "" : ": " + pDetail));
+    }
+
+    std::runtime_error truncated() const
+    {
+      return std::runtime_error(mName + " ends within " + get_name(mFormat) + " compressed data");
+    }
+
+    void decode()
+    {
+      switch (mFormat) {
+      case format::gzip:
+        decode_gzip();
+        break;
+      case format::xz:
+        decode_xz();
+        break;
+      case format::zstd:
+        if (mFile)
+          decode_zstd_frames();
+        else
+          decode_zstd();
+        break;
+      default:
+        break;
+      }
+    }
+
+    // All the decode functions feed the input part by part and hand out a
+    // block whenever it is full. The codec may still hold decoded data after
+    // filling a block, hence the next input is requested only if the last
+    // call did not fill the block.
+
+    void decode_gzip()
+    {
+#ifdef D2D_WITH_ZLIB
+      auto stream = z_stream {};
+      // 32: detect a gzip or zlib header
+      if (inflateInit2(&stream, 15 + 32) != Z_OK)
+        throw std::runtime_error("Could not initialize zlib");
+      auto guard = std::unique_ptr<z_stream, int (*)(z_stream*)> {&stream, &inflateEnd};
+      auto block = std::vector<char> (blockSize);
+      std::size_t filled = 0;
+      auto ended = false;
+      auto full = false;
+      while (true) {
+        if (stream.avail_in == 0 && !full) {
+          char const* data;
+          std::size_t size;
+          if (!next_input(data, size))
+            break;
+          stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+          stream.avail_in = (uInt) size;
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(block.data() + filled);
+        stream.avail_out = (uInt) (blockSize - filled);
+        auto ret = inflate(&stream, Z_NO_FLUSH);
+        filled = blockSize - stream.avail_out;
+        full = filled == blockSize;
+        if (ret == Z_STREAM_END) {
+          // Another member may follow (e.g., of concatenated files or pigz)
+          ended = true;
+          inflateReset(&stream);
+        } else if (ret == Z_OK) {
+          ended = false;
+        } else if (ret != Z_BUF_ERROR) {
+          throw corrupt(stream.msg != nullptr ? stream.msg : "");
+        }
+        if (full) {
+          emit(block, filled);
+          filled = 0;
+        }
+      }
+      if (!ended)
+        throw truncated();
+      emit(block, filled);
+#endif
+    }
+
+    void decode_xz()
+    {
+#ifdef D2D_WITH_LZMA
+      auto stream = lzma_stream LZMA_STREAM_INIT;
+      if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        throw std::runtime_error("Could not initialize liblzma");
+      auto guard = std::unique_ptr<lzma_stream, void (*)(lzma_stream*)> {&stream, &lzma_end};
+      auto block = std::vector<char> (blockSize);
+      std::size_t filled = 0;
+      auto action = LZMA_RUN;
+      auto full = false;
+      while (true) {
+        if (stream.avail_in == 0 && !full && action == LZMA_RUN) {
+          char const* data;
+          std::size_t size;
+          if (next_input(data, size)) {
+            stream.next_in = reinterpret_cast<uint8_t const*>(data);
+            stream.avail_in = size;
+          } else {
+            action = LZMA_FINISH;
+          }
+        }
+        stream.next_out = reinterpret_cast<uint8_t*>(block.data() + filled);
+        stream.avail_out = blockSize - filled;
+        auto ret = lzma_code(&stream, action);
+        filled = blockSize - stream.avail_out;
+        full = filled == blockSize;
+        if (full) {
+          emit(block, filled);
+          filled = 0;
+        }
+        if (ret == LZMA_STREAM_END)
+          break;
+        if (ret == LZMA_BUF_ERROR && action == LZMA_FINISH)
+          throw truncated();
+        if (ret != LZMA_OK)
+          throw corrupt(ret == LZMA_FORMAT_ERROR ? "not an xz stream" : "");
+      }
+      emit(block, filled);
+#endif
+    }
+
+    void decode_zstd()
+    {
+#ifdef D2D_WITH_ZSTD
+      auto context = std::unique_ptr<ZSTD_DCtx, std::size_t (*)(ZSTD_DCtx*)>
+        {ZSTD_createDCtx(), &ZSTD_freeDCtx};
+      if (!context)
+        throw std::runtime_error("Could not initialize zstd");
+      auto block = std::vector<char> (blockSize);
+      auto input = ZSTD_inBuffer {nullptr, 0, 0};
+      auto output = ZSTD_outBuffer {block.data(), blockSize, 0};
+      std::size_t hint = 0; // 0 at the end of a frame
+      auto full = false;
+      while (true) {
+        if (input.pos == input.size && !full) {
+          char const* data;
+          std::size_t size;
+          if (!next_input(data, size))
+            break;
+          input = ZSTD_inBuffer {data, size, 0};
+        }
+        hint = ZSTD_decompressStream(context.get(), &output, &input);
+        if (ZSTD_isError(hint))
+          throw corrupt(ZSTD_getErrorName(hint));
+        full = output.pos == output.size;
+        if (full) {
+          emit(block, output.pos);
+          output = ZSTD_outBuffer {block.data(), blockSize, 0};
+        }
+      }
+      if (hint != 0)
+        throw truncated();
+      emit(block, output.pos);
+#endif
+    }
+
+    // Splits the mapped file into its frames and decodes as many of them in
+    // parallel as there are threads. A file of a single frame is decoded as
+    // a stream instead. Worker k decodes the frames k, k + n, k + 2n, ...
+    // into blocks which it passes on through a bounded queue of its own,
+    // each frame ended by an empty block; the blocks are handed to the
+    // reader in the order of the frames. Hence at most numBlocks + 1 blocks
+    // per worker are in memory, whatever the size of the frames.
+    void decode_zstd_frames()
+    {
+#ifdef D2D_WITH_ZSTD
+      auto frames = std::vector<std::pair<char const*, std::size_t> > {};
+      for (std::size_t offset = 0; offset < mFile->size(); ) {
+        auto size = ZSTD_findFrameCompressedSize
+          (mFile->data() + offset, mFile->size() - offset);
+        if (ZSTD_isError(size)) {
+          if (ZSTD_getErrorCode(size) == ZSTD_error_srcSize_wrong)
+            throw truncated();
+          throw corrupt(ZSTD_getErrorName(size));
+        }
+        frames.emplace_back(mFile->data() + offset, size);
+        offset += size;
+      }
+      if (frames.size() <= 1) {
+        decode_zstd();
+        return;
+      }
+      mNumInputBytes = mFile->size();
+      auto numworkers = std::min(d2d::util::parallel::get_num_threads(), frames.size());
+      auto queues = std::vector<std::unique_ptr<bounded_queue<std::vector<char> > > > {};
+      for (std::size_t idx = 0; idx < numworkers; ++idx)
+        queues.emplace_back(new bounded_queue<std::vector<char> > {numBlocks});
+      auto workers = std::vector<std::thread> {};
+      // Stops and joins the workers however this function is left
+      auto stop = [&] {
+        for (auto& queue : queues)
+          queue->cancel();
+        for (auto& worker : workers)
+          worker.join();
+      };
+      try {
+        for (std::size_t idx = 0; idx < numworkers; ++idx)
+          workers.emplace_back([&, idx] {
+              auto& queue = *queues[idx];
+              try {
+                for (auto frame = idx; frame < frames.size(); frame += numworkers)
+                  if (!decode_zstd_frame(frames[frame].first, frames[frame].second, queue))
+                    return;
+                queue.finish();
+              } catch (...) {
+                queue.finish(std::current_exception());
+              }
+            });
+        for (std::size_t frame = 0; frame < frames.size(); ++frame) {
+          auto& queue = *queues[frame % numworkers];
+          auto block = std::vector<char> {};
+          while (queue.pop(block) && !block.empty())
+            push(std::move(block));
+        }
+      } catch (...) {
+        stop();
+        throw;
+      }
+      stop();
+#endif
+    }
+
+#ifdef D2D_WITH_ZSTD
+    // Decodes a frame into blocks of blockSize bytes, which it pushes to
+    // pQueue followed by an empty block. Returns false if pQueue has been
+    // cancelled.
+    bool decode_zstd_frame
+    (char const* pData, std::size_t pSize, bounded_queue<std::vector<char> >& pQueue) const
+    {
+      auto context = std::unique_ptr<ZSTD_DCtx, std::size_t (*)(ZSTD_DCtx*)>
+        {ZSTD_createDCtx(), &ZSTD_freeDCtx};
+      if (!context)
+        throw std::runtime_error("Could not initialize zstd");
+      auto block = std::vector<char> (blockSize);
+      auto input = ZSTD_inBuffer {pData, pSize, 0};
+      auto output = ZSTD_outBuffer {block.data(), blockSize, 0};
+      while (true) {
+        auto hint = ZSTD_decompressStream(context.get(), &output, &input);
+        if (ZSTD_isError(hint))
+          throw corrupt(ZSTD_getErrorName(hint));
+        auto full = output.pos == output.size;
+        if (full || (hint == 0 && output.pos > 0)) {
+          block.resize(output.pos);
+          if (!pQueue.push(std::move(block)))
+            return false;
+          block = std::vector<char> (blockSize);
+          output = ZSTD_outBuffer {block.data(), blockSize, 0};
+        }
+        if (hint == 0)
+          break;
+        if (!full && input.pos == input.size)
+          throw truncated();
+      }
+      return pQueue.push(std::vector<char> {});
+    }
+#endif
+
+    std::string mName;
+    format mFormat;
+    std::unique_ptr<mapped_file> mFile;
+    int mFd = -1;
+    std::string mPrefix;
+    std::vector<char> mInput;
+    uint64_t mNumInputBytes = 0;
+    // The decoded blocks on their way to the reader
+    bounded_queue<std::vector<char> > mQueue;
+    std::vector<char> mBlock;
+    std::size_t mPosition = 0;
+    // Started last, when all the other members are initialized
+    std::thread mThread;
+  };
+
+  // Reads a file, or stdin for "-", and decodes it if it is compressed
+  class reader {
+  public:
+
+    reader(std::string const& pFilePath)
+    {
+      if (d2d::util::stdio::is_stdio(pFilePath)) {
+        mFd = STDIN_FILENO;
+      } else {
+        mFd = ::open(pFilePath.c_str(), O_RDONLY);
+        if (mFd < 0)
+          throw std::runtime_error
+            ("Could not open " + pFilePath + ": " + std::strerror(errno));
+        mOwnsFd = true;
+      }
+      // The first bytes determine the format; for stdin they cannot be read
+      // again and are handed on
+      mPrefix.resize(magicSize);
+      std::size_t filled = 0;
+      while (filled < magicSize) {
+        auto count = d2d::util::stdio::read_some(mFd, &mPrefix[filled], magicSize - filled);
+        if (count == 0)
+          break;
+        filled += count;
+      }
+      mPrefix.resize(filled);
+      mFormat = detect(mPrefix.data(), mPrefix.size());
+      if (mFormat == format::none)
+        return;
+      if (mOwnsFd) {
+        close();
+        mDecoder.reset(new decoder {pFilePath, mFormat});
+      } else {
+        mDecoder.reset(new decoder {mFd, std::move(mPrefix), mFormat});
+      }
+    }
+
+    reader(reader const&) = delete;
+    reader& operator=(reader const&) = delete;
+
+    ~reader()
+    {
+      close();
+    }
+
+    format get_format() const
+    {
+      return mFormat;
+    }
+
+    // Reads up to pSize (decoded) bytes; returns 0 at the end
+    std::size_t read(char* pBuffer, std::size_t pSize)
+    {
+      if (mDecoder)
+        return mDecoder->read(pBuffer, pSize);
+      if (mPosition < mPrefix.size()) {
+        auto count = std::min(pSize, mPrefix.size() - mPosition);
+        std::memcpy(pBuffer, mPrefix.data() + mPosition, count);
+        mPosition += count;
+        return count;
+      }
+      return d2d::util::stdio::read_some(mFd, pBuffer, pSize);
+    }
+
+  private:
+    void close()
+    {
+      if (mOwnsFd)
+        ::close(mFd);
+      mOwnsFd = false;
+    }
+
+    int mFd = -1;
+    bool mOwnsFd = false;
+    std::string mPrefix;
+    std::size_t mPosition = 0;
+    format mFormat = format::none;
+    std::unique_ptr<decoder> mDecoder;
+  };
+}}}
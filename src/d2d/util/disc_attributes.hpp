@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "d2d/util/adjacency.hpp"
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/simd.hpp"
+#include "d2d/util/utils.hpp"
+
+// Derivation of disc attributes (normals and radii) from a triangle mesh.
+// Every vertex of the mesh becomes a disc. The vertex to triangle adjacency
+// is built once by the caller and shared by all derivations.
+
+namespace d2d { namespace util {
+
+  template<typename numeric_type>
+  d2d::util::triple<numeric_type>
+  compute_average_normal
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+   d2d::util::array_view<d2d::util::triple<size_t> const> triangles,
+   d2d::util::array_view<size_t const> adjtriangles)
+  {
+    auto result = d2d::util::triple<numeric_type> {0, 0, 0};
+    for (auto const& tidx: adjtriangles) {
+      auto const& pidcs = triangles[tidx];
+      auto tridata =
+        d2d::util::triple<d2d::util::triple<numeric_type> >
+        {vertices[pidcs[0]], vertices[pidcs[1]], vertices[pidcs[2]]};
+      auto normal = d2d::util::compute_normal(tridata);
+      result = d2d::util::sum(result, normal);
+    }
+    d2d::util::normalize(result);
+    return result;
+  }
+
+  template<typename numeric_type>
+  numeric_type
+  compute_radius
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+   d2d::util::array_view<d2d::util::triple<size_t> const> triangles,
+   size_t pidx,
+   d2d::util::array_view<size_t const> adjtriangles)
+  {
+    auto result = (numeric_type) 0;
+    for (auto const& tidx: adjtriangles) {
+      auto const& pidcs = triangles[tidx];
+      auto tridata =
+        d2d::util::triple<d2d::util::triple<numeric_type> >
+        {vertices[pidcs[0]], vertices[pidcs[1]], vertices[pidcs[2]]};
+      auto centroid = d2d::util::get_centroid(tridata);
+      auto distance = d2d::util::distance(vertices[pidx], centroid);
+      if (result < distance)
+        result = distance;
+    }
+    return result;
+  }
+
+  template<typename numeric_type>
+  std::vector<d2d::util::triple<numeric_type> >
+  create_disc_normals_from_triangles
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+   d2d::util::array_view<d2d::util::triple<size_t> const> triangles,
+   d2d::util::vertex_triangle_adjacency const& p2tmap)
+  {
+    auto numvertices = vertices.size();
+    auto normals = std::vector<d2d::util::triple<numeric_type> > (numvertices);
+    for (size_t vidx = 0; vidx < numvertices; ++vidx) {
+      normals[vidx] = compute_average_normal
+        (vertices, triangles, p2tmap[vidx]);
+    }
+    return normals;
+  }
+
+  template<typename numeric_type>
+  std::vector<numeric_type>
+  create_disc_radii_from_triangles
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+   d2d::util::array_view<d2d::util::triple<size_t> const> triangles,
+   d2d::util::vertex_triangle_adjacency const& p2tmap)
+  {
+    auto numvertices = vertices.size();
+    auto radii = std::vector<numeric_type> (numvertices);
+    for (size_t vidx = 0; vidx < numvertices; ++vidx) {
+      radii[vidx] = compute_radius(vertices, triangles, vidx, p2tmap[vidx]);
+    }
+    return radii;
+  }
+
+  template<typename numeric_type>
+  struct disc_attributes {
+    std::vector<d2d::util::triple<numeric_type> > normals;
+    std::vector<numeric_type> radii;
+  };
+
+  // Computes the normals and the radii of all discs in one pass. The normal
+  // and the centroid of each triangle are computed once (instead of once per
+  // adjacent vertex and attribute) by the vectorized batch kernels; the
+  // vertices are then processed in parallel. Each vertex accumulates its
+  // adjacent triangles in the order of the adjacency, hence the results are
+  // bit-identical to the ones of create_disc_normals_from_triangles() and
+  // create_disc_radii_from_triangles() regardless of the number of threads.
+  template<typename numeric_type>
+  disc_attributes<numeric_type>
+  create_disc_attributes_from_triangles
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> vertices,
+   d2d::util::array_view<d2d::util::triple<size_t> const> triangles,
+   d2d::util::vertex_triangle_adjacency const& p2tmap)
+  {
+    namespace parallel = d2d::util::parallel;
+    d2d::util::profile::phase phase {"disc attributes"};
+    phase.set_items(vertices.size());
+    size_t const blockSize = 256;
+    auto numvertices = vertices.size();
+    auto numtriangles = triangles.size();
+    auto trinormals = std::vector<d2d::util::triple<numeric_type> > (numtriangles);
+    auto centroids = std::vector<d2d::util::triple<numeric_type> > (numtriangles);
+    parallel::for_each_range(numtriangles, [&](size_t pBegin, size_t pEnd) {
+        // The corners of a block of triangles are gathered into
+        // structure-of-arrays buffers for the batch kernels.
+        auto buffer = std::vector<numeric_type> (15 * blockSize);
+        auto soa = [&](size_t pIdx) {
+          auto base = buffer.data() + 3 * pIdx * blockSize;
+          return d2d::util::simd::soa<numeric_type>
+            {base, base + blockSize, base + 2 * blockSize};
+        };
+        auto corners = d2d::util::triple<d2d::util::simd::soa<numeric_type> >
+          {soa(0), soa(1), soa(2)};
+        auto normals = soa(3);
+        auto centers = soa(4);
+        for (auto first = pBegin; first < pEnd; first += blockSize) {
+          auto count = std::min(blockSize, pEnd - first);
+          for (size_t idx = 0; idx < count; ++idx) {
+            auto const& pidcs = triangles[first + idx];
+            for (size_t cidx = 0; cidx < 3; ++cidx) {
+              auto const& vertex = vertices[pidcs[cidx]];
+              corners[cidx].x[idx] = vertex[0];
+              corners[cidx].y[idx] = vertex[1];
+              corners[cidx].z[idx] = vertex[2];
+            }
+          }
+          d2d::util::simd::batch_compute_normal<numeric_type>
+            (corners[0], corners[1], corners[2], normals, count);
+          d2d::util::simd::batch_get_centroid<numeric_type>
+            (corners[0], corners[1], corners[2], centers, count);
+          for (size_t idx = 0; idx < count; ++idx) {
+            trinormals[first + idx] = d2d::util::triple<numeric_type>
+              {normals.x[idx], normals.y[idx], normals.z[idx]};
+            centroids[first + idx] = d2d::util::triple<numeric_type>
+              {centers.x[idx], centers.y[idx], centers.z[idx]};
+          }
+        }
+      });
+
+    auto result = disc_attributes<numeric_type> {};
+    result.normals.resize(numvertices);
+    result.radii.resize(numvertices);
+    parallel::for_each_range(numvertices, [&](size_t pBegin, size_t pEnd) {
+        for (auto vidx = pBegin; vidx < pEnd; ++vidx) {
+          auto normal = d2d::util::triple<numeric_type> {0, 0, 0};
+          auto radius = (numeric_type) 0;
+          for (auto const& tidx : p2tmap[vidx]) {
+            normal = d2d::util::sum(normal, trinormals[tidx]);
+            auto distance = d2d::util::distance(vertices[vidx], centroids[tidx]);
+            if (radius < distance)
+              radius = distance;
+          }
+          d2d::util::normalize(normal);
+          result.normals[vidx] = normal;
+          result.radii[vidx] = radius;
+        }
+      });
+    return result;
+  }
+}}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/morton.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/radix_sort.hpp"
+#include "d2d/util/utils.hpp"
+
+// Levels of detail of disc surfaces. The discs are sorted along a Morton
+// (Z-order) curve once; the discs in one cell of an octree level are then
+// contiguous. A level merges the discs of each cell into one disc: its
+// position and normal are the averages weighted by the areas of the discs,
+// its area is the sum of their areas. Everything but the sort is a linear
+// scan, and all steps run in parallel.
+
+namespace d2d { namespace util {
+
+  template<typename numeric_type>
+  struct disc_set {
+    std::vector<d2d::util::triple<numeric_type> > vertices;
+    std::vector<d2d::util::triple<numeric_type> > normals;
+    std::vector<numeric_type> radii;
+  };
+
+  template<typename numeric_type>
+  class disc_clustering {
+  public:
+
+    // The views have to stay valid as long as this object is used
+    disc_clustering
+    (d2d::util::array_view<d2d::util::triple<numeric_type> const> pVertices,
+     d2d::util::array_view<d2d::util::triple<numeric_type> const> pNormals,
+     d2d::util::array_view<numeric_type const> pRadii) :
+      mVertices(pVertices),
+      mNormals(pNormals),
+      mRadii(pRadii)
+    {
+      d2d::util::profile::phase phase {"lod sort"};
+      phase.set_items(pVertices.size());
+      mCodes = compute_morton_codes(pVertices);
+      mOrder = d2d::util::radix_sort(mCodes);
+      count_cells();
+    }
+
+    // The number of discs of octree level pLevel (0: the finest cells, 21:
+    // one cell)
+    std::size_t get_num_cells(unsigned pLevel) const
+    {
+      return mNumCells[std::min<unsigned>(pLevel, numLevels - 1)];
+    }
+
+    // The level whose number of discs is closest to 1/pFactor of the
+    // original number (in the ratio)
+    unsigned find_level(std::size_t pFactor) const
+    {
+      auto target = std::max(1.0, (double) mCodes.size() / (double) std::max<std::size_t>(1, pFactor));
+      auto best = 0u;
+      auto bestdist = std::numeric_limits<double>::max();
+      for (auto level = 0u; level < numLevels; ++level) {
+        auto dist = std::abs(std::log((double) std::max<std::size_t>(1, mNumCells[level]) / target));
+        if (dist < bestdist) {
+          best = level;
+          bestdist = dist;
+        }
+      }
+      return best;
+    }
+
+    // Reduces the discs by about pFactor
+    disc_set<numeric_type> reduce(std::size_t pFactor) const
+    {
+      return merge(find_level(pFactor));
+    }
+
+    // Merges the discs of each cell of octree level pLevel
+    disc_set<numeric_type> merge(unsigned pLevel) const
+    {
+      d2d::util::profile::phase phase {"lod merge"};
+      phase.set_items(mCodes.size());
+      auto result = disc_set<numeric_type> {};
+      if (mCodes.empty())
+        return result;
+      auto shift = 3 * pLevel;
+      auto starts = find_cell_starts(shift);
+      auto numcells = starts.size() - 1;
+      result.vertices.resize(numcells);
+      result.normals.resize(numcells);
+      result.radii.resize(numcells);
+      d2d::util::parallel::for_each_range(numcells, [&](std::size_t pFirst, std::size_t pLast) {
+          for (auto cidx = pFirst; cidx < pLast; ++cidx) {
+            auto position = d2d::util::triple<double> {0, 0, 0};
+            auto normal = d2d::util::triple<double> {0, 0, 0};
+            auto sumsq = 0.0;
+            for (auto sidx = starts[cidx]; sidx < starts[cidx + 1]; ++sidx) {
+              auto didx = mOrder[sidx];
+              // The area of a disc is proportional to the square of its radius
+              auto weight = (double) mRadii[didx] * (double) mRadii[didx];
+              for (std::size_t cc = 0; cc < 3; ++cc) {
+                position[cc] += weight * (double) mVertices[didx][cc];
+                normal[cc] += weight * (double) mNormals[didx][cc];
+              }
+              sumsq += weight;
+            }
+            auto first = mOrder[starts[cidx]];
+            auto count = (double) (starts[cidx + 1] - starts[cidx]);
+            if (sumsq <= 0) {
+              // Discs without area count equally
+              for (auto sidx = starts[cidx]; sidx < starts[cidx + 1]; ++sidx)
+                for (std::size_t cc = 0; cc < 3; ++cc) {
+                  position[cc] += (double) mVertices[mOrder[sidx]][cc] / count;
+                  normal[cc] += (double) mNormals[mOrder[sidx]][cc];
+                }
+            } else {
+              for (std::size_t cc = 0; cc < 3; ++cc)
+                position[cc] /= sumsq;
+            }
+            auto length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                                    normal[2] * normal[2]);
+            for (std::size_t cc = 0; cc < 3; ++cc) {
+              result.vertices[cidx][cc] = (numeric_type) position[cc];
+              // Opposite normals cancel out; the first disc decides then
+              result.normals[cidx][cc] = length > 0
+                ? (numeric_type) (normal[cc] / length) : mNormals[first][cc];
+            }
+            result.radii[cidx] = (numeric_type) std::sqrt(sumsq);
+          }
+        });
+      return result;
+    }
+
+  private:
+    static constexpr unsigned numLevels = 22;
+
+    // The number of (fixed) blocks in which the sorted codes are scanned
+    std::size_t get_num_blocks() const
+    {
+      return std::max<std::size_t>
+        (1, std::min(4 * d2d::util::parallel::get_num_threads(), mCodes.size() >> 14));
+    }
+
+    // The number of cells of all levels in one pass: two neighbouring codes
+    // lie in different cells of all the levels below their highest
+    // differing bit
+    void count_cells()
+    {
+      auto num = mCodes.size();
+      mNumCells.assign(numLevels, num == 0 ? 0 : 1);
+      if (num < 2)
+        return;
+      auto numblocks = get_num_blocks();
+      auto blocksize = (num + numblocks - 1) / numblocks;
+      auto counts = std::vector<std::size_t> (numblocks * numLevels, 0);
+      d2d::util::parallel::for_each_index(numblocks, [&](std::size_t pBlock) {
+          auto first = std::max<std::size_t>(1, pBlock * blocksize);
+          auto last = std::min(num, pBlock * blocksize + blocksize);
+          auto blockcounts = counts.data() + pBlock * numLevels;
+          for (auto idx = first; idx < last; ++idx) {
+            auto diff = mCodes[idx] ^ mCodes[idx - 1];
+            if (diff != 0)
+              ++blockcounts[(63 - __builtin_clzll(diff)) / 3];
+          }
+        });
+      // A boundary at bit level bb separates the cells of levels 0 to bb
+      for (std::size_t block = 0; block < numblocks; ++block) {
+        auto sum = (std::size_t) 0;
+        for (auto level = numLevels; level-- > 0;) {
+          sum += counts[block * numLevels + level];
+          mNumCells[level] += sum;
+        }
+      }
+    }
+
+    // The positions in the sorted order at which the cells start, followed
+    // by the number of discs
+    std::vector<std::size_t> find_cell_starts(unsigned pShift) const
+    {
+      auto num = mCodes.size();
+      auto numblocks = get_num_blocks();
+      auto blocksize = (num + numblocks - 1) / numblocks;
+      auto blockstarts = std::vector<std::vector<std::size_t> > (numblocks);
+      d2d::util::parallel::for_each_index(numblocks, [&](std::size_t pBlock) {
+          auto first = std::min(num, pBlock * blocksize);
+          auto last = std::min(num, first + blocksize);
+          for (auto idx = first; idx < last; ++idx)
+            if (idx == 0 || (mCodes[idx] >> pShift) != (mCodes[idx - 1] >> pShift))
+              blockstarts[pBlock].push_back(idx);
+        });
+      auto result = std::vector<std::size_t> {};
+      for (auto const& starts : blockstarts)
+        result.insert(result.end(), starts.begin(), starts.end());
+      result.push_back(num);
+      return result;
+    }
+
+    d2d::util::array_view<d2d::util::triple<numeric_type> const> mVertices;
+    d2d::util::array_view<d2d::util::triple<numeric_type> const> mNormals;
+    d2d::util::array_view<numeric_type const> mRadii;
+    // The sorted Morton codes and the indices of the discs in that order
+    std::vector<uint64_t> mCodes;
+    std::vector<std::size_t> mOrder;
+    std::vector<std::size_t> mNumCells;
+  };
+
+  template<typename numeric_type>
+  constexpr unsigned disc_clustering<numeric_type>::numLevels;
+
+  // Calls pFun(factor, level) for the level of detail of each factor of
+  // pFactors. The discs are sorted only once for all levels.
+  template<typename numeric_type, typename function_type>
+  void for_each_level_of_detail
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> pVertices,
+   d2d::util::array_view<d2d::util::triple<numeric_type> const> pNormals,
+   d2d::util::array_view<numeric_type const> pRadii,
+   std::vector<std::size_t> const& pFactors,
+   function_type pFun)
+  {
+    if (pFactors.empty())
+      return;
+    auto clustering = disc_clustering<numeric_type> {pVertices, pNormals, pRadii};
+    for (auto factor : pFactors)
+      pFun(factor, clustering.reduce(factor));
+  }
+}}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace d2d { namespace util {
+
+  // A read-only memory mapping of a whole file. The mapping is released
+  // when the object is destroyed.
+  class mapped_file {
+  public:
+
+    // If pPrefetch is false, the pages are read on demand (or as requested
+    // by prefetch()) instead of reading ahead the whole file.
+    mapped_file(std::string const& pFilePath, bool pPrefetch = true)
+    {
+      auto fd = ::open(pFilePath.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error
+          ("Could not open " + pFilePath + ": " + std::strerror(errno));
+      struct stat filestat;
+      if (::fstat(fd, &filestat) != 0) {
+        auto errstr = std::string {std::strerror(errno)};
+        ::close(fd);
+        throw std::runtime_error("Could not stat " + pFilePath + ": " + errstr);
+      }
+      mSize = (std::size_t) filestat.st_size;
+      if (mSize > 0) {
+        auto addr = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+          auto errstr = std::string {std::strerror(errno)};
+          ::close(fd);
+          throw std::runtime_error("Could not map " + pFilePath + ": " + errstr);
+        }
+        mData = static_cast<char const*>(addr);
+        // The file is consumed front to back by the readers (or by several
+        // threads in big chunks); let the kernel read ahead aggressively.
+        ::madvise(addr, mSize, pPrefetch ? MADV_WILLNEED : MADV_SEQUENTIAL);
+      }
+      // The mapping stays valid after closing the file descriptor.
+      ::close(fd);
+    }
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    mapped_file(mapped_file&& pOther) noexcept :
+      mData(pOther.mData),
+      mSize(pOther.mSize)
+    {
+      pOther.mData = nullptr;
+      pOther.mSize = 0;
+    }
+
+    ~mapped_file()
+    {
+      if (mData != nullptr)
+        ::munmap(const_cast<char*>(mData), mSize);
+    }
+
+    char const* data() const { return mData; }
+    std::size_t size() const { return mSize; }
+    char const* begin() const { return mData; }
+    char const* end() const { return mData + mSize; }
+
+    // Asks the kernel to read the pages of [pBegin, pEnd) ahead
+    void prefetch(char const* pBegin, char const* pEnd) const
+    {
+      advise(pBegin, pEnd, MADV_WILLNEED);
+    }
+
+    // Drops the pages of [pBegin, pEnd) from the memory of the process. They
+    // are read from the file again when accessed later.
+    void discard(char const* pBegin, char const* pEnd) const
+    {
+      advise(pBegin, pEnd, MADV_DONTNEED);
+    }
+
+  private:
+    // Applies pAdvice to the pages which lie completely in [pBegin, pEnd)
+    void advise(char const* pBegin, char const* pEnd, int pAdvice) const
+    {
+      auto pagesize = (std::uintptr_t) ::sysconf(_SC_PAGESIZE);
+      auto first = ((std::uintptr_t) pBegin + pagesize - 1) / pagesize * pagesize;
+      auto last = (std::uintptr_t) pEnd / pagesize * pagesize;
+      if (pEnd == end())
+        last = ((std::uintptr_t) pEnd + pagesize - 1) / pagesize * pagesize;
+      if (first < last)
+        ::madvise((void*) first, last - first, pAdvice);
+    }
+
+    char const* mData = nullptr;
+    std::size_t mSize = 0;
+  };
+}}
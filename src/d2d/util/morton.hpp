@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/utils.hpp"
+
+namespace d2d { namespace util {
+
+  // Interleaves the lower 21 bits of pV with two zero bits each
+  inline uint64_t spread_bits(uint64_t pV)
+  {
+    pV &= 0x1fffff;
+    pV = (pV | pV << 32) & 0x1f00000000ffffULL;
+    pV = (pV | pV << 16) & 0x1f0000ff0000ffULL;
+    pV = (pV | pV << 8) & 0x100f00f00f00f00fULL;
+    pV = (pV | pV << 4) & 0x10c30c30c30c30c3ULL;
+    pV = (pV | pV << 2) & 0x1249249249249249ULL;
+    return pV;
+  }
+
+  // The Morton codes of the points. The bounding cube of the points is
+  // divided into 2^21 cells per axis.
+  template<typename numeric_type>
+  std::vector<uint64_t>
+  compute_morton_codes(d2d::util::array_view<d2d::util::triple<numeric_type> const> pPoints)
+  {
+    auto num = pPoints.size();
+    auto codes = std::vector<uint64_t> (num);
+    if (num == 0)
+      return codes;
+    auto lower = d2d::util::triple<double>
+      {pPoints[0][0], pPoints[0][1], pPoints[0][2]};
+    auto upper = lower;
+    for (std::size_t idx = 0; idx < num; ++idx)
+      for (std::size_t cc = 0; cc < 3; ++cc) {
+        lower[cc] = std::min<double>(lower[cc], pPoints[idx][cc]);
+        upper[cc] = std::max<double>(upper[cc], pPoints[idx][cc]);
+      }
+    auto extent = std::max({upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2]});
+    auto const maxCell = (double) 0x1fffff;
+    auto scale = extent > 0 ? maxCell / extent : 0.0;
+    d2d::util::parallel::for_each_range(num, [&](std::size_t pFirst, std::size_t pLast) {
+        for (auto idx = pFirst; idx < pLast; ++idx) {
+          auto code = (uint64_t) 0;
+          for (std::size_t cc = 0; cc < 3; ++cc) {
+            auto cell = std::min(maxCell, std::max(0.0, (pPoints[idx][cc] - lower[cc]) * scale));
+            code |= spread_bits((uint64_t) cell) << (2 - cc);
+          }
+          codes[idx] = code;
+        }
+      });
+    return codes;
+  }
+}}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace d2d { namespace util { namespace parallel {
+
+  // The number of threads requested by the user. Zero means "use all
+  // hardware threads".
+  inline std::size_t& num_threads_setting()
+  {
+    static std::size_t numthreads = 0;
+    return numthreads;
+  }
+
+  inline void set_num_threads(std::size_t pNumThreads)
+  {
+    num_threads_setting() = pNumThreads;
+  }
+
+  inline std::size_t get_num_threads()
+  {
+    auto numthreads = num_threads_setting();
+    if (numthreads == 0)
+      numthreads = std::thread::hardware_concurrency();
+    return std::max<std::size_t>(1, numthreads);
+  }
+
+  // Calls pFun(idx) for every idx in [0, pNumTasks). The tasks are handed out
+  // dynamically to the worker threads, that is, tasks of uneven cost are
+  // balanced. The first exception thrown by a task is rethrown in the calling
+  // thread after all workers have finished.
+  template<typename function_type>
+  void for_each_index(std::size_t pNumTasks, function_type pFun)
+  {
+    auto numthreads = std::min(get_num_threads(), pNumTasks);
+    if (numthreads <= 1) {
+      for (std::size_t idx = 0; idx < pNumTasks; ++idx)
+        pFun(idx);
+      return;
+    }
+    std::atomic<std::size_t> next {0};
+    std::exception_ptr error;
+    std::mutex errormutex;
+    auto work = [&]() {
+      for (auto idx = next++; idx < pNumTasks; idx = next++) {
+        try {
+          pFun(idx);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(errormutex);
+          if (!error)
+            error = std::current_exception();
+          next = pNumTasks; // Stop handing out further tasks
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(numthreads - 1);
+    for (std::size_t tidx = 1; tidx < numthreads; ++tidx)
+      workers.emplace_back(work);
+    work(); // The calling thread takes part in the work
+    for (auto& worker : workers)
+      worker.join();
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // Splits [0, pNum) into contiguous ranges of at least pMinGrain elements and
+  // calls pFun(begin, end) for each of them in parallel.
+  template<typename function_type>
+  void for_each_range(std::size_t pNum, function_type pFun,
+                      std::size_t pMinGrain = 1 << 12)
+  {
+    if (pNum == 0)
+      return;
+    pMinGrain = std::max<std::size_t>(1, pMinGrain);
+    // A few ranges per thread give some room for load balancing
+    auto numranges = std::min(4 * get_num_threads(),
+                              (pNum + pMinGrain - 1) / pMinGrain);
+    numranges = std::max<std::size_t>(1, numranges);
+    auto rangesize = (pNum + numranges - 1) / numranges;
+    for_each_index(numranges, [&](std::size_t ridx) {
+        auto begin = ridx * rangesize;
+        auto end = std::min(pNum, begin + rangesize);
+        if (begin < end)
+          pFun(begin, end);
+      });
+  }
+}}}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Locale independent number parsing on character ranges. These functions
+// replace the stream extraction operators on the hot paths of the readers.
+// Each parse function skips leading blanks (like operator>> does), advances
+// pPos past the parsed characters and returns false if no number could be
+// read.
+
+namespace d2d { namespace util { namespace parse {
+
+  inline bool is_blank(char pC)
+  {
+    return pC == ' ' || pC == '\t' || pC == '\r' || pC == '\v' || pC == '\f';
+  }
+
+  inline bool is_digit(char pC)
+  {
+    return '0' <= pC && pC <= '9';
+  }
+
+  // Skips blanks but not newlines
+  inline char const* skip_blanks(char const* pPos, char const* pEnd)
+  {
+    while (pPos < pEnd && is_blank(*pPos))
+      ++pPos;
+    return pPos;
+  }
+
+  // Returns a pointer to the first character after the next newline or pEnd
+  inline char const* next_line(char const* pPos, char const* pEnd)
+  {
+    auto nl = static_cast<char const*>
+      (std::memchr(pPos, '\n', (std::size_t) (pEnd - pPos)));
+    return nl == nullptr ? pEnd : nl + 1;
+  }
+
+  inline bool parse_int64(char const*& pPos, char const* pEnd, int64_t& pResult)
+  {
+    auto pos = skip_blanks(pPos, pEnd);
+    bool negative = false;
+    if (pos < pEnd && (*pos == '-' || *pos == '+')) {
+      negative = *pos == '-';
+      ++pos;
+    }
+    auto digits = pos;
+    uint64_t value = 0;
+    while (pos < pEnd && is_digit(*pos)) {
+      value = 10 * value + (uint64_t) (*pos - '0');
+      ++pos;
+    }
+    if (pos == digits)
+      return false;
+    pResult = negative ? - (int64_t) value : (int64_t) value;
+    pPos = pos;
+    return true;
+  }
+
+  inline bool parse_int32(char const*& pPos, char const* pEnd, int32_t& pResult)
+  {
+    int64_t value;
+    if (!parse_int64(pPos, pEnd, value))
+      return false;
+    pResult = (int32_t) value;
+    return true;
+  }
+
+  inline bool parse_size(char const*& pPos, char const* pEnd, std::size_t& pResult)
+  {
+    auto pos = skip_blanks(pPos, pEnd);
+    if (pos < pEnd && *pos == '+')
+      ++pos;
+    auto digits = pos;
+    std::size_t value = 0;
+    while (pos < pEnd && is_digit(*pos)) {
+      value = 10 * value + (std::size_t) (*pos - '0');
+      ++pos;
+    }
+    if (pos == digits)
+      return false;
+    pResult = value;
+    pPos = pos;
+    return true;
+  }
+
+  // Parses a decimal floating point number of the form
+  // [+-]digits[.digits][(e|E)[+-]digits]. Numbers with at most 19
+  // significant digits whose decimal mantissa and power of ten are exactly
+  // representable as doubles are converted without any rounding error on
+  // the fast path (Clinger's algorithm). All other numbers are handed to
+  // std::strtod. The programs of this project never change the global
+  // locale, hence std::strtod always operates in the "C" locale.
+  inline bool parse_double(char const*& pPos, char const* pEnd, double& pResult)
+  {
+    static double const powersoften[] =
+      {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    auto start = skip_blanks(pPos, pEnd);
+    auto pos = start;
+    bool negative = false;
+    if (pos < pEnd && (*pos == '-' || *pos == '+')) {
+      negative = *pos == '-';
+      ++pos;
+    }
+    uint64_t mantissa = 0;
+    int numdigits = 0; // significant digits in mantissa
+    int exponent = 0;
+    bool anydigit = false;
+    bool truncated = false;
+    for (; pos < pEnd && is_digit(*pos); ++pos) {
+      anydigit = true;
+      if (numdigits < 19) {
+        mantissa = 10 * mantissa + (uint64_t) (*pos - '0');
+        if (mantissa != 0)
+          ++numdigits;
+      } else {
+        ++exponent;
+        truncated |= *pos != '0';
+      }
+    }
+    if (pos < pEnd && *pos == '.') {
+      ++pos;
+      for (; pos < pEnd && is_digit(*pos); ++pos) {
+        anydigit = true;
+        if (numdigits < 19) {
+          mantissa = 10 * mantissa + (uint64_t) (*pos - '0');
+          if (mantissa != 0)
+            ++numdigits;
+          --exponent;
+        } else {
+          truncated |= *pos != '0';
+        }
+      }
+    }
+    if (!anydigit)
+      return false;
+    if (pos < pEnd && (*pos == 'e' || *pos == 'E')) {
+      auto epos = pos + 1;
+      bool enegative = false;
+      if (epos < pEnd && (*epos == '-' || *epos == '+')) {
+        enegative = *epos == '-';
+        ++epos;
+      }
+      if (epos < pEnd && is_digit(*epos)) {
+        int expvalue = 0;
+        for (; epos < pEnd && is_digit(*epos); ++epos)
+          if (expvalue < 100000)
+            expvalue = 10 * expvalue + (*epos - '0');
+        exponent += enegative ? -expvalue : expvalue;
+        pos = epos;
+      }
+      // else: the 'e' does not belong to the number (like operator>>)
+    }
+    if (!truncated && mantissa <= (uint64_t(1) << 53) &&
+        -22 <= exponent && exponent <= 22) {
+      auto value = (double) mantissa;
+      if (exponent < 0)
+        value /= powersoften[-exponent];
+      else
+        value *= powersoften[exponent];
+      pResult = negative ? -value : value;
+      pPos = pos;
+      return true;
+    }
+    // Slow path. std::strtod needs a null terminated string.
+    auto length = (std::size_t) (pos - start);
+    char buffer[64];
+    if (length < sizeof(buffer)) {
+      std::memcpy(buffer, start, length);
+      buffer[length] = '\0';
+      pResult = std::strtod(buffer, nullptr);
+    } else {
+      pResult = std::strtod(std::string(start, length).c_str(), nullptr);
+    }
+    pPos = pos;
+    return true;
+  }
+
+  // Parses a count given on the command line, e.g., of --threads: decimal
+  // digits only (no sign, blanks or suffix) of a value from pMin to pMax.
+  // Returns false if pStr is not such a count.
+  inline bool parse_count
+  (std::string const& pStr, std::size_t& pResult,
+   std::size_t pMin = 1, std::size_t pMax = SIZE_MAX)
+  {
+    if (pStr.empty())
+      return false;
+    auto value = std::size_t {0};
+    for (auto cc : pStr) {
+      if (!is_digit(cc))
+        return false;
+      auto digit = (std::size_t) (cc - '0');
+      if (value > (SIZE_MAX - digit) / 10)
+        return false;
+      value = 10 * value + digit;
+    }
+    if (value < pMin || value > pMax)
+      return false;
+    pResult = value;
+    return true;
+  }
+
+  // Parses a size in bytes with an optional binary suffix, e.g., "4096",
+  // "512M", "4G" or "4GiB". Returns false if pStr is not such a size.
+  inline bool parse_byte_size(std::string const& pStr, std::size_t& pResult)
+  {
+    auto digits = std::size_t {0};
+    while (digits < pStr.size() && is_digit(pStr[digits]))
+      ++digits;
+    auto value = std::size_t {0};
+    if (!parse_count(pStr.substr(0, digits), value, 0))
+      return false;
+    auto suffix = pStr.substr(digits);
+    auto shift = 0;
+    if (!suffix.empty()) {
+      switch (suffix[0]) {
+      case 'k': case 'K': shift = 10; break;
+      case 'm': case 'M': shift = 20; break;
+      case 'g': case 'G': shift = 30; break;
+      case 't': case 'T': shift = 40; break;
+      case 'b': case 'B': break;
+      default: return false;
+      }
+      // "B" itself takes no further characters
+      auto rest = suffix.substr(1);
+      if (shift == 0 ? !rest.empty() : !(rest.empty() || rest == "B" || rest == "iB"))
+        return false;
+    }
+    if (value > (SIZE_MAX >> shift))
+      return false;
+    pResult = value << shift;
+    return true;
+  }
+}}}
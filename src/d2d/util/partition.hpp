@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/utils.hpp"
+
+namespace d2d { namespace util {
+
+  // A partition of items into parts. The items of part pidx are
+  // order[offsets[pidx]], ..., order[offsets[pidx + 1] - 1].
+  struct partition {
+    std::vector<std::size_t> order;
+    std::vector<std::size_t> offsets;
+
+    std::size_t num_parts() const
+    {
+      return offsets.size() - 1;
+    }
+
+    d2d::util::array_view<std::size_t const> get_part(std::size_t pIdx) const
+    {
+      return d2d::util::array_view<std::size_t const> {order}.subview
+        (offsets[pIdx], offsets[pIdx + 1] - offsets[pIdx]);
+    }
+  };
+
+  // Partitions the points into pNumParts spatially coherent parts of (nearly)
+  // equal size by recursive coordinate bisection. Each bisection splits a
+  // part across the longest side of its bounding box. The parts of one level
+  // of the recursion are split concurrently. There are at most as many parts
+  // as points, so that no part is empty.
+  template<typename numeric_type>
+  partition
+  partition_points
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> pPoints,
+   std::size_t pNumParts)
+  {
+    // A range [begin, end) of the order which is split into numparts parts
+    struct range {
+      std::size_t begin;
+      std::size_t end;
+      std::size_t numparts;
+    };
+
+    d2d::util::profile::phase phase {"partition"};
+    phase.set_items(pPoints.size());
+    auto result = partition {};
+    result.order.resize(pPoints.size());
+    std::iota(result.order.begin(), result.order.end(), (std::size_t) 0);
+    pNumParts = std::max<std::size_t>(1, std::min(pNumParts, pPoints.size()));
+
+    auto ranges = std::vector<range> {{0, pPoints.size(), pNumParts}};
+    while (ranges.size() < pNumParts) {
+      auto splits = std::vector<range> (2 * ranges.size());
+      d2d::util::parallel::for_each_index(ranges.size(), [&](std::size_t ridx) {
+          auto rr = ranges[ridx];
+          if (rr.numparts == 1) {
+            // Nothing to split; the empty second range is dropped below
+            splits[2 * ridx] = rr;
+            splits[2 * ridx + 1] = {rr.end, rr.end, 0};
+            return;
+          }
+          auto first = result.order.begin() + rr.begin;
+          auto last = result.order.begin() + rr.end;
+          auto lower = d2d::util::triple<numeric_type> {};
+          auto upper = d2d::util::triple<numeric_type> {};
+          lower.fill(std::numeric_limits<numeric_type>::max());
+          upper.fill(std::numeric_limits<numeric_type>::lowest());
+          for (auto it = first; it != last; ++it)
+            for (std::size_t cc = 0; cc < 3; ++cc) {
+              lower[cc] = std::min(lower[cc], pPoints[*it][cc]);
+              upper[cc] = std::max(upper[cc], pPoints[*it][cc]);
+            }
+          std::size_t axis = 0;
+          for (std::size_t cc = 1; cc < 3; ++cc)
+            if (upper[cc] - lower[cc] > upper[axis] - lower[axis])
+              axis = cc;
+          // The number of points of each side is proportional to its number of parts
+          auto leftparts = rr.numparts / 2;
+          auto middle = rr.begin + (rr.end - rr.begin) * leftparts / rr.numparts;
+          std::nth_element(first, result.order.begin() + middle, last,
+                           [&](std::size_t pA, std::size_t pB) {
+                             return pPoints[pA][axis] < pPoints[pB][axis] ||
+                               (pPoints[pA][axis] == pPoints[pB][axis] && pA < pB);
+                           });
+          splits[2 * ridx] = {rr.begin, middle, leftparts};
+          splits[2 * ridx + 1] = {middle, rr.end, rr.numparts - leftparts};
+        });
+      ranges.clear();
+      for (auto const& rr : splits)
+        if (rr.numparts > 0)
+          ranges.push_back(rr);
+    }
+
+    result.offsets.reserve(ranges.size() + 1);
+    for (auto const& rr : ranges)
+      result.offsets.push_back(rr.begin);
+    result.offsets.push_back(pPoints.size());
+    return result;
+  }
+
+  // Returns pValues[pOrder[0]], pValues[pOrder[1]], ...
+  template<typename value_type>
+  std::vector<value_type>
+  gather
+  (d2d::util::array_view<value_type const> pValues,
+   d2d::util::array_view<std::size_t const> pOrder)
+  {
+    auto result = std::vector<value_type> (pOrder.size());
+    d2d::util::parallel::for_each_range
+      (pOrder.size(), [&](std::size_t pFirst, std::size_t pLast) {
+        for (auto idx = pFirst; idx < pLast; ++idx)
+          result[idx] = pValues[pOrder[idx]];
+      });
+    return result;
+  }
+
+  // The triangles of a part of a mesh and the vertices they refer to. The
+  // vertex indices of the triangles refer to the vertices of the part, that
+  // is, vertices which are shared across parts appear in each of these parts.
+  template<typename numeric_type>
+  struct submesh {
+    std::vector<d2d::util::triple<numeric_type> > vertices;
+    std::vector<d2d::util::triple<std::size_t> > triangles;
+    // The index of each vertex of the part in the whole mesh
+    std::vector<std::size_t> globalids;
+  };
+
+  template<typename numeric_type>
+  submesh<numeric_type>
+  extract_submesh
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> pVertices,
+   d2d::util::array_view<d2d::util::triple<std::size_t> const> pTriangles,
+   d2d::util::array_view<std::size_t const> pTriangleIds)
+  {
+    // The global indices of the vertices of the part in ascending order
+    auto globalids = std::vector<std::size_t> {};
+    globalids.reserve(3 * pTriangleIds.size());
+    for (auto tidx : pTriangleIds)
+      globalids.insert(globalids.end(), pTriangles[tidx].begin(), pTriangles[tidx].end());
+    std::sort(globalids.begin(), globalids.end());
+    globalids.erase(std::unique(globalids.begin(), globalids.end()), globalids.end());
+
+    auto result = submesh<numeric_type> {};
+    result.vertices.reserve(globalids.size());
+    for (auto vidx : globalids)
+      result.vertices.push_back(pVertices[vidx]);
+    result.triangles.reserve(pTriangleIds.size());
+    for (auto tidx : pTriangleIds) {
+      auto triangle = d2d::util::triple<std::size_t> {};
+      for (std::size_t cc = 0; cc < 3; ++cc)
+        triangle[cc] = (std::size_t)
+          (std::lower_bound(globalids.begin(), globalids.end(), pTriangles[tidx][cc]) -
+           globalids.begin());
+      result.triangles.push_back(triangle);
+    }
+    result.globalids = std::move(globalids);
+    return result;
+  }
+}}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "d2d/util/bounded_queue.hpp"
+#include "d2d/util/profile.hpp"
+
+// A pipeline of stages which process a sequence of items (e.g., the chunks
+// of an input) concurrently: while one stage writes item N, the one before
+// computes item N+1 and the first one reads item N+2. Every stage runs on a
+// thread of its own and passes its items on in order through a bounded
+// queue, so a fast stage is held back by a slow one (back-pressure) and only
+// a fixed number of items is in memory:
+//
+//   d2d::util::pipeline<chunk> stages {1};
+//   stages.set_source("read", [&](chunk& pChunk) { ...; return more; });
+//   stages.add_stage("derive", [&](chunk& pChunk) { ... });
+//   stages.add_stage("write", [&](chunk& pChunk) { ... });
+//   stages.run();
+//
+// The stages may use util::parallel themselves. With profiling on, the busy
+// and waiting times of every stage are recorded, which shows the stage that
+// limits the throughput.
+
+namespace d2d { namespace util {
+
+  template<typename item_type>
+  class pipeline {
+  public:
+
+    // pQueueCapacity items may wait between two stages
+    pipeline(std::size_t pQueueCapacity = 1) :
+      mQueueCapacity(pQueueCapacity)
+    {}
+
+    // pRead fills in the next item; it returns false (with the item
+    // unused) when there are no more
+    void set_source(std::string pName, std::function<bool(item_type&)> pRead)
+    {
+      mSource = std::move(pRead);
+      mNames.insert(mNames.begin(), std::move(pName));
+    }
+
+    void add_stage(std::string pName, std::function<void(item_type&)> pStage)
+    {
+      mStages.push_back(std::move(pStage));
+      mNames.push_back(std::move(pName));
+    }
+
+    // Runs all the stages until the source is exhausted. If a stage throws,
+    // the others are stopped and the first exception is rethrown.
+    void run()
+    {
+      auto numstages = mStages.size() + 1;
+      mQueues.clear();
+      for (std::size_t idx = 0; idx + 1 < numstages; ++idx)
+        mQueues.emplace_back(new bounded_queue<item_type> {mQueueCapacity});
+      mTimes.assign(numstages, times {});
+      mError = nullptr;
+      auto start = clock::now();
+      auto threads = std::vector<std::thread> {};
+      for (std::size_t idx = 0; idx < numstages; ++idx)
+        threads.emplace_back([this, idx] { run_stage(idx); });
+      for (auto& thread : threads)
+        thread.join();
+      auto wall = seconds(start, clock::now());
+      if (mError)
+        std::rethrow_exception(mError);
+      if (d2d::util::profile::is_enabled()) {
+        for (std::size_t idx = 0; idx < numstages; ++idx) {
+          auto rec = d2d::util::profile::stage_record {};
+          rec.name = mNames[idx];
+          rec.wall = wall;
+          rec.busy = mTimes[idx].busy;
+          rec.waitin = mTimes[idx].waitin;
+          rec.waitout = mTimes[idx].waitout;
+          rec.items = mTimes[idx].items;
+          d2d::util::profile::registry::get().add_stage(std::move(rec));
+        }
+      }
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct times {
+      double busy = 0;
+      double waitin = 0;
+      double waitout = 0;
+      std::size_t items = 0;
+    };
+
+    static double seconds(clock::time_point pFrom, clock::time_point pTo)
+    {
+      return std::chrono::duration<double>(pTo - pFrom).count();
+    }
+
+    void run_stage(std::size_t pIdx)
+    {
+      auto& tt = mTimes[pIdx];
+      auto input = pIdx > 0 ? mQueues[pIdx - 1].get() : nullptr;
+      auto output = pIdx < mQueues.size() ? mQueues[pIdx].get() : nullptr;
+      try {
+        while (true) {
+          auto item = item_type {};
+          auto before = clock::now();
+          if (input == nullptr) {
+            auto more = mSource(item);
+            tt.busy += seconds(before, clock::now());
+            if (!more)
+              break;
+          } else {
+            if (!input->pop(item))
+              break;
+            auto popped = clock::now();
+            tt.waitin += seconds(before, popped);
+            mStages[pIdx - 1](item);
+            tt.busy += seconds(popped, clock::now());
+          }
+          ++tt.items;
+          if (output != nullptr) {
+            before = clock::now();
+            if (!output->push(std::move(item)))
+              break;
+            tt.waitout += seconds(before, clock::now());
+          }
+        }
+        if (output != nullptr)
+          output->finish();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock {mErrorMutex};
+        if (!mError)
+          mError = std::current_exception();
+        for (auto& queue : mQueues)
+          queue->cancel();
+      }
+    }
+
+    std::size_t mQueueCapacity;
+    std::function<bool(item_type&)> mSource;
+    std::vector<std::function<void(item_type&)> > mStages;
+    // Of the source and the stages
+    std::vector<std::string> mNames;
+    std::vector<std::unique_ptr<bounded_queue<item_type> > > mQueues;
+    std::vector<times> mTimes;
+    std::exception_ptr mError;
+    std::mutex mErrorMutex;
+  };
+}}
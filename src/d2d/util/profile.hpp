@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "d2d/util/clo.hpp"
+
+// Profiling of the phases of a conversion (--profile). A phase is a scope:
+//
+//   d2d::util::profile::phase phase {"read"};
+//   ...
+//   phase.set_items(numvertices);
+//
+// records the wall time, the CPU time of the process (of all its threads),
+// the bytes and items processed and the peak resident set size at the end
+// of the scope. When profiling is off a phase does nothing but check a flag.
+
+namespace d2d { namespace util { namespace profile {
+
+  // A finished phase
+  struct record {
+    std::string name;
+    double wall = 0;
+    double cpu = 0;
+    uint64_t bytes = 0;
+    uint64_t items = 0;
+    // KiB
+    long peakrss = 0;
+  };
+
+  // A stage of a pipeline (see d2d/util/pipeline.hpp). The times are the
+  // ones the stage was busy, waited for input and waited for space in its
+  // output queue during the wall time of the pipeline.
+  struct stage_record {
+    std::string name;
+    double wall = 0;
+    double busy = 0;
+    double waitin = 0;
+    double waitout = 0;
+    uint64_t items = 0;
+  };
+
+  // The records of all phases of the process
+  class registry {
+  public:
+    static registry& get()
+    {
+      static registry instance;
+      return instance;
+    }
+
+    void enable()
+    {
+      mStart = std::chrono::steady_clock::now();
+      mEnabled.store(true, std::memory_order_relaxed);
+    }
+
+    bool is_enabled() const
+    {
+      return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    void add(record pRecord)
+    {
+      std::lock_guard<std::mutex> lock {mMutex};
+      mRecords.push_back(std::move(pRecord));
+    }
+
+    // The records of equally named phases summed up, in the order of the
+    // first occurrence of each name. count holds the number of occurrences.
+    struct total : record {
+      std::size_t count = 0;
+    };
+
+    std::vector<total> get_totals() const
+    {
+      std::lock_guard<std::mutex> lock {mMutex};
+      auto result = std::vector<total> {};
+      for (auto const& rec : mRecords) {
+        auto it = std::find_if(result.begin(), result.end(), [&](total const& pTotal) {
+            return pTotal.name == rec.name;
+          });
+        if (it == result.end()) {
+          result.emplace_back();
+          it = result.end() - 1;
+          it->name = rec.name;
+        }
+        it->wall += rec.wall;
+        it->cpu += rec.cpu;
+        it->bytes += rec.bytes;
+        it->items += rec.items;
+        it->peakrss = std::max(it->peakrss, rec.peakrss);
+        it->count += 1;
+      }
+      return result;
+    }
+
+    void add_stage(stage_record pRecord)
+    {
+      std::lock_guard<std::mutex> lock {mMutex};
+      auto it = std::find_if(mStages.begin(), mStages.end(), [&](stage_record const& pStage) {
+          return pStage.name == pRecord.name;
+        });
+      if (it == mStages.end()) {
+        mStages.push_back(std::move(pRecord));
+        return;
+      }
+      it->wall += pRecord.wall;
+      it->busy += pRecord.busy;
+      it->waitin += pRecord.waitin;
+      it->waitout += pRecord.waitout;
+      it->items += pRecord.items;
+    }
+
+    // The records of equally named stages summed up
+    std::vector<stage_record> get_stages() const
+    {
+      std::lock_guard<std::mutex> lock {mMutex};
+      return mStages;
+    }
+
+    double get_elapsed_seconds() const
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    }
+
+  private:
+    registry() = default;
+
+    std::atomic<bool> mEnabled {false};
+    std::chrono::steady_clock::time_point mStart;
+    mutable std::mutex mMutex;
+    std::vector<record> mRecords;
+    std::vector<stage_record> mStages;
+  };
+
+  inline bool is_enabled()
+  {
+    return registry::get().is_enabled();
+  }
+
+  // The CPU time of all threads of the process in seconds
+  inline double get_cpu_seconds()
+  {
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+      return 0;
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+  }
+
+  // The peak resident set size of the process so far in KiB
+  inline long get_peak_rss()
+  {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+    return usage.ru_maxrss;
+  }
+
+  class phase {
+  public:
+    explicit phase(char const* pName) :
+      mName(pName),
+      mActive(is_enabled())
+    {
+      if (!mActive)
+        return;
+      mWallStart = std::chrono::steady_clock::now();
+      mCpuStart = get_cpu_seconds();
+    }
+
+    ~phase()
+    {
+      if (!mActive)
+        return;
+      auto rec = record {};
+      rec.name = mName;
+      rec.wall = std::chrono::duration<double>
+        (std::chrono::steady_clock::now() - mWallStart).count();
+      rec.cpu = get_cpu_seconds() - mCpuStart;
+      rec.bytes = mBytes;
+      rec.items = mItems;
+      rec.peakrss = get_peak_rss();
+      registry::get().add(std::move(rec));
+    }
+
+    phase(phase const&) = delete;
+    phase& operator=(phase const&) = delete;
+
+    void set_bytes(uint64_t pBytes)
+    {
+      mBytes = pBytes;
+    }
+
+    // The size of a file (e.g., the one read or written in this phase). The
+    // file is only looked at when profiling is on.
+    void set_bytes_of_file(std::string const& pPath)
+    {
+      if (!mActive)
+        return;
+      struct stat filestat;
+      if (::stat(pPath.c_str(), &filestat) == 0)
+        mBytes = (uint64_t) filestat.st_size;
+    }
+
+    void set_items(uint64_t pItems)
+    {
+      mItems = pItems;
+    }
+
+  private:
+    char const* mName;
+    bool mActive;
+    std::chrono::steady_clock::time_point mWallStart;
+    double mCpuStart = 0;
+    uint64_t mBytes = 0;
+    uint64_t mItems = 0;
+  };
+
+  inline void print_summary(std::ostream& pOut)
+  {
+    auto& reg = registry::get();
+    auto totals = reg.get_totals();
+    auto flags = pOut.flags();
+    pOut << "Profile (wall and CPU time in seconds; the CPU time includes all threads)\n"
+         << std::left << std::setw(20) << "phase" << std::right
+         << std::setw(7) << "calls" << std::setw(11) << "wall" << std::setw(11) << "cpu"
+         << std::setw(12) << "MiB" << std::setw(11) << "MiB/s" << std::setw(14) << "items"
+         << std::setw(14) << "peak RSS MiB" << "\n";
+    pOut << std::fixed;
+    for (auto const& tt : totals) {
+      auto mib = (double) tt.bytes / (1024 * 1024);
+      pOut << std::left << std::setw(20) << tt.name << std::right
+           << std::setw(7) << tt.count
+           << std::setprecision(3) << std::setw(11) << tt.wall << std::setw(11) << tt.cpu
+           << std::setprecision(1) << std::setw(12) << mib << std::setw(11)
+           << (tt.wall > 0 ? mib / tt.wall : 0.0)
+           << std::setw(14) << tt.items
+           << std::setw(14) << (double) tt.peakrss / 1024 << "\n";
+    }
+    auto stages = reg.get_stages();
+    if (!stages.empty()) {
+      pOut << "Pipeline stages (utilization: the share of the wall time a stage was busy;"
+           << " the stage with the highest one limits the throughput)\n"
+           << std::left << std::setw(20) << "stage" << std::right
+           << std::setw(9) << "items" << std::setw(11) << "wall" << std::setw(11) << "busy"
+           << std::setw(11) << "wait in" << std::setw(11) << "wait out"
+           << std::setw(13) << "utilization" << "\n";
+      for (auto const& ss : stages) {
+        pOut << std::left << std::setw(20) << ss.name << std::right
+             << std::setw(9) << ss.items << std::setprecision(3)
+             << std::setw(11) << ss.wall << std::setw(11) << ss.busy
+             << std::setw(11) << ss.waitin << std::setw(11) << ss.waitout
+             << std::setprecision(1) << std::setw(12)
+             << (ss.wall > 0 ? 100 * ss.busy / ss.wall : 0.0) << "%\n";
+      }
+    }
+    pOut << std::setprecision(3) << "total wall " << reg.get_elapsed_seconds()
+         << " s, peak RSS " << std::setprecision(1) << (double) get_peak_rss() / 1024
+         << " MiB" << std::endl;
+    pOut.flags(flags);
+  }
+
+  inline std::string escape_json(std::string const& pStr)
+  {
+    auto result = std::string {};
+    for (auto cc : pStr) {
+      if (cc == '"' || cc == '\\') {
+        result += '\\';
+        result += cc;
+      } else if ((unsigned char) cc < 0x20) {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned) cc);
+        result += buffer;
+      } else {
+        result += cc;
+      }
+    }
+    return result;
+  }
+
+  inline void write_json(std::string const& pPath)
+  {
+    auto& reg = registry::get();
+    auto totals = reg.get_totals();
+    auto out = std::ofstream {pPath};
+    out << std::setprecision(9)
+        << "{\n  \"wall_seconds\": " << reg.get_elapsed_seconds()
+        << ",\n  \"peak_rss_bytes\": " << (uint64_t) get_peak_rss() * 1024
+        << ",\n  \"phases\": [";
+    for (std::size_t idx = 0; idx < totals.size(); ++idx) {
+      auto const& tt = totals[idx];
+      out << (idx == 0 ? "\n" : ",\n")
+          << "    {\"name\": \"" << escape_json(tt.name) << "\""
+          << ", \"calls\": " << tt.count
+          << ", \"wall_seconds\": " << tt.wall
+          << ", \"cpu_seconds\": " << tt.cpu
+          << ", \"bytes\": " << tt.bytes
+          << ", \"items\": " << tt.items
+          << ", \"peak_rss_bytes\": " << (uint64_t) tt.peakrss * 1024 << "}";
+    }
+    out << "\n  ]";
+    auto stages = reg.get_stages();
+    if (!stages.empty()) {
+      out << ",\n  \"stages\": [";
+      for (std::size_t idx = 0; idx < stages.size(); ++idx) {
+        auto const& ss = stages[idx];
+        out << (idx == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << escape_json(ss.name) << "\""
+            << ", \"items\": " << ss.items
+            << ", \"wall_seconds\": " << ss.wall
+            << ", \"busy_seconds\": " << ss.busy
+            << ", \"wait_in_seconds\": " << ss.waitin
+            << ", \"wait_out_seconds\": " << ss.waitout << "}";
+      }
+      out << "\n  ]";
+    }
+    out << "\n}\n";
+    if (!out)
+      throw std::runtime_error("Could not write the profile " + pPath);
+  }
+
+  inline void add_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    pOptMan.addCmlParam(d2d::util::clo::bool_option
+                        {"PROFILE", {"--profile"},
+                           "prints the time, throughput and memory of each phase of the conversion"});
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"PROFILE_JSON", {"--profile-json"},
+                           "writes the profile to the given JSON file (implies --profile)"});
+  }
+
+  // Profiling is enabled by either option. Returns the JSON file name
+  // (empty if none).
+  inline std::string read_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    auto jsonfile = pOptMan.get_string_option_value("PROFILE_JSON");
+    if (pOptMan.get_bool_option_value("PROFILE") || !jsonfile.empty())
+      registry::get().enable();
+    return jsonfile;
+  }
+
+  // Prints the summary and writes the JSON report if profiling is enabled
+  inline void report(std::string const& pJsonFile)
+  {
+    if (!is_enabled())
+      return;
+    print_summary(std::cout);
+    if (!pJsonFile.empty())
+      write_json(pJsonFile);
+  }
+}}}
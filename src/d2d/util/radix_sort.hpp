@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "d2d/util/parallel.hpp"
+
+namespace d2d { namespace util {
+
+  // Sorts the 64 bit keys in ascending order and returns the permutation
+  // applied, that is, order[idx] is the original index of the key which ends
+  // up at position idx. The sort is a stable least significant digit radix
+  // sort with 8 bit digits. Each pass counts the digits of contiguous blocks
+  // of keys in parallel and scatters the blocks in parallel; digits which are
+  // equal for all keys are skipped. The result does not depend on the number
+  // of threads.
+  inline std::vector<std::size_t>
+  radix_sort(std::vector<uint64_t>& pKeys)
+  {
+    std::size_t const numBuckets = 256;
+    auto num = pKeys.size();
+    auto order = std::vector<std::size_t> (num);
+    std::iota(order.begin(), order.end(), (std::size_t) 0);
+    if (num < 2)
+      return order;
+
+    // Fixed blocks (independent of the threads actually used) keep the
+    // scatter stable
+    auto numblocks = std::max<std::size_t>
+      (1, std::min(4 * d2d::util::parallel::get_num_threads(), num >> 14));
+    auto blocksize = (num + numblocks - 1) / numblocks;
+    auto keys = std::vector<uint64_t> (num);
+    auto indices = std::vector<std::size_t> (num);
+    auto counts = std::vector<std::size_t> (numblocks * numBuckets);
+
+    // The bits which differ between any two keys
+    auto ored = (uint64_t) 0;
+    auto anded = ~(uint64_t) 0;
+    for (auto key : pKeys) {
+      ored |= key;
+      anded &= key;
+    }
+    auto varying = ored ^ anded;
+
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+      if (((varying >> shift) & 0xff) == 0)
+        continue;
+      std::fill(counts.begin(), counts.end(), 0);
+      d2d::util::parallel::for_each_index(numblocks, [&](std::size_t pBlock) {
+          auto first = std::min(num, pBlock * blocksize);
+          auto last = std::min(num, first + blocksize);
+          auto blockcounts = counts.data() + pBlock * numBuckets;
+          for (auto idx = first; idx < last; ++idx)
+            ++blockcounts[(pKeys[idx] >> shift) & 0xff];
+        });
+      // Bucket by bucket, block by block
+      auto offset = (std::size_t) 0;
+      for (std::size_t bucket = 0; bucket < numBuckets; ++bucket)
+        for (std::size_t block = 0; block < numblocks; ++block) {
+          auto& count = counts[block * numBuckets + bucket];
+          auto blockcount = count;
+          count = offset;
+          offset += blockcount;
+        }
+      d2d::util::parallel::for_each_index(numblocks, [&](std::size_t pBlock) {
+          auto first = std::min(num, pBlock * blocksize);
+          auto last = std::min(num, first + blocksize);
+          auto positions = counts.data() + pBlock * numBuckets;
+          for (auto idx = first; idx < last; ++idx) {
+            auto pos = positions[(pKeys[idx] >> shift) & 0xff]++;
+            keys[pos] = pKeys[idx];
+            indices[pos] = order[idx];
+          }
+        });
+      pKeys.swap(keys);
+      order.swap(indices);
+    }
+    return order;
+  }
+}}
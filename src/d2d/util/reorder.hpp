@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/clo.hpp"
+#include "d2d/util/morton.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/partition.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/radix_sort.hpp"
+#include "d2d/util/utils.hpp"
+
+// Reordering of surfaces for cache locality. The vertices are sorted along a
+// Morton (Z-order) curve, such that vertices which are close in space are
+// mostly close in memory. The triangles are then sorted by their smallest
+// (new) vertex index, which is the order in which a traversal of the
+// vertices meets them. Both sorts are the parallel radix sort; the result
+// does not depend on the number of threads.
+
+namespace d2d { namespace util {
+
+  // The indices of the points and cells of a surface in the input, that is,
+  // before welding and reordering. Empty views if they are not tracked.
+  struct original_ids {
+    d2d::util::array_view<std::size_t const> points;
+    d2d::util::array_view<std::size_t const> cells;
+  };
+
+  // The order of the points along the Morton curve: order[idx] is the old
+  // index of the point which moves to idx
+  template<typename numeric_type>
+  std::vector<std::size_t>
+  spatial_order(d2d::util::array_view<d2d::util::triple<numeric_type> const> pPoints)
+  {
+    auto codes = compute_morton_codes(pPoints);
+    return d2d::util::radix_sort(codes);
+  }
+
+  // The new index of each old index of a permutation given as for
+  // spatial_order()
+  inline std::vector<std::size_t>
+  invert_permutation(d2d::util::array_view<std::size_t const> pOrder)
+  {
+    auto result = std::vector<std::size_t> (pOrder.size());
+    d2d::util::parallel::for_each_range
+      (pOrder.size(), [&](std::size_t pFirst, std::size_t pLast) {
+        for (auto idx = pFirst; idx < pLast; ++idx)
+          result[pOrder[idx]] = idx;
+      });
+    return result;
+  }
+
+  // Renumbers the vertices of the triangles by pRemap (old to new index) in
+  // place and returns the order of the triangles by their smallest new
+  // vertex index (ties keep their relative order)
+  inline std::vector<std::size_t>
+  renumber_and_order_triangles
+  (std::vector<d2d::util::triple<std::size_t> >& pTriangles,
+   std::vector<std::size_t> const& pRemap)
+  {
+    auto keys = std::vector<uint64_t> (pTriangles.size());
+    d2d::util::parallel::for_each_range
+      (pTriangles.size(), [&](std::size_t pFirst, std::size_t pLast) {
+        for (auto tidx = pFirst; tidx < pLast; ++tidx) {
+          auto& triangle = pTriangles[tidx];
+          for (auto& vidx : triangle)
+            vidx = pRemap[vidx];
+          keys[tidx] = std::min({triangle[0], triangle[1], triangle[2]});
+        }
+      });
+    return d2d::util::radix_sort(keys);
+  }
+
+  // Command line options of the reordering
+  struct reorder_options {
+    // Sort the vertices and triangles along a space-filling curve
+    bool reorder = false;
+    // Write the original indices of the points and cells (as
+    // vtkOriginalPointIds and vtkOriginalCellIds)
+    bool originalids = false;
+
+    static void add_cml_params(d2d::util::clo::manager& pOptMan)
+    {
+      pOptMan.addCmlParam(d2d::util::clo::bool_option
+        {"REORDER", {"--reorder"},
+           "sorts the vertices (and triangles) along a Morton curve for cache locality"});
+      pOptMan.addCmlParam(d2d::util::clo::bool_option
+        {"ORIGINAL_IDS", {"--original-ids"},
+           "writes the indices of the points and cells in the input as"
+           " vtkOriginalPointIds and vtkOriginalCellIds"});
+    }
+
+    void read_cml_params(d2d::util::clo::manager& pOptMan)
+    {
+      reorder = pOptMan.get_bool_option_value("REORDER");
+      originalids = pOptMan.get_bool_option_value("ORIGINAL_IDS");
+    }
+  };
+}}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+// Batch versions of the vector math of utils.hpp which operate on
+// structure-of-arrays data. Each function is compiled for several
+// instruction sets (scalar, AVX2 and AVX-512 on x86-64); the best one the
+// CPU supports is selected at runtime. Hence the binaries do not need to
+// be built with -march=native to make use of wide vector units.
+//
+// The environment variable D2D_SIMD (scalar, avx2 or avx512) restricts the
+// selection, e.g., to compare the vectorized with the scalar results.
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define D2D_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define D2D_SIMD_X86 0
+#endif
+
+namespace d2d { namespace util { namespace simd {
+
+  // Three arrays holding the x, y and z components of a sequence of vectors
+  template<typename numeric_type>
+  struct soa {
+    numeric_type* x;
+    numeric_type* y;
+    numeric_type* z;
+
+    operator soa<numeric_type const>() const
+    {
+      return {x, y, z};
+    }
+  };
+
+  enum class isa {scalar, avx2, avx512};
+
+  namespace scalar {
+    template<typename numeric_type>
+    struct ops {
+      using vec = numeric_type;
+      static constexpr std::size_t width = 1;
+      static vec load(numeric_type const* pPtr) { return *pPtr; }
+      static void store(numeric_type* pPtr, vec pV) { *pPtr = pV; }
+      static vec set1(numeric_type pV) { return pV; }
+      static vec add(vec pA, vec pB) { return pA + pB; }
+      static vec sub(vec pA, vec pB) { return pA - pB; }
+      static vec mul(vec pA, vec pB) { return pA * pB; }
+      static vec div(vec pA, vec pB) { return pA / pB; }
+      static vec sqrt(vec pA) { return std::sqrt(pA); }
+    };
+#include "d2d/util/simd_kernels.inl"
+  }
+
+#if D2D_SIMD_X86
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+  namespace avx2 {
+    template<typename numeric_type> struct ops;
+
+    template<>
+    struct ops<double> {
+      using vec = __m256d;
+      static constexpr std::size_t width = 4;
+      static vec load(double const* pPtr) { return _mm256_loadu_pd(pPtr); }
+      static void store(double* pPtr, vec pV) { _mm256_storeu_pd(pPtr, pV); }
+      static vec set1(double pV) { return _mm256_set1_pd(pV); }
+      static vec add(vec pA, vec pB) { return _mm256_add_pd(pA, pB); }
+      static vec sub(vec pA, vec pB) { return _mm256_sub_pd(pA, pB); }
+      static vec mul(vec pA, vec pB) { return _mm256_mul_pd(pA, pB); }
+      static vec div(vec pA, vec pB) { return _mm256_div_pd(pA, pB); }
+      static vec sqrt(vec pA) { return _mm256_sqrt_pd(pA); }
+    };
+
+    template<>
+    struct ops<float> {
+      using vec = __m256;
+      static constexpr std::size_t width = 8;
+      static vec load(float const* pPtr) { return _mm256_loadu_ps(pPtr); }
+      static void store(float* pPtr, vec pV) { _mm256_storeu_ps(pPtr, pV); }
+      static vec set1(float pV) { return _mm256_set1_ps(pV); }
+      static vec add(vec pA, vec pB) { return _mm256_add_ps(pA, pB); }
+      static vec sub(vec pA, vec pB) { return _mm256_sub_ps(pA, pB); }
+      static vec mul(vec pA, vec pB) { return _mm256_mul_ps(pA, pB); }
+      static vec div(vec pA, vec pB) { return _mm256_div_ps(pA, pB); }
+      static vec sqrt(vec pA) { return _mm256_sqrt_ps(pA); }
+    };
+#include "d2d/util/simd_kernels.inl"
+  }
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+  namespace avx512 {
+    template<typename numeric_type> struct ops;
+
+    template<>
+    struct ops<double> {
+      using vec = __m512d;
+      static constexpr std::size_t width = 8;
+      static vec load(double const* pPtr) { return _mm512_loadu_pd(pPtr); }
+      static void store(double* pPtr, vec pV) { _mm512_storeu_pd(pPtr, pV); }
+      static vec set1(double pV) { return _mm512_set1_pd(pV); }
+      static vec add(vec pA, vec pB) { return _mm512_add_pd(pA, pB); }
+      static vec sub(vec pA, vec pB) { return _mm512_sub_pd(pA, pB); }
+      static vec mul(vec pA, vec pB) { return _mm512_mul_pd(pA, pB); }
+      static vec div(vec pA, vec pB) { return _mm512_div_pd(pA, pB); }
+      static vec sqrt(vec pA) { return _mm512_maskz_sqrt_pd(0xff, pA); }
+    };
+
+    template<>
+    struct ops<float> {
+      using vec = __m512;
+      static constexpr std::size_t width = 16;
+      static vec load(float const* pPtr) { return _mm512_loadu_ps(pPtr); }
+      static void store(float* pPtr, vec pV) { _mm512_storeu_ps(pPtr, pV); }
+      static vec set1(float pV) { return _mm512_set1_ps(pV); }
+      static vec add(vec pA, vec pB) { return _mm512_add_ps(pA, pB); }
+      static vec sub(vec pA, vec pB) { return _mm512_sub_ps(pA, pB); }
+      static vec mul(vec pA, vec pB) { return _mm512_mul_ps(pA, pB); }
+      static vec div(vec pA, vec pB) { return _mm512_div_ps(pA, pB); }
+      static vec sqrt(vec pA) { return _mm512_maskz_sqrt_ps(0xffff, pA); }
+    };
+#include "d2d/util/simd_kernels.inl"
+  }
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif // D2D_SIMD_X86
+
+  inline isa detect_isa()
+  {
+    auto best = isa::scalar;
+#if D2D_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      best = isa::avx512;
+    else if (__builtin_cpu_supports("avx2"))
+      best = isa::avx2;
+#endif
+    // The environment may restrict the selection but not extend it
+    auto const* requested = std::getenv("D2D_SIMD");
+    if (requested != nullptr) {
+      if (std::strcmp(requested, "scalar") == 0)
+        best = isa::scalar;
+      else if (std::strcmp(requested, "avx2") == 0 && best == isa::avx512)
+        best = isa::avx2;
+    }
+    return best;
+  }
+
+  inline isa& isa_setting()
+  {
+    static isa selected = detect_isa();
+    return selected;
+  }
+
+  inline isa get_isa()
+  {
+    return isa_setting();
+  }
+
+  // Restricts the instruction set used by the batch functions. An
+  // instruction set which the CPU does not support is ignored.
+  inline void set_isa(isa pIsa)
+  {
+    auto best = detect_isa();
+    isa_setting() = (int) pIsa < (int) best ? pIsa : best;
+  }
+
+  inline char const* to_string(isa pIsa)
+  {
+    switch (pIsa) {
+    case isa::avx2: return "avx2";
+    case isa::avx512: return "avx512";
+    default: return "scalar";
+    }
+  }
+
+#if D2D_SIMD_X86
+#define D2D_SIMD_DISPATCH(function, ...)             \
+  switch (get_isa()) {                               \
+  case isa::avx512: return avx512::function(__VA_ARGS__); \
+  case isa::avx2: return avx2::function(__VA_ARGS__); \
+  default: return scalar::function(__VA_ARGS__);     \
+  }
+#else
+#define D2D_SIMD_DISPATCH(function, ...)             \
+  return scalar::function(__VA_ARGS__);
+#endif
+
+  template<typename numeric_type>
+  void batch_sum
+  (soa<numeric_type const> pF, soa<numeric_type const> pS,
+   soa<numeric_type> pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(sum<numeric_type>, pF, pS, pOut, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_diff
+  (soa<numeric_type const> pF, soa<numeric_type const> pS,
+   soa<numeric_type> pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(diff<numeric_type>, pF, pS, pOut, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_cross_product
+  (soa<numeric_type const> pF, soa<numeric_type const> pS,
+   soa<numeric_type> pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(cross_product<numeric_type>, pF, pS, pOut, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_compute_normal
+  (soa<numeric_type const> pP0, soa<numeric_type const> pP1,
+   soa<numeric_type const> pP2, soa<numeric_type> pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(compute_normal<numeric_type>, pP0, pP1, pP2, pOut, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_normalize(soa<numeric_type> pV, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(normalize<numeric_type>, pV, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_get_centroid
+  (soa<numeric_type const> pP0, soa<numeric_type const> pP1,
+   soa<numeric_type const> pP2, soa<numeric_type> pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(get_centroid<numeric_type>, pP0, pP1, pP2, pOut, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_distance
+  (soa<numeric_type const> pF, soa<numeric_type const> pS,
+   numeric_type* pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(distance<numeric_type>, pF, pS, pOut, pNum)
+  }
+
+  template<typename numeric_type>
+  void batch_sqrt(numeric_type const* pIn, numeric_type* pOut, std::size_t pNum)
+  {
+    D2D_SIMD_DISPATCH(sqrt<numeric_type>, pIn, pOut, pNum)
+  }
+
+#undef D2D_SIMD_DISPATCH
+}}}
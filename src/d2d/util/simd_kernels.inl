@@ -0,0 +1,183 @@
+// Batch versions of the vector math of utils.hpp on structure-of-arrays
+// data. This file is included by simd.hpp once per instruction set, inside
+// a namespace which provides ops<numeric_type>: the vector type, its width
+// and the arithmetic on it. The kernels use the same sequence of operations
+// as the scalar functions of utils.hpp and no fused multiply-add, hence they
+// compute bit-identical results as long as the compiler does not contract
+// the scalar code either (the build passes -ffp-contract=off).
+//
+// Do not include this file anywhere else.
+
+template<typename numeric_type>
+void sum
+(soa<numeric_type const> pF, soa<numeric_type const> pS,
+ soa<numeric_type> pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    op::store(pOut.x + idx, op::add(op::load(pF.x + idx), op::load(pS.x + idx)));
+    op::store(pOut.y + idx, op::add(op::load(pF.y + idx), op::load(pS.y + idx)));
+    op::store(pOut.z + idx, op::add(op::load(pF.z + idx), op::load(pS.z + idx)));
+  }
+  for (; idx < pNum; ++idx) {
+    pOut.x[idx] = pF.x[idx] + pS.x[idx];
+    pOut.y[idx] = pF.y[idx] + pS.y[idx];
+    pOut.z[idx] = pF.z[idx] + pS.z[idx];
+  }
+}
+
+template<typename numeric_type>
+void diff
+(soa<numeric_type const> pF, soa<numeric_type const> pS,
+ soa<numeric_type> pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    op::store(pOut.x + idx, op::sub(op::load(pF.x + idx), op::load(pS.x + idx)));
+    op::store(pOut.y + idx, op::sub(op::load(pF.y + idx), op::load(pS.y + idx)));
+    op::store(pOut.z + idx, op::sub(op::load(pF.z + idx), op::load(pS.z + idx)));
+  }
+  for (; idx < pNum; ++idx) {
+    pOut.x[idx] = pF.x[idx] - pS.x[idx];
+    pOut.y[idx] = pF.y[idx] - pS.y[idx];
+    pOut.z[idx] = pF.z[idx] - pS.z[idx];
+  }
+}
+
+template<typename numeric_type>
+void cross_product
+(soa<numeric_type const> pF, soa<numeric_type const> pS,
+ soa<numeric_type> pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    auto fx = op::load(pF.x + idx), fy = op::load(pF.y + idx), fz = op::load(pF.z + idx);
+    auto sx = op::load(pS.x + idx), sy = op::load(pS.y + idx), sz = op::load(pS.z + idx);
+    op::store(pOut.x + idx, op::sub(op::mul(fy, sz), op::mul(fz, sy)));
+    op::store(pOut.y + idx, op::sub(op::mul(fz, sx), op::mul(fx, sz)));
+    op::store(pOut.z + idx, op::sub(op::mul(fx, sy), op::mul(fy, sx)));
+  }
+  for (; idx < pNum; ++idx) {
+    auto fx = pF.x[idx], fy = pF.y[idx], fz = pF.z[idx];
+    auto sx = pS.x[idx], sy = pS.y[idx], sz = pS.z[idx];
+    pOut.x[idx] = fy * sz - fz * sy;
+    pOut.y[idx] = fz * sx - fx * sz;
+    pOut.z[idx] = fx * sy - fy * sx;
+  }
+}
+
+// The (not normalized) normals of the triangles (pP0[i], pP1[i], pP2[i])
+template<typename numeric_type>
+void compute_normal
+(soa<numeric_type const> pP0, soa<numeric_type const> pP1,
+ soa<numeric_type const> pP2, soa<numeric_type> pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    auto x0 = op::load(pP0.x + idx), y0 = op::load(pP0.y + idx), z0 = op::load(pP0.z + idx);
+    auto ux = op::sub(op::load(pP1.x + idx), x0);
+    auto uy = op::sub(op::load(pP1.y + idx), y0);
+    auto uz = op::sub(op::load(pP1.z + idx), z0);
+    auto vx = op::sub(op::load(pP2.x + idx), x0);
+    auto vy = op::sub(op::load(pP2.y + idx), y0);
+    auto vz = op::sub(op::load(pP2.z + idx), z0);
+    op::store(pOut.x + idx, op::sub(op::mul(uy, vz), op::mul(uz, vy)));
+    op::store(pOut.y + idx, op::sub(op::mul(uz, vx), op::mul(ux, vz)));
+    op::store(pOut.z + idx, op::sub(op::mul(ux, vy), op::mul(uy, vx)));
+  }
+  for (; idx < pNum; ++idx) {
+    auto ux = pP1.x[idx] - pP0.x[idx];
+    auto uy = pP1.y[idx] - pP0.y[idx];
+    auto uz = pP1.z[idx] - pP0.z[idx];
+    auto vx = pP2.x[idx] - pP0.x[idx];
+    auto vy = pP2.y[idx] - pP0.y[idx];
+    auto vz = pP2.z[idx] - pP0.z[idx];
+    pOut.x[idx] = uy * vz - uz * vy;
+    pOut.y[idx] = uz * vx - ux * vz;
+    pOut.z[idx] = ux * vy - uy * vx;
+  }
+}
+
+// Normalizes the vectors in place
+template<typename numeric_type>
+void normalize(soa<numeric_type> pV, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    auto xx = op::load(pV.x + idx), yy = op::load(pV.y + idx), zz = op::load(pV.z + idx);
+    auto norm = op::sqrt(op::add(op::add(op::mul(xx, xx), op::mul(yy, yy)),
+                                 op::mul(zz, zz)));
+    op::store(pV.x + idx, op::div(xx, norm));
+    op::store(pV.y + idx, op::div(yy, norm));
+    op::store(pV.z + idx, op::div(zz, norm));
+  }
+  for (; idx < pNum; ++idx) {
+    auto xx = pV.x[idx], yy = pV.y[idx], zz = pV.z[idx];
+    auto norm = std::sqrt(xx * xx + yy * yy + zz * zz);
+    pV.x[idx] = xx / norm;
+    pV.y[idx] = yy / norm;
+    pV.z[idx] = zz / norm;
+  }
+}
+
+// The centroids of the triangles (pP0[i], pP1[i], pP2[i])
+template<typename numeric_type>
+void get_centroid
+(soa<numeric_type const> pP0, soa<numeric_type const> pP1,
+ soa<numeric_type const> pP2, soa<numeric_type> pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  auto three = op::set1(3);
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    op::store(pOut.x + idx, op::div(op::add(op::add(op::load(pP0.x + idx), op::load(pP1.x + idx)),
+                                            op::load(pP2.x + idx)), three));
+    op::store(pOut.y + idx, op::div(op::add(op::add(op::load(pP0.y + idx), op::load(pP1.y + idx)),
+                                            op::load(pP2.y + idx)), three));
+    op::store(pOut.z + idx, op::div(op::add(op::add(op::load(pP0.z + idx), op::load(pP1.z + idx)),
+                                            op::load(pP2.z + idx)), three));
+  }
+  for (; idx < pNum; ++idx) {
+    pOut.x[idx] = (pP0.x[idx] + pP1.x[idx] + pP2.x[idx]) / 3;
+    pOut.y[idx] = (pP0.y[idx] + pP1.y[idx] + pP2.y[idx]) / 3;
+    pOut.z[idx] = (pP0.z[idx] + pP1.z[idx] + pP2.z[idx]) / 3;
+  }
+}
+
+template<typename numeric_type>
+void distance
+(soa<numeric_type const> pF, soa<numeric_type const> pS,
+ numeric_type* pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width) {
+    auto dx = op::sub(op::load(pF.x + idx), op::load(pS.x + idx));
+    auto dy = op::sub(op::load(pF.y + idx), op::load(pS.y + idx));
+    auto dz = op::sub(op::load(pF.z + idx), op::load(pS.z + idx));
+    op::store(pOut + idx, op::sqrt(op::add(op::add(op::mul(dx, dx), op::mul(dy, dy)),
+                                           op::mul(dz, dz))));
+  }
+  for (; idx < pNum; ++idx) {
+    auto dx = pF.x[idx] - pS.x[idx];
+    auto dy = pF.y[idx] - pS.y[idx];
+    auto dz = pF.z[idx] - pS.z[idx];
+    pOut[idx] = std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+}
+
+template<typename numeric_type>
+void sqrt(numeric_type const* pIn, numeric_type* pOut, std::size_t pNum)
+{
+  using op = ops<numeric_type>;
+  std::size_t idx = 0;
+  for (; idx + op::width <= pNum; idx += op::width)
+    op::store(pOut + idx, op::sqrt(op::load(pIn + idx)));
+  for (; idx < pNum; ++idx)
+    pOut[idx] = std::sqrt(pIn[idx]);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Standard input and output in place of files. The file name "-" stands
+// for stdin (inputs) or stdout (outputs), so the tools can be used in shell
+// pipelines without intermediate files.
+
+namespace d2d { namespace util { namespace stdio {
+
+  inline bool is_stdio(std::string const& pFilePath)
+  {
+    return pFilePath == "-";
+  }
+
+  // Reads up to pSize bytes from pFd; returns 0 at EOF
+  inline std::size_t read_some(int pFd, char* pBuffer, std::size_t pSize)
+  {
+    while (true) {
+      auto count = ::read(pFd, pBuffer, pSize);
+      if (count >= 0)
+        return (std::size_t) count;
+      if (errno != EINTR)
+        throw std::runtime_error(std::string {"Could not read stdin: "} + std::strerror(errno));
+    }
+  }
+
+  // Reads with pRead(buffer, size) (which returns the number of bytes read,
+  // 0 at EOF) and calls pFun(begin, end) for the complete lines read so far
+  // whenever at least pMinBytes of them have arrived (and for the rest at
+  // the end; the last line need not end in a line break). The input is
+  // processed while the producer is still writing it; only the unprocessed
+  // part is held in memory. Returns the number of bytes read.
+  template<typename read_function, typename function_type>
+  uint64_t read_lines(read_function pRead, std::size_t pMinBytes, function_type pFun)
+  {
+    auto buffer = std::vector<char> (std::max<std::size_t>(pMinBytes, 1 << 16) * 2);
+    std::size_t filled = 0;
+    uint64_t total = 0;
+    while (true) {
+      if (filled == buffer.size())
+        buffer.resize(2 * buffer.size()); // a very long line
+      auto count = pRead(buffer.data() + filled, buffer.size() - filled);
+      if (count == 0)
+        break;
+      filled += count;
+      total += count;
+      if (filled < pMinBytes)
+        continue;
+      auto lastbreak = std::find(std::reverse_iterator<char*>(buffer.data() + filled),
+                                 std::reverse_iterator<char*>(buffer.data()), '\n');
+      auto lineend = lastbreak.base();
+      if (lineend == buffer.data())
+        continue;
+      pFun(static_cast<char const*>(buffer.data()), static_cast<char const*>(lineend));
+      filled = (std::size_t) (buffer.data() + filled - lineend);
+      std::memmove(buffer.data(), lineend, filled);
+    }
+    if (filled > 0)
+      pFun(static_cast<char const*>(buffer.data()),
+           static_cast<char const*>(buffer.data() + filled));
+    return total;
+  }
+
+  // Reads from pFd until EOF, for formats which have to be parsed as a whole
+  inline std::vector<char> read_all(int pFd)
+  {
+    auto result = std::vector<char> {};
+    std::size_t filled = 0;
+    while (true) {
+      if (filled == result.size())
+        result.resize(std::max<std::size_t>(1 << 20, 2 * result.size()));
+      auto count = read_some(pFd, result.data() + filled, result.size() - filled);
+      if (count == 0)
+        break;
+      filled += count;
+    }
+    result.resize(filled);
+    return result;
+  }
+}}}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "d2d/util/utils.hpp"
+
+// Deterministic synthetic inputs for benchmarks and scaling runs. Every
+// value is a function of the seed and the index of the point (or vertex)
+// only, so that any range of a data set can be generated independently and
+// in parallel, and the same seed always gives the same data set.
+
+namespace d2d { namespace util { namespace synthetic {
+
+  // The SplitMix64 generator
+  class random {
+  public:
+    random(uint64_t pSeed) :
+      mState(pSeed) {}
+
+    // A generator for item pIdx of the data set of pSeed
+    random(uint64_t pSeed, uint64_t pIdx) :
+      mState(pSeed ^ (pIdx * 0x9e3779b97f4a7c15ULL))
+    {
+      next();
+    }
+
+    uint64_t next()
+    {
+      auto zz = (mState += 0x9e3779b97f4a7c15ULL);
+      zz = (zz ^ (zz >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      zz = (zz ^ (zz >> 27)) * 0x94d049bb133111ebULL;
+      return zz ^ (zz >> 31);
+    }
+
+    // Uniform in [0, 1)
+    double uniform()
+    {
+      return (double) (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+  private:
+    uint64_t mState;
+  };
+
+  // Appends the DSV rows [pFirst, pLast) of the data set of pSeed to pOut.
+  // The points lie on a sphere of radius 100; their normals point outwards.
+  // About one in ten points is flagged as covered.
+  inline void
+  append_dsv_rows(std::string& pOut, uint64_t pSeed, std::size_t pFirst, std::size_t pLast)
+  {
+    char buffer[256];
+    for (auto idx = pFirst; idx < pLast; ++idx) {
+      auto rand = random {pSeed, idx};
+      auto zz = 2 * rand.uniform() - 1;
+      auto phi = 6.283185307179586 * rand.uniform();
+      auto rr = std::sqrt(1 - zz * zz);
+      auto nx = rr * std::cos(phi);
+      auto ny = rr * std::sin(phi);
+      auto area = 0.01 + rand.uniform();
+      auto matid = (int) (rand.next() % 4);
+      auto cover = rand.uniform() < 0.1 ? 1 : 0;
+      auto len = std::snprintf
+        (buffer, sizeof(buffer), "%.10g %.10g %.10g %.10g %.10g %.10g %d %.10g %d\n",
+         100 * nx, 100 * ny, 100 * zz, nx, ny, zz, matid, area, cover);
+      pOut.append(buffer, (std::size_t) len);
+    }
+  }
+
+  // A triangulated height field of nx times ny vertices. The vertices are
+  // numbered row by row; each grid cell is split into two triangles.
+  template<typename numeric_type>
+  class surface_grid {
+  public:
+
+    // The grid is about square and has at least pNumVertices vertices
+    static surface_grid with_vertices(uint64_t pSeed, std::size_t pNumVertices)
+    {
+      auto nx = std::max<std::size_t>
+        (2, (std::size_t) std::ceil(std::sqrt((double) pNumVertices)));
+      auto ny = std::max<std::size_t>(2, (pNumVertices + nx - 1) / nx);
+      return surface_grid {pSeed, nx, ny};
+    }
+
+    surface_grid(uint64_t pSeed, std::size_t pNx, std::size_t pNy) :
+      mSeed(pSeed), mNx(pNx), mNy(pNy) {}
+
+    std::size_t num_vertices() const
+    {
+      return mNx * mNy;
+    }
+
+    std::size_t num_triangles() const
+    {
+      return 2 * (mNx - 1) * (mNy - 1);
+    }
+
+    d2d::util::triple<numeric_type> get_vertex(std::size_t pIdx) const
+    {
+      auto ii = (double) (pIdx % mNx);
+      auto jj = (double) (pIdx / mNx);
+      // A little jitter keeps the triangles from being all alike
+      auto rand = random {mSeed, pIdx};
+      return {(numeric_type) (ii + 0.25 * (rand.uniform() - 0.5)),
+              (numeric_type) (jj + 0.25 * (rand.uniform() - 0.5)),
+              (numeric_type) (8 * std::sin(0.05 * ii) * std::cos(0.05 * jj))};
+    }
+
+    d2d::util::triple<std::size_t> get_triangle(std::size_t pIdx) const
+    {
+      auto cell = pIdx / 2;
+      auto ii = cell % (mNx - 1);
+      auto jj = cell / (mNx - 1);
+      auto corner = jj * mNx + ii;
+      if (pIdx % 2 == 0)
+        return {corner, corner + 1, corner + mNx + 1};
+      return {corner, corner + mNx + 1, corner + mNx};
+    }
+
+    std::vector<d2d::util::triple<numeric_type> > get_vertices() const
+    {
+      auto result = std::vector<d2d::util::triple<numeric_type> > (num_vertices());
+      for (std::size_t idx = 0; idx < result.size(); ++idx)
+        result[idx] = get_vertex(idx);
+      return result;
+    }
+
+    std::vector<d2d::util::triple<std::size_t> > get_triangles() const
+    {
+      auto result = std::vector<d2d::util::triple<std::size_t> > (num_triangles());
+      for (std::size_t idx = 0; idx < result.size(); ++idx)
+        result[idx] = get_triangle(idx);
+      return result;
+    }
+
+  private:
+    uint64_t mSeed;
+    std::size_t mNx;
+    std::size_t mNy;
+  };
+}}}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace d2d { namespace util {
+
+  // A fixed number of worker threads which run submitted tasks. The queue of
+  // waiting tasks is bounded; submit() blocks while it is full. Tasks must
+  // not throw (catch inside the task if needed).
+  class thread_pool {
+  public:
+
+    thread_pool(std::size_t pNumThreads, std::size_t pQueueCapacity = 0) :
+      mCapacity(pQueueCapacity == 0 ? 2 * std::max<std::size_t>(1, pNumThreads) : pQueueCapacity)
+    {
+      pNumThreads = std::max<std::size_t>(1, pNumThreads);
+      mWorkers.reserve(pNumThreads);
+      for (std::size_t idx = 0; idx < pNumThreads; ++idx)
+        mWorkers.emplace_back([this] { work(); });
+    }
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    ~thread_pool()
+    {
+      {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mStop = true;
+      }
+      mTaskAvailable.notify_all();
+      for (auto& worker : mWorkers)
+        worker.join();
+    }
+
+    std::size_t size() const
+    {
+      return mWorkers.size();
+    }
+
+    void submit(std::function<void()> pTask)
+    {
+      std::unique_lock<std::mutex> lock {mMutex};
+      mSpaceAvailable.wait(lock, [this] { return mTasks.size() < mCapacity; });
+      mTasks.push_back(std::move(pTask));
+      ++mNumPending;
+      lock.unlock();
+      mTaskAvailable.notify_one();
+    }
+
+    // Blocks until all submitted tasks have finished
+    void wait()
+    {
+      std::unique_lock<std::mutex> lock {mMutex};
+      mAllDone.wait(lock, [this] { return mNumPending == 0; });
+    }
+
+  private:
+    void work()
+    {
+      while (true) {
+        std::unique_lock<std::mutex> lock {mMutex};
+        mTaskAvailable.wait(lock, [this] { return mStop || !mTasks.empty(); });
+        if (mTasks.empty())
+          return; // stopped
+        auto task = std::move(mTasks.front());
+        mTasks.pop_front();
+        lock.unlock();
+        mSpaceAvailable.notify_one();
+        task();
+        lock.lock();
+        if (--mNumPending == 0)
+          mAllDone.notify_all();
+      }
+    }
+
+  private:
+    std::size_t mCapacity;
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()> > mTasks;
+    std::size_t mNumPending = 0;
+    bool mStop = false;
+    std::mutex mMutex;
+    std::condition_variable mTaskAvailable;
+    std::condition_variable mSpaceAvailable;
+    std::condition_variable mAllDone;
+  };
+}}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/clo.hpp"
+
+// Time series (--time-series). A list names the input of every step in
+// order; each step is converted to its own file and the files are collected
+// in a ParaView .pvd file. The steps are read and written in a pipeline:
+// step N+1 is read while step N is written, hence two steps are in memory
+// at a time.
+
+namespace d2d { namespace util { namespace series {
+
+  struct step {
+    std::string input;
+    double time = 0;
+  };
+
+  // Reads a list with one step per line: the input file, optionally followed
+  // by the time of the step (default: the number of the step). Empty lines
+  // and lines starting with # are ignored.
+  inline std::vector<step> read_list(std::string const& pFilePath)
+  {
+    auto file = std::ifstream {pFilePath};
+    if (!file)
+      throw std::runtime_error("Could not open time series " + pFilePath);
+    auto result = std::vector<step> {};
+    auto line = std::string {};
+    for (std::size_t linenum = 1; std::getline(file, line); ++linenum) {
+      auto stream = std::istringstream {line};
+      auto ss = step {};
+      if (!(stream >> ss.input) || ss.input[0] == '#')
+        continue;
+      ss.time = (double) result.size();
+      auto time = std::string {};
+      if (stream >> time) {
+        try {
+          ss.time = std::stod(time);
+        } catch (std::exception const&) {
+          throw std::runtime_error
+            ("Invalid time in line " + std::to_string(linenum) + " of " + pFilePath);
+        }
+      }
+      result.push_back(ss);
+    }
+    if (result.empty())
+      throw std::runtime_error("No steps in time series " + pFilePath);
+    return result;
+  }
+
+  // The output file of step pIdx for the collection pPvdFileName, e.g.,
+  // flow_007.vtp for flow.pvd. The number is padded to the width of the
+  // largest one.
+  inline std::string
+  get_step_file_name(std::string const& pPvdFileName, std::size_t pIdx, std::size_t pNumSteps)
+  {
+    auto stem = pPvdFileName;
+    if (stem.size() > 4 && stem.compare(stem.size() - 4, 4, ".pvd") == 0)
+      stem.erase(stem.size() - 4);
+    auto width = std::to_string(pNumSteps > 0 ? pNumSteps - 1 : 0).size();
+    auto number = std::to_string(pIdx);
+    return stem + "_" + std::string(width - std::min(width, number.size()), '0') + number +
+      ".vtp";
+  }
+
+  // Writes the collection of the files of the steps. The files are
+  // referenced relative to the .pvd file, next to which they are written.
+  inline void write_pvd
+  (std::string const& pPvdFileName, std::vector<step> const& pSteps,
+   std::vector<std::string> const& pFiles)
+  {
+    auto file = std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+      {std::fopen(pPvdFileName.c_str(), "w"), &std::fclose};
+    if (!file)
+      throw std::runtime_error("Could not open " + pPvdFileName + " for writing");
+    std::fprintf(file.get(),
+                 "<?xml version=\"1.0\"?>\n"
+                 "<VTKFile type=\"Collection\" version=\"0.1\" byte_order=\"LittleEndian\">\n"
+                 "  <Collection>\n");
+    for (std::size_t idx = 0; idx < pSteps.size(); ++idx) {
+      auto name = pFiles[idx];
+      auto slash = name.find_last_of('/');
+      if (slash != std::string::npos)
+        name.erase(0, slash + 1);
+      std::fprintf(file.get(),
+                   "    <DataSet timestep=\"%.17g\" group=\"\" part=\"0\" file=\"%s\"/>\n",
+                   pSteps[idx].time, name.c_str());
+    }
+    std::fprintf(file.get(), "  </Collection>\n</VTKFile>\n");
+    if (std::fflush(file.get()) != 0)
+      throw std::runtime_error("Could not write " + pPvdFileName);
+  }
+
+  // Calls pWrite(idx, pRead(idx)) for all the steps in order. pRead(idx + 1)
+  // runs on another thread while pWrite(idx, ...) runs. Exceptions of either
+  // are rethrown.
+  template<typename read_function, typename write_function>
+  void run(std::size_t pNumSteps, read_function pRead, write_function pWrite)
+  {
+    if (pNumSteps == 0)
+      return;
+    auto current = pRead(0);
+    for (std::size_t idx = 0; idx < pNumSteps; ++idx) {
+      auto next = std::future<decltype(pRead(0))> {};
+      if (idx + 1 < pNumSteps)
+        next = std::async(std::launch::async, pRead, idx + 1);
+      pWrite(idx, current);
+      if (next.valid())
+        current = next.get();
+    }
+  }
+
+  inline void add_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"TIME_SERIES", {"--time-series"},
+                           "converts the steps listed in the given file (one input per line, optionally"
+                           " followed by its time) into the .pvd collection given by --outfile"});
+  }
+
+  inline bool is_requested(d2d::util::clo::manager& pOptMan)
+  {
+    return !pOptMan.get_string_option_value("TIME_SERIES").empty();
+  }
+
+  inline std::vector<step> read_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    return read_list(pOptMan.get_string_option_value("TIME_SERIES"));
+  }
+}}}
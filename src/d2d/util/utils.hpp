@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cassert>
 #include <cmath>
 #include <functional>
 #include <iostream>
@@ -73,9 +74,10 @@ namespace d2d { namespace util {
   bool is_normalized(triple<numeric_type> const& pV)
   {
     auto epsilon = 1e-6f;
-    numeric_type length =
-      std::sqrt(pV[0] * pV[0] + pV[1] * pV[1] + pV[2] * pV[2]);
-    return 1-epsilon <= length && length <= 1+epsilon;
+    // Comparing the squared length saves a square root
+    numeric_type lengthsq = pV[0] * pV[0] + pV[1] * pV[1] + pV[2] * pV[2];
+    return (1-epsilon) * (1-epsilon) <= lengthsq &&
+      lengthsq <= (1+epsilon) * (1+epsilon);
   }
 
   // This function modifies its argument when called
@@ -87,11 +89,14 @@ namespace d2d { namespace util {
     pV[0] /= thrdNorm;
     pV[1] /= thrdNorm;
     pV[2] /= thrdNorm;
-    if ( ! is_normalized(pV) )
+#ifndef NDEBUG
+    if ( ! is_normalized(pV) ) {
       std::cerr
         << "Warning: Assertion error is about to happen. thrdNorm == "
         << thrdNorm << std::endl;
-    assert( is_normalized(pV) && "Postcondition" );
+      assert( false && "Postcondition" );
+    }
+#endif
   }
 
   // Input: a triple of triples where each inner triple holds the x, y
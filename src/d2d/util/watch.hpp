@@ -0,0 +1,393 @@
+#pragma once
+
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/batch.hpp"
+#include "d2d/util/clo.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/thread_pool.hpp"
+
+// Watch mode (--watch). The process stays alive and converts every file
+// which is written to (or moved into) one of the watched directories, on a
+// pool of workers which keep their state warm (VTK, the Gmsh session). A
+// file is picked up only when it is closed after writing (IN_CLOSE_WRITE)
+// or moved into place (IN_MOVED_TO), never while it is half written. The
+// queue depth and the latencies from the event to the finished output are
+// written to a status file after every change. SIGINT or SIGTERM stop the
+// watching; the queued files are converted before the process exits.
+
+namespace d2d { namespace util { namespace watch {
+
+  namespace detail {
+
+    inline std::atomic<bool>& stop_requested()
+    {
+      static std::atomic<bool> stop {false};
+      return stop;
+    }
+
+    inline void on_signal(int)
+    {
+      stop_requested().store(true);
+    }
+
+    inline bool has_extension(std::string const& pName, std::vector<std::string> const& pExtensions)
+    {
+      for (auto const& ext : pExtensions)
+        if (pName.size() > ext.size() &&
+            pName.compare(pName.size() - ext.size(), ext.size(), ext) == 0)
+          return true;
+      return false;
+    }
+
+    // Nanoseconds; -1 if the file does not exist
+    inline int64_t get_mtime(std::string const& pFilePath)
+    {
+      struct stat filestat;
+      if (::stat(pFilePath.c_str(), &filestat) != 0)
+        return -1;
+      return (int64_t) filestat.st_mtim.tv_sec * 1000000000 + filestat.st_mtim.tv_nsec;
+    }
+  }
+
+  // The counters of the status file
+  struct counters {
+    std::size_t queued = 0;
+    std::size_t running = 0;
+    std::size_t converted = 0;
+    std::size_t failed = 0;
+    // Seconds from the event to the finished output, and the part of it
+    // spent waiting in the queue
+    double lastlatency = 0;
+    double totallatency = 0;
+    double maxlatency = 0;
+    double totalwait = 0;
+  };
+
+  class directory_watcher {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    // Converts the files ending in one of pExtensions to files ending in
+    // pOutExtension (see d2d::util::batch::get_output_file_name())
+    directory_watcher
+    (std::vector<std::string> pDirs,
+     std::vector<std::string> pExtensions,
+     std::string pOutDir,
+     std::string pOutExtension,
+     std::string pStatusFile) :
+      mDirs(std::move(pDirs)),
+      mExtensions(std::move(pExtensions)),
+      mOutDir(std::move(pOutDir)),
+      mOutExtension(std::move(pOutExtension)),
+      mStatusFile(std::move(pStatusFile)),
+      mStart(clock::now())
+    {
+      mFd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+      if (mFd < 0)
+        throw std::runtime_error(std::string {"Could not initialize inotify: "} + std::strerror(errno));
+      for (auto& dir : mDirs) {
+        while (dir.size() > 1 && dir.back() == '/')
+          dir.pop_back();
+        auto wd = ::inotify_add_watch(mFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+          ::close(mFd);
+          throw std::runtime_error("Could not watch " + dir + ": " + std::strerror(errno));
+        }
+        mWatches[wd] = dir;
+      }
+    }
+
+    directory_watcher(directory_watcher const&) = delete;
+    directory_watcher& operator=(directory_watcher const&) = delete;
+
+    ~directory_watcher()
+    {
+      ::close(mFd);
+    }
+
+    // Runs pConvert(input, output) on pNumWorkers workers for the files
+    // present at the start whose output is missing or older and for all the
+    // files written later, until SIGINT or SIGTERM
+    template<typename function_type>
+    void run(std::size_t pNumWorkers, function_type pConvert)
+    {
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_handler = &detail::on_signal;
+      sigemptyset(&action.sa_mask);
+      ::sigaction(SIGINT, &action, nullptr);
+      ::sigaction(SIGTERM, &action, nullptr);
+
+      pNumWorkers = std::max<std::size_t>(1, pNumWorkers);
+      auto numthreads = d2d::util::parallel::get_num_threads();
+      d2d::util::parallel::set_num_threads(std::max<std::size_t>(1, numthreads / pNumWorkers));
+      {
+        // Without a bound on the queue the event loop never blocks
+        d2d::util::thread_pool pool {pNumWorkers, std::size_t(-1) / 2};
+        mSubmit = [this, &pool, &pConvert](std::string const& pInput) {
+          pool.submit([this, &pConvert, pInput] { convert(pConvert, pInput); });
+        };
+        for (auto const& input : scan())
+          enqueue(input);
+        std::cout << "Watching " << mDirs.size() << " director" << (mDirs.size() == 1 ? "y" : "ies")
+                  << " for " << join(mExtensions) << " files" << std::endl;
+        alignas(struct inotify_event) char buffer[64 * 1024];
+        while (!detail::stop_requested().load()) {
+          struct pollfd pfd {mFd, POLLIN, 0};
+          auto ready = ::poll(&pfd, 1, 1000);
+          if (ready < 0 && errno != EINTR)
+            throw std::runtime_error(std::string {"poll failed: "} + std::strerror(errno));
+          if (ready <= 0)
+            continue;
+          auto length = ::read(mFd, buffer, sizeof(buffer));
+          for (auto pos = (ssize_t) 0; pos < length; ) {
+            auto event = reinterpret_cast<struct inotify_event const*>(buffer + pos);
+            pos += sizeof(struct inotify_event) + event->len;
+            // Events were lost; the files written meanwhile have older outputs
+            if (event->mask & IN_Q_OVERFLOW) {
+              for (auto const& input : scan())
+                enqueue(input);
+              continue;
+            }
+            if (event->len == 0 || (event->mask & IN_ISDIR))
+              continue;
+            auto name = std::string {event->name};
+            if (name[0] == '.' || !detail::has_extension(name, mExtensions))
+              continue;
+            enqueue(mWatches[event->wd] + "/" + name);
+          }
+        }
+        std::cout << "Stopping; converting " << get_counters().queued << " queued file(s)"
+                  << std::endl;
+        pool.wait();
+        mSubmit = nullptr;
+      }
+      d2d::util::parallel::set_num_threads(numthreads);
+      std::lock_guard<std::mutex> lock {mMutex};
+      write_status();
+    }
+
+    counters get_counters() const
+    {
+      std::lock_guard<std::mutex> lock {mMutex};
+      return mCounters;
+    }
+
+  private:
+    // Queues a conversion of pInput. A file which is queued already is
+    // converted once; a file which is being converted is queued again when
+    // its conversion has finished (two conversions of a file never run at
+    // the same time).
+    void enqueue(std::string const& pInput)
+    {
+      std::lock_guard<std::mutex> lock {mMutex};
+      if (mRunning.count(pInput) > 0) {
+        mAgain.insert(pInput);
+        return;
+      }
+      if (!mQueued.emplace(pInput, clock::now()).second)
+        return;
+      ++mCounters.queued;
+      write_status();
+      mSubmit(pInput);
+    }
+
+    template<typename function_type>
+    void convert
+    (function_type& pConvert, std::string const& pInput)
+    {
+      auto output = d2d::util::batch::get_output_file_name(pInput, mOutDir, mOutExtension);
+      auto startedat = clock::now();
+      auto queuedat = startedat;
+      {
+        std::lock_guard<std::mutex> lock {mMutex};
+        queuedat = mQueued.at(pInput);
+        mQueued.erase(pInput);
+        mRunning.insert(pInput);
+        --mCounters.queued;
+        ++mCounters.running;
+        write_status();
+      }
+      auto failure = std::string {};
+      try {
+        pConvert(pInput, output);
+      } catch (std::exception const& ee) {
+        failure = ee.what();
+      }
+      auto finishedat = clock::now();
+      auto latency = std::chrono::duration<double>(finishedat - queuedat).count();
+      auto wait = std::chrono::duration<double>(startedat - queuedat).count();
+      auto again = false;
+      {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mRunning.erase(pInput);
+        again = mAgain.erase(pInput) > 0;
+        --mCounters.running;
+        if (failure.empty()) {
+          ++mCounters.converted;
+          mCounters.lastlatency = latency;
+          mCounters.totallatency += latency;
+          mCounters.maxlatency = std::max(mCounters.maxlatency, latency);
+          mCounters.totalwait += wait;
+          std::cout << "Converted " << pInput << " to " << output << " in " << latency << " s"
+                    << std::endl;
+        } else {
+          ++mCounters.failed;
+          std::cerr << "Error: " << pInput << ": " << failure << std::endl;
+        }
+        write_status();
+      }
+      if (again)
+        enqueue(pInput);
+    }
+
+    // The files in the directories whose output is missing or older
+    std::vector<std::string> scan() const
+    {
+      auto result = std::vector<std::string> {};
+      for (auto const& dir : mDirs) {
+        auto handle = std::unique_ptr<DIR, int (*)(DIR*)> {::opendir(dir.c_str()), &::closedir};
+        if (!handle)
+          continue;
+        auto names = std::vector<std::string> {};
+        while (auto entry = ::readdir(handle.get())) {
+          auto name = std::string {entry->d_name};
+          if (name[0] != '.' && detail::has_extension(name, mExtensions))
+            names.push_back(name);
+        }
+        std::sort(names.begin(), names.end());
+        for (auto const& name : names) {
+          auto input = dir + "/" + name;
+          auto output = d2d::util::batch::get_output_file_name(input, mOutDir, mOutExtension);
+          if (detail::get_mtime(output) < detail::get_mtime(input))
+            result.push_back(input);
+        }
+      }
+      return result;
+    }
+
+    // Writes the counters as JSON; the file is replaced, so readers never
+    // see a partial one. Requires mMutex to be held.
+    void write_status() const
+    {
+      if (mStatusFile.empty())
+        return;
+      auto tmpname = mStatusFile + ".tmp";
+      auto file = std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+        {std::fopen(tmpname.c_str(), "w"), &std::fclose};
+      if (!file)
+        return;
+      auto const& cc = mCounters;
+      auto numdone = std::max<std::size_t>(1, cc.converted);
+      std::fprintf
+        (file.get(),
+         "{\n"
+         "  \"uptime\": %.3f,\n"
+         "  \"queued\": %zu,\n"
+         "  \"running\": %zu,\n"
+         "  \"converted\": %zu,\n"
+         "  \"failed\": %zu,\n"
+         "  \"latency\": {\"last\": %.6f, \"mean\": %.6f, \"max\": %.6f, \"mean_wait\": %.6f}\n"
+         "}\n",
+         std::chrono::duration<double>(clock::now() - mStart).count(),
+         cc.queued, cc.running, cc.converted, cc.failed,
+         cc.lastlatency, cc.totallatency / numdone, cc.maxlatency, cc.totalwait / numdone);
+      file.reset();
+      std::rename(tmpname.c_str(), mStatusFile.c_str());
+    }
+
+    static std::string join(std::vector<std::string> const& pValues)
+    {
+      auto result = std::string {};
+      for (auto const& value : pValues)
+        result += (result.empty() ? "" : ", ") + value;
+      return result;
+    }
+
+    std::vector<std::string> mDirs;
+    std::vector<std::string> mExtensions;
+    std::string mOutDir;
+    std::string mOutExtension;
+    std::string mStatusFile;
+    clock::time_point mStart;
+    int mFd = -1;
+    std::map<int, std::string> mWatches;
+    std::function<void(std::string const&)> mSubmit;
+    mutable std::mutex mMutex;
+    // The files waiting (with the time of their event), the ones being
+    // converted and the ones written again meanwhile
+    std::map<std::string, clock::time_point> mQueued;
+    std::set<std::string> mRunning;
+    std::set<std::string> mAgain;
+    counters mCounters;
+  };
+
+  inline void add_cml_params(d2d::util::clo::manager& pOptMan)
+  {
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"WATCH", {"--watch"},
+                           "keeps running and converts the files written to the given directories"
+                           " (separated by commas) as soon as they are closed; see also --outdir and --jobs"});
+    pOptMan.addCmlParam(d2d::util::clo::string_option
+                        {"STATUS_FILE", {"--status-file"},
+                           "writes the queue depth and latencies of --watch as JSON to the given file"});
+  }
+
+  inline bool is_requested(d2d::util::clo::manager& pOptMan)
+  {
+    return !pOptMan.get_string_option_value("WATCH").empty();
+  }
+
+  inline std::vector<std::string> get_directories(d2d::util::clo::manager& pOptMan)
+  {
+    auto result = std::vector<std::string> {};
+    auto value = pOptMan.get_string_option_value("WATCH");
+    std::size_t first = 0;
+    while (first <= value.size()) {
+      auto comma = std::min(value.find(',', first), value.size());
+      if (comma > first)
+        result.push_back(value.substr(first, comma - first));
+      first = comma + 1;
+    }
+    return result;
+  }
+
+  // Watches the directories given by --watch until SIGINT or SIGTERM
+  template<typename function_type>
+  void run
+  (d2d::util::clo::manager& pOptMan, std::vector<std::string> const& pExtensions,
+   std::string const& pOutExtension, function_type pConvert)
+  {
+    directory_watcher watcher
+      {get_directories(pOptMan), pExtensions, pOptMan.get_string_option_value("OUTDIR"),
+       pOutExtension, pOptMan.get_string_option_value("STATUS_FILE")};
+    watcher.run(d2d::util::batch::get_num_jobs(pOptMan), pConvert);
+    auto cc = watcher.get_counters();
+    std::cout << "Converted " << cc.converted << " file(s)";
+    if (cc.failed > 0)
+      std::cout << " (" << cc.failed << " failed)";
+    std::cout << std::endl;
+  }
+}}}
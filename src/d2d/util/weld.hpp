@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "d2d/util/array_view.hpp"
+#include "d2d/util/parallel.hpp"
+#include "d2d/util/profile.hpp"
+#include "d2d/util/radix_sort.hpp"
+#include "d2d/util/utils.hpp"
+
+// Welding of near-coincident vertices. The vertices are hashed into a grid
+// of cells as large as the tolerance, such that all vertices within the
+// tolerance of a vertex lie in its cell or in one of the 26 neighbouring
+// cells. Each vertex is welded to the vertex of lowest index within the
+// tolerance (which in turn may be welded to a vertex of even lower index).
+// The search runs in parallel; the result does not depend on the number of
+// threads.
+
+namespace d2d { namespace util {
+
+  struct weld_result {
+    // The new index of each original vertex
+    std::vector<std::size_t> remap;
+    // The original index of each new vertex (the first of its group)
+    std::vector<std::size_t> kept;
+  };
+
+  namespace detail {
+
+    inline uint64_t hash_cell(int64_t pX, int64_t pY, int64_t pZ)
+    {
+      // The finalizer of SplitMix64 over a combination of the coordinates
+      auto hh = (uint64_t) pX * 0x9e3779b97f4a7c15ULL ^
+        (uint64_t) pY * 0xc2b2ae3d27d4eb4fULL ^ (uint64_t) pZ * 0x165667b19e3779f9ULL;
+      hh = (hh ^ (hh >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      hh = (hh ^ (hh >> 27)) * 0x94d049bb133111ebULL;
+      return hh ^ (hh >> 31);
+    }
+
+    // Maps the hash of a cell to the range of the vertices of the cell in
+    // the sorted order (open addressing with linear probing)
+    class cell_table {
+    public:
+      cell_table(std::size_t pNumCells)
+      {
+        auto capacity = (std::size_t) 16;
+        while (capacity < 2 * pNumCells)
+          capacity *= 2;
+        mMask = capacity - 1;
+        mKeys.resize(capacity);
+        mRanges.resize(capacity, {0, 0});
+      }
+
+      void insert(uint64_t pKey, std::size_t pBegin, std::size_t pEnd)
+      {
+        for (auto slot = pKey & mMask;; slot = (slot + 1) & mMask)
+          if (mRanges[slot].second == 0) {
+            mKeys[slot] = pKey;
+            mRanges[slot] = {pBegin, pEnd};
+            return;
+          }
+      }
+
+      // An empty range if there is no such cell
+      std::pair<std::size_t, std::size_t> find(uint64_t pKey) const
+      {
+        for (auto slot = pKey & mMask;; slot = (slot + 1) & mMask) {
+          if (mRanges[slot].second == 0)
+            return {0, 0};
+          if (mKeys[slot] == pKey)
+            return mRanges[slot];
+        }
+      }
+
+    private:
+      std::size_t mMask;
+      std::vector<uint64_t> mKeys;
+      // Ranges are never empty, hence an end of zero marks a free slot
+      std::vector<std::pair<std::size_t, std::size_t> > mRanges;
+    };
+  }
+
+  // Welds the vertices within pTolerance of each other. A tolerance of zero
+  // welds coincident vertices only.
+  template<typename numeric_type>
+  weld_result
+  weld_vertices
+  (d2d::util::array_view<d2d::util::triple<numeric_type> const> pVertices,
+   double pTolerance)
+  {
+    d2d::util::profile::phase phase {"weld"};
+    phase.set_items(pVertices.size());
+    auto num = pVertices.size();
+    auto exact = !(pTolerance > 0);
+    if (!exact) {
+      // The cells are indexed by 64 bit integers (and their neighbours by
+      // those +-1); coordinates beyond that in units of the tolerance, or
+      // which are not finite, cannot be put into cells
+      auto const maxcell = std::ldexp(1.0, 62);
+      for (std::size_t idx = 0; idx < num; ++idx)
+        for (std::size_t cc = 0; cc < 3; ++cc)
+          if (!(std::fabs((double) pVertices[idx][cc] / pTolerance) < maxcell)) {
+            char tolerance[32];
+            std::snprintf(tolerance, sizeof(tolerance), "%g", pTolerance);
+            throw std::runtime_error
+              (std::string {"The weld tolerance "} + tolerance +
+               " is too small for the coordinates of the vertices (or they are not finite)");
+          }
+    }
+    auto cellof = [&](d2d::util::triple<numeric_type> const& pV) {
+      auto cell = d2d::util::triple<int64_t> {};
+      for (std::size_t cc = 0; cc < 3; ++cc)
+        cell[cc] = (int64_t) std::floor((double) pV[cc] / pTolerance);
+      return cell;
+    };
+    auto keyof = [&](d2d::util::triple<numeric_type> const& pV) {
+      if (exact) {
+        // The bits of the coordinates; -0 and 0 differ, which is harmless
+        auto bits = d2d::util::triple<int64_t> {0, 0, 0};
+        for (std::size_t cc = 0; cc < 3; ++cc)
+          std::memcpy(&bits[cc], &pV[cc], sizeof(numeric_type));
+        return detail::hash_cell(bits[0], bits[1], bits[2]);
+      }
+      auto cell = cellof(pV);
+      return detail::hash_cell(cell[0], cell[1], cell[2]);
+    };
+
+    auto keys = std::vector<uint64_t> (num);
+    d2d::util::parallel::for_each_range(num, [&](std::size_t pFirst, std::size_t pLast) {
+        for (auto idx = pFirst; idx < pLast; ++idx)
+          keys[idx] = keyof(pVertices[idx]);
+      });
+    auto order = d2d::util::radix_sort(keys);
+    auto numcells = (std::size_t) 0;
+    for (std::size_t idx = 0; idx < num; ++idx)
+      if (idx == 0 || keys[idx] != keys[idx - 1])
+        ++numcells;
+    auto table = detail::cell_table {numcells};
+    for (std::size_t begin = 0, end = 0; begin < num; begin = end) {
+      end = begin + 1;
+      while (end < num && keys[end] == keys[begin])
+        ++end;
+      table.insert(keys[begin], begin, end);
+    }
+
+    // The vertex of lowest index within the tolerance of each vertex
+    auto tolsq = pTolerance * pTolerance;
+    auto lowest = std::vector<std::size_t> (num);
+    d2d::util::parallel::for_each_range(num, [&](std::size_t pFirst, std::size_t pLast) {
+        for (auto idx = pFirst; idx < pLast; ++idx) {
+          auto const& vertex = pVertices[idx];
+          auto best = idx;
+          auto visit = [&](uint64_t pKey) {
+            auto range = table.find(pKey);
+            for (auto sidx = range.first; sidx < range.second; ++sidx) {
+              auto other = order[sidx];
+              if (other >= best)
+                continue;
+              auto distsq = 0.0;
+              for (std::size_t cc = 0; cc < 3; ++cc) {
+                auto diff = (double) pVertices[other][cc] - (double) vertex[cc];
+                distsq += diff * diff;
+              }
+              if (distsq <= tolsq)
+                best = other;
+            }
+          };
+          if (exact) {
+            visit(keyof(vertex));
+          } else {
+            auto cell = cellof(vertex);
+            for (int64_t dx = -1; dx <= 1; ++dx)
+              for (int64_t dy = -1; dy <= 1; ++dy)
+                for (int64_t dz = -1; dz <= 1; ++dz)
+                  visit(detail::hash_cell(cell[0] + dx, cell[1] + dy, cell[2] + dz));
+          }
+          lowest[idx] = best;
+        }
+      });
+
+    // lowest[idx] <= idx, hence the groups resolve in one pass in index order
+    auto result = weld_result {};
+    result.remap.resize(num);
+    for (std::size_t idx = 0; idx < num; ++idx) {
+      if (lowest[idx] == idx) {
+        result.remap[idx] = result.kept.size();
+        result.kept.push_back(idx);
+      } else {
+        result.remap[idx] = result.remap[lowest[idx]];
+      }
+    }
+    return result;
+  }
+
+  // Applies the remapping of weld_vertices() to triangles. Triangles which
+  // degenerate (two corners welded together) are dropped; the indices of
+  // the remaining ones are stored in pKept if given.
+  inline std::vector<d2d::util::triple<std::size_t> >
+  remap_triangles
+  (d2d::util::array_view<d2d::util::triple<std::size_t> const> pTriangles,
+   std::vector<std::size_t> const& pRemap,
+   std::vector<std::size_t>* pKept = nullptr)
+  {
+    if (pKept)
+      pKept->clear();
+    auto result = std::vector<d2d::util::triple<std::size_t> > {};
+    result.reserve(pTriangles.size());
+    for (std::size_t tidx = 0; tidx < pTriangles.size(); ++tidx) {
+      auto const& triangle = pTriangles[tidx];
+      auto remapped = d2d::util::triple<std::size_t>
+        {pRemap[triangle[0]], pRemap[triangle[1]], pRemap[triangle[2]]};
+      if (remapped[0] != remapped[1] && remapped[1] != remapped[2] &&
+          remapped[0] != remapped[2]) {
+        result.push_back(remapped);
+        if (pKept)
+          pKept->push_back(tidx);
+      }
+    }
+    return result;
+  }
+}}
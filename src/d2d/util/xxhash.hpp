@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "d2d/util/parallel.hpp"
+
+// XXH64 (https://github.com/Cyan4973/xxHash), a fast non-cryptographic hash
+// of 64 bits. The results equal the ones of the reference implementation.
+
+namespace d2d { namespace util {
+
+  namespace detail {
+
+    constexpr uint64_t xxPrime1 = 0x9e3779b185ebca87ULL;
+    constexpr uint64_t xxPrime2 = 0xc2b2ae3d27d4eb4fULL;
+    constexpr uint64_t xxPrime3 = 0x165667b19e3779f9ULL;
+    constexpr uint64_t xxPrime4 = 0x85ebca77c2b2ae63ULL;
+    constexpr uint64_t xxPrime5 = 0x27d4eb2f165667c5ULL;
+
+    inline uint64_t xx_rotl(uint64_t pV, unsigned pBits)
+    {
+      return (pV << pBits) | (pV >> (64 - pBits));
+    }
+
+    // Little endian reads, as everywhere in d2d
+    inline uint64_t xx_read64(unsigned char const* pPtr)
+    {
+      uint64_t value;
+      std::memcpy(&value, pPtr, sizeof(value));
+      return value;
+    }
+
+    inline uint64_t xx_read32(unsigned char const* pPtr)
+    {
+      uint32_t value;
+      std::memcpy(&value, pPtr, sizeof(value));
+      return value;
+    }
+
+    inline uint64_t xx_round(uint64_t pAcc, uint64_t pInput)
+    {
+      pAcc += pInput * xxPrime2;
+      pAcc = xx_rotl(pAcc, 31);
+      return pAcc * xxPrime1;
+    }
+
+    inline uint64_t xx_merge_round(uint64_t pAcc, uint64_t pVal)
+    {
+      pAcc ^= xx_round(0, pVal);
+      return pAcc * xxPrime1 + xxPrime4;
+    }
+  }
+
+  inline uint64_t xxhash64(void const* pData, std::size_t pSize, uint64_t pSeed = 0)
+  {
+    using namespace detail;
+    auto ptr = static_cast<unsigned char const*>(pData);
+    auto end = ptr + pSize;
+    uint64_t hh;
+    if (pSize >= 32) {
+      auto v1 = pSeed + xxPrime1 + xxPrime2;
+      auto v2 = pSeed + xxPrime2;
+      auto v3 = pSeed;
+      auto v4 = pSeed - xxPrime1;
+      auto limit = end - 32;
+      do {
+        v1 = xx_round(v1, xx_read64(ptr));
+        v2 = xx_round(v2, xx_read64(ptr + 8));
+        v3 = xx_round(v3, xx_read64(ptr + 16));
+        v4 = xx_round(v4, xx_read64(ptr + 24));
+        ptr += 32;
+      } while (ptr <= limit);
+      hh = xx_rotl(v1, 1) + xx_rotl(v2, 7) + xx_rotl(v3, 12) + xx_rotl(v4, 18);
+      hh = xx_merge_round(hh, v1);
+      hh = xx_merge_round(hh, v2);
+      hh = xx_merge_round(hh, v3);
+      hh = xx_merge_round(hh, v4);
+    } else {
+      hh = pSeed + xxPrime5;
+    }
+    hh += (uint64_t) pSize;
+    for (; ptr + 8 <= end; ptr += 8) {
+      hh ^= xx_round(0, xx_read64(ptr));
+      hh = xx_rotl(hh, 27) * xxPrime1 + xxPrime4;
+    }
+    if (ptr + 4 <= end) {
+      hh ^= xx_read32(ptr) * xxPrime1;
+      hh = xx_rotl(hh, 23) * xxPrime2 + xxPrime3;
+      ptr += 4;
+    }
+    for (; ptr < end; ++ptr) {
+      hh ^= (*ptr) * xxPrime5;
+      hh = xx_rotl(hh, 11) * xxPrime1;
+    }
+    hh ^= hh >> 33;
+    hh *= xxPrime2;
+    hh ^= hh >> 29;
+    hh *= xxPrime3;
+    hh ^= hh >> 32;
+    return hh;
+  }
+
+  // The hash of large buffers: blocks of 16 MiB are hashed in parallel and
+  // their hashes are hashed in turn. The result does not depend on the
+  // number of threads (but differs from xxhash64() for more than one block).
+  inline uint64_t xxhash64_blocks(void const* pData, std::size_t pSize)
+  {
+    std::size_t const blockSize = 16 << 20;
+    auto data = static_cast<char const*>(pData);
+    if (pSize <= blockSize)
+      return xxhash64(data, pSize);
+    auto numblocks = (pSize + blockSize - 1) / blockSize;
+    auto hashes = std::vector<uint64_t> (numblocks);
+    d2d::util::parallel::for_each_index(numblocks, [&](std::size_t pBlock) {
+        auto first = pBlock * blockSize;
+        hashes[pBlock] = xxhash64(data + first, std::min(blockSize, pSize - first));
+      });
+    return xxhash64(hashes.data(), hashes.size() * sizeof(uint64_t), pSize);
+  }
+}}